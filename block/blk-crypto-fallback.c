@@ -30,6 +30,11 @@ module_param_named(num_keyslots, blk_crypto_num_keyslots, uint, 0);
 MODULE_PARM_DESC(num_keyslots,
 		 "Number of keyslots for the blk-crypto crypto API fallback");
 
+static unsigned int parallel_encrypt_min_segs = 32;
+module_param(parallel_encrypt_min_segs, uint, 0644);
+MODULE_PARM_DESC(parallel_encrypt_min_segs,
+		 "Minimum number of segments each CPU encrypts when the blk-crypto crypto API fallback splits a bio across CPUs (0 to disable)");
+
 static unsigned int num_prealloc_fallback_crypt_ctxs = 128;
 module_param(num_prealloc_fallback_crypt_ctxs, uint, 0);
 MODULE_PARM_DESC(num_prealloc_crypt_fallback_ctxs,
@@ -198,20 +203,18 @@ static struct bio *blk_crypto_clone_bio(struct bio *bio_src)
 	return bio;
 }
 
-static int blk_crypto_alloc_cipher_req(struct bio *src_bio,
+static int blk_crypto_alloc_cipher_req(const struct bio_crypt_ctx *bc,
 				       struct skcipher_request **ciph_req_ret,
 				       struct crypto_wait *wait)
 {
 	struct skcipher_request *ciph_req;
 	const struct blk_crypto_keyslot *slotp;
 
-	slotp = &blk_crypto_keyslots[src_bio->bi_crypt_context->bc_keyslot];
+	slotp = &blk_crypto_keyslots[bc->bc_keyslot];
 	ciph_req = skcipher_request_alloc(slotp->tfms[slotp->crypto_mode],
 					  GFP_NOIO);
-	if (!ciph_req) {
-		src_bio->bi_status = BLK_STS_RESOURCE;
+	if (!ciph_req)
 		return -ENOMEM;
-	}
 
 	skcipher_request_set_callback(ciph_req,
 				      CRYPTO_TFM_REQ_MAY_BACKLOG |
@@ -264,77 +267,53 @@ static void blk_crypto_dun_to_iv(const u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE],
 }
 
 /*
- * The crypto API fallback's encryption routine.
- * Allocate a bounce bio for encryption, encrypt the input bio using crypto API,
- * and replace *bio_ptr with the bounce bio. May split input bio if it's too
- * large.
+ * Encrypt the bvecs [@start, @end) of @enc_bio, replacing each plaintext page
+ * with a bounce page from blk_crypto_bounce_page_pool. @start_dun is the DUN
+ * of the first data unit in the range. *@nr_bounced is set to the number of
+ * bvecs whose page was replaced, so that the caller can free the bounce pages
+ * on failure.
  */
-static int blk_crypto_encrypt_bio(struct bio **bio_ptr)
+static int blk_crypto_encrypt_bvecs(const struct bio_crypt_ctx *bc,
+				    struct bio *enc_bio,
+				    unsigned int start, unsigned int end,
+				    const u64 start_dun[BLK_CRYPTO_DUN_ARRAY_SIZE],
+				    unsigned int *nr_bounced)
 {
-	struct bio *src_bio;
 	struct skcipher_request *ciph_req = NULL;
 	DECLARE_CRYPTO_WAIT(wait);
 	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
 	union blk_crypto_iv iv;
 	struct scatterlist src, dst;
-	struct bio *enc_bio;
+	const unsigned int data_unit_size = bc->bc_key->data_unit_size;
 	unsigned int i, j;
-	int data_unit_size;
-	struct bio_crypt_ctx *bc;
-	int err = 0;
-
-	/* Split the bio if it's too big for single page bvec */
-	err = blk_crypto_split_bio_if_needed(bio_ptr);
-	if (err)
-		return err;
-
-	src_bio = *bio_ptr;
-	bc = src_bio->bi_crypt_context;
-	data_unit_size = bc->bc_key->data_unit_size;
-
-	/* Allocate bounce bio for encryption */
-	enc_bio = blk_crypto_clone_bio(src_bio);
-	if (!enc_bio) {
-		src_bio->bi_status = BLK_STS_RESOURCE;
-		return -ENOMEM;
-	}
+	int err;
 
-	/*
-	 * Use the crypto API fallback keyslot manager to get a crypto_skcipher
-	 * for the algorithm and key specified for this bio.
-	 */
-	err = bio_crypt_ctx_acquire_keyslot(bc, blk_crypto_ksm);
-	if (err) {
-		src_bio->bi_status = BLK_STS_IOERR;
-		goto out_put_enc_bio;
-	}
+	*nr_bounced = 0;
 
-	/* and then allocate an skcipher_request for it */
-	err = blk_crypto_alloc_cipher_req(src_bio, &ciph_req, &wait);
+	err = blk_crypto_alloc_cipher_req(bc, &ciph_req, &wait);
 	if (err)
-		goto out_release_keyslot;
+		return err;
 
-	memcpy(curr_dun, bc->bc_dun, sizeof(curr_dun));
+	memcpy(curr_dun, start_dun, sizeof(curr_dun));
 	sg_init_table(&src, 1);
 	sg_init_table(&dst, 1);
 
 	skcipher_request_set_crypt(ciph_req, &src, &dst, data_unit_size,
 				   iv.bytes);
 
-	/* Encrypt each page in the bounce bio */
-	for (i = 0; i < enc_bio->bi_vcnt; i++) {
+	/* Encrypt each page in the range */
+	for (i = start; i < end; i++) {
 		struct bio_vec *enc_bvec = &enc_bio->bi_io_vec[i];
 		struct page *plaintext_page = enc_bvec->bv_page;
 		struct page *ciphertext_page =
 			mempool_alloc(blk_crypto_bounce_page_pool, GFP_NOIO);
 
-		enc_bvec->bv_page = ciphertext_page;
-
 		if (!ciphertext_page) {
-			src_bio->bi_status = BLK_STS_RESOURCE;
 			err = -ENOMEM;
-			goto out_free_bounce_pages;
+			goto out;
 		}
+		enc_bvec->bv_page = ciphertext_page;
+		(*nr_bounced)++;
 
 		sg_set_page(&src, plaintext_page, data_unit_size,
 			    enc_bvec->bv_offset);
@@ -346,32 +325,206 @@ static int blk_crypto_encrypt_bio(struct bio **bio_ptr)
 			blk_crypto_dun_to_iv(curr_dun, &iv);
 			err = crypto_wait_req(crypto_skcipher_encrypt(ciph_req),
 					      &wait);
-			if (err) {
-				i++;
-				src_bio->bi_status = BLK_STS_RESOURCE;
-				goto out_free_bounce_pages;
-			}
+			if (err)
+				goto out;
 			bio_crypt_dun_increment(curr_dun, 1);
 			src.offset += data_unit_size;
 			dst.offset += data_unit_size;
 		}
 	}
+out:
+	skcipher_request_free(ciph_req);
+	return err;
+}
+
+/*
+ * A contiguous range of bvecs of a bounce bio, encrypted by one CPU when
+ * a large bio is encrypted in parallel.
+ */
+struct blk_crypto_encrypt_chunk {
+	struct work_struct work;
+	const struct bio_crypt_ctx *bc;
+	struct bio *enc_bio;
+	unsigned int start;
+	unsigned int end;
+	unsigned int nr_bounced;
+	u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
+	int err;
+	atomic_t *pending;
+	struct completion *done;
+};
+
+static void blk_crypto_encrypt_chunk(struct blk_crypto_encrypt_chunk *chunk)
+{
+	chunk->err = blk_crypto_encrypt_bvecs(chunk->bc, chunk->enc_bio,
+					      chunk->start, chunk->end,
+					      chunk->dun, &chunk->nr_bounced);
+	if (atomic_dec_and_test(chunk->pending))
+		complete(chunk->done);
+}
+
+static void blk_crypto_encrypt_chunk_work(struct work_struct *work)
+{
+	blk_crypto_encrypt_chunk(container_of(work,
+					      struct blk_crypto_encrypt_chunk,
+					      work));
+}
+
+/*
+ * Decide how many chunks to split the encryption of @enc_bio into. Only bios
+ * with at least two chunks' worth of segments are encrypted in parallel, and
+ * never on more CPUs than are online.
+ */
+static unsigned int blk_crypto_nr_encrypt_chunks(const struct bio *enc_bio)
+{
+	unsigned int min_segs = READ_ONCE(parallel_encrypt_min_segs);
+	unsigned int nr_chunks;
+
+	if (!min_segs)
+		return 1;
+
+	nr_chunks = enc_bio->bi_vcnt / min_segs;
+	return clamp(nr_chunks, 1U, num_online_cpus());
+}
+
+/*
+ * Split the bvecs of @enc_bio into @nr_chunks contiguous ranges, encrypt all
+ * but the first one on blk_crypto_wq and the first one on the submitting CPU,
+ * then wait for all of them to finish.
+ */
+static void blk_crypto_encrypt_chunks(const struct bio_crypt_ctx *bc,
+				      struct bio *enc_bio,
+				      struct blk_crypto_encrypt_chunk *chunks,
+				      unsigned int nr_chunks)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	atomic_t pending = ATOMIC_INIT(nr_chunks);
+	const unsigned int data_unit_size = bc->bc_key->data_unit_size;
+	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
+	unsigned int i, c;
+
+	memcpy(curr_dun, bc->bc_dun, sizeof(curr_dun));
+	i = 0;
+	for (c = 0; c < nr_chunks; c++) {
+		struct blk_crypto_encrypt_chunk *chunk = &chunks[c];
+
+		chunk->bc = bc;
+		chunk->enc_bio = enc_bio;
+		chunk->start = i;
+		/* bi_vcnt is at most BIO_MAX_PAGES, this can't overflow */
+		chunk->end = enc_bio->bi_vcnt * (c + 1) / nr_chunks;
+		chunk->nr_bounced = 0;
+		chunk->err = 0;
+		chunk->pending = &pending;
+		chunk->done = &done;
+		memcpy(chunk->dun, curr_dun, sizeof(curr_dun));
+
+		/* Advance the DUN past the data units of this chunk */
+		for (; i < chunk->end; i++)
+			bio_crypt_dun_increment(curr_dun,
+				enc_bio->bi_io_vec[i].bv_len / data_unit_size);
+
+		if (c > 0) {
+			INIT_WORK(&chunk->work, blk_crypto_encrypt_chunk_work);
+			queue_work(blk_crypto_wq, &chunk->work);
+		}
+	}
+
+	blk_crypto_encrypt_chunk(&chunks[0]);
+	wait_for_completion(&done);
+}
+
+/*
+ * The crypto API fallback's encryption routine.
+ * Allocate a bounce bio for encryption, encrypt the input bio using crypto API,
+ * and replace *bio_ptr with the bounce bio. May split input bio if it's too
+ * large. Large bios are encrypted on several CPUs at once.
+ */
+static int blk_crypto_encrypt_bio(struct bio **bio_ptr)
+{
+	struct bio *src_bio;
+	struct blk_crypto_encrypt_chunk one_chunk;
+	struct blk_crypto_encrypt_chunk *chunks = &one_chunk;
+	unsigned int nr_chunks;
+	struct bio *enc_bio;
+	unsigned int i, c;
+	struct bio_crypt_ctx *bc;
+	int err = 0;
+
+	/* Split the bio if it's too big for single page bvec */
+	err = blk_crypto_split_bio_if_needed(bio_ptr);
+	if (err)
+		return err;
+
+	src_bio = *bio_ptr;
+	bc = src_bio->bi_crypt_context;
+
+	/* Allocate bounce bio for encryption */
+	enc_bio = blk_crypto_clone_bio(src_bio);
+	if (!enc_bio) {
+		src_bio->bi_status = BLK_STS_RESOURCE;
+		return -ENOMEM;
+	}
+
+	/*
+	 * Use the crypto API fallback keyslot manager to get a crypto_skcipher
+	 * for the algorithm and key specified for this bio.
+	 */
+	err = bio_crypt_ctx_acquire_keyslot(bc, blk_crypto_ksm);
+	if (err) {
+		src_bio->bi_status = BLK_STS_IOERR;
+		goto out_put_enc_bio;
+	}
+
+	/*
+	 * Each chunk uses its own skcipher_request on the keyslot's tfm, so
+	 * the chunks can be encrypted concurrently. If the chunk array can't
+	 * be allocated, just encrypt the whole bio on this CPU.
+	 */
+	nr_chunks = blk_crypto_nr_encrypt_chunks(enc_bio);
+	if (nr_chunks > 1) {
+		chunks = kmalloc_array(nr_chunks, sizeof(*chunks), GFP_NOIO);
+		if (!chunks) {
+			chunks = &one_chunk;
+			nr_chunks = 1;
+		}
+	}
+
+	if (nr_chunks > 1) {
+		blk_crypto_encrypt_chunks(bc, enc_bio, chunks, nr_chunks);
+	} else {
+		one_chunk.err = blk_crypto_encrypt_bvecs(bc, enc_bio, 0,
+							 enc_bio->bi_vcnt,
+							 bc->bc_dun,
+							 &one_chunk.nr_bounced);
+		one_chunk.start = 0;
+	}
+
+	for (c = 0; c < nr_chunks; c++) {
+		if (chunks[c].err) {
+			err = chunks[c].err;
+			src_bio->bi_status = BLK_STS_RESOURCE;
+		}
+	}
+	if (err)
+		goto out_free_bounce_pages;
 
 	enc_bio->bi_private = src_bio;
 	enc_bio->bi_end_io = blk_crypto_encrypt_endio;
 	*bio_ptr = enc_bio;
 
 	enc_bio = NULL;
-	err = 0;
-	goto out_free_ciph_req;
+	goto out_free_chunks;
 
 out_free_bounce_pages:
-	while (i > 0)
-		mempool_free(enc_bio->bi_io_vec[--i].bv_page,
-			     blk_crypto_bounce_page_pool);
-out_free_ciph_req:
-	skcipher_request_free(ciph_req);
-out_release_keyslot:
+	for (c = 0; c < nr_chunks; c++) {
+		for (i = 0; i < chunks[c].nr_bounced; i++)
+			mempool_free(enc_bio->bi_io_vec[chunks[c].start + i].bv_page,
+				     blk_crypto_bounce_page_pool);
+	}
+out_free_chunks:
+	if (chunks != &one_chunk)
+		kfree(chunks);
 	bio_crypt_ctx_release_keyslot(bc);
 out_put_enc_bio:
 	if (enc_bio)
@@ -422,9 +575,11 @@ static void blk_crypto_decrypt_bio(struct work_struct *work)
 	}
 
 	/* and then allocate an skcipher_request for it */
-	err = blk_crypto_alloc_cipher_req(bio, &ciph_req, &wait);
-	if (err)
+	err = blk_crypto_alloc_cipher_req(bc, &ciph_req, &wait);
+	if (err) {
+		bio->bi_status = BLK_STS_RESOURCE;
 		goto out;
+	}
 
 	memcpy(curr_dun, f_ctx->fallback_dun, sizeof(curr_dun));
 	sg_init_table(&sg, 1);
@@ -46,8 +46,15 @@
  * If needed, tools/cgroup/iocost_coef_gen.py can be used to generate
  * device-specific coefficients.
  *
- * If needed, tools/cgroup/iocost_coef_gen.py can be used to generate
- * device-specific coefficients.
+ * Alternatively, writing "ctrl=calib" to io.cost.model makes the
+ * controller derive the coefficients from the IOs the device is actually
+ * serving.  Only IOs which had the device to themselves from issue to
+ * completion are sampled, so that their latency is the pure device time.
+ * The samples of each direction are fitted to a base cost per seq and rand
+ * IO plus a shared per-page cost.  Once enough seq and rand reads and
+ * writes have been seen, the fitted coefficients are installed as a user
+ * cost model.  As QD1 latencies don't capture device parallelism, the
+ * resulting model is conservative and vrate adjustment makes up the rest.
  *
  * 2. Control Strategy
  *
@@ -302,6 +309,17 @@ enum {
 
 	/* if apart further than 16M, consider randio for linear model */
 	LCOEF_RANDIO_PAGES	= 4096,
+
+	/*
+	 * Cost model calibration collects this many samples for each of
+	 * seq/rand reads/writes.  Together with the latency cap, this keeps
+	 * the regression sums well within 64bit.
+	 */
+	IOC_CALIB_NR_SAMPLES	= 1024,
+	IOC_CALIB_MAX_LAT_NS	= NSEC_PER_SEC,
+
+	/* fixed point scale of the fitted per-IO and per-page costs */
+	IOC_CALIB_SCALE		= 1024,
 };
 
 enum ioc_running {
@@ -388,6 +406,29 @@ struct ioc_pcpu_stat {
 	u64				last_rq_wait_ns;
 };
 
+/* latency samples of IOs which had the device to themselves */
+struct ioc_calib_stat {
+	u32				nr;
+	u64				sum_pages;
+	u64				sum_pages_sq;
+	u64				sum_ns;
+	u64				sum_pages_ns;
+};
+
+/* cost model calibration state, see ioc_calib_done() */
+struct ioc_calib {
+	spinlock_t			lock;
+	bool				active;
+	u64				start_ns;
+
+	int				nr_inflight;
+	int				nr_issued;	/* since last idle */
+	bool				first_rand;	/* first IO after idle */
+	sector_t			cursor;
+
+	struct ioc_calib_stat		stat[2][2];	/* [rw][is_rand] */
+};
+
 /* per device */
 struct ioc {
 	struct rq_qos			rqos;
@@ -424,6 +465,8 @@ struct ioc {
 	int				autop_idx;
 	bool				user_qos_params:1;
 	bool				user_cost_model:1;
+
+	struct ioc_calib		calib;
 };
 
 /* per device-cgroup pair */
@@ -1450,6 +1493,9 @@ static void ioc_timer_fn(struct timer_list *timer)
 			usage = 0;
 		}
 
+		TRACE_IOCG_PATH(iocg_period, iocg, &now, vtime, vdone, usage,
+				hw_active, hw_inuse);
+
 		/* see whether there's surplus vtime */
 		vmargin = ioc->margin_us * now.vrate;
 		vmin = now.vnow - vmargin;
@@ -1880,6 +1926,217 @@ static void ioc_rqos_merge(struct rq_qos *rqos, struct request *rq,
 	spin_unlock_irqrestore(&iocg->waitq.lock, flags);
 }
 
+static void ioc_calib_start(struct ioc *ioc)
+{
+	struct ioc_calib *calib = &ioc->calib;
+	unsigned long flags;
+
+	/* calibration hooks into ->issue() which needs stats accounting */
+	blk_stat_enable_accounting(ioc->rqos.q);
+
+	spin_lock_irqsave(&calib->lock, flags);
+	memset(calib->stat, 0, sizeof(calib->stat));
+	calib->nr_inflight = 0;
+	calib->nr_issued = 0;
+	calib->cursor = 0;
+	calib->start_ns = ktime_get_ns();
+	calib->active = true;
+	spin_unlock_irqrestore(&calib->lock, flags);
+}
+
+static void ioc_calib_stop(struct ioc *ioc)
+{
+	struct ioc_calib *calib = &ioc->calib;
+	unsigned long flags;
+
+	spin_lock_irqsave(&calib->lock, flags);
+	calib->active = false;
+	spin_unlock_irqrestore(&calib->lock, flags);
+}
+
+/* was @rq issued after the current calibration started? */
+static bool ioc_calib_tracked(struct ioc_calib *calib, struct request *rq)
+{
+	lockdep_assert_held(&calib->lock);
+
+	return calib->active && (rq->rq_flags & RQF_STATS) &&
+		rq->io_start_time_ns >= calib->start_ns;
+}
+
+/*
+ * Fit latency = base cost + pages * page cost to the seq and rand samples
+ * of one direction with the page cost shared between the two, and convert
+ * the result into the bps, seqiops and randiops of io.cost.model.  If all
+ * samples were of the same size, the page cost can't be told apart from
+ * the base cost and the current @bps is kept.
+ */
+static void calc_calib_i_lcoefs(const struct ioc_calib_stat *stat,
+				u64 *bps, u64 *seqiops, u64 *randiops)
+{
+	u64 *iops[2] = { seqiops, randiops };
+	s64 sxx = 0, sxy = 0;
+	u64 page_cost = 0;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		const struct ioc_calib_stat *st = &stat[i];
+
+		sxx += st->sum_pages_sq -
+			div64_u64(st->sum_pages * st->sum_pages, st->nr);
+		sxy += st->sum_pages_ns -
+			div64_u64(st->sum_pages * st->sum_ns, st->nr);
+	}
+
+	if (sxx > 0 && sxy > 0) {
+		page_cost = div64_s64(sxy * IOC_CALIB_SCALE, sxx);
+		if (page_cost)
+			*bps = div64_u64((u64)IOC_PAGE_SIZE * NSEC_PER_SEC *
+					 IOC_CALIB_SCALE, page_cost);
+	} else if (*bps) {
+		page_cost = div64_u64((u64)IOC_PAGE_SIZE * NSEC_PER_SEC *
+				      IOC_CALIB_SCALE, *bps);
+	}
+
+	for (i = 0; i < 2; i++) {
+		const struct ioc_calib_stat *st = &stat[i];
+		s64 base_cost;
+		u64 io_cost;
+
+		base_cost = div64_s64((s64)(st->sum_ns * IOC_CALIB_SCALE) -
+				      (s64)(page_cost * st->sum_pages), st->nr);
+		/* @seqiops and @randiops are for 4k IOs */
+		io_cost = max_t(s64, base_cost, 0) + page_cost;
+		if (io_cost)
+			*iops[i] = div64_u64((u64)NSEC_PER_SEC * IOC_CALIB_SCALE,
+					     io_cost);
+	}
+}
+
+static void ioc_calib_apply(struct ioc *ioc, struct ioc_calib_stat stat[2][2])
+{
+	u64 *u = ioc->params.i_lcoefs;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	calc_calib_i_lcoefs(stat[READ], &u[I_LCOEF_RBPS],
+			    &u[I_LCOEF_RSEQIOPS], &u[I_LCOEF_RRANDIOPS]);
+	calc_calib_i_lcoefs(stat[WRITE], &u[I_LCOEF_WBPS],
+			    &u[I_LCOEF_WSEQIOPS], &u[I_LCOEF_WRANDIOPS]);
+	ioc->user_cost_model = true;
+	ioc_refresh_params(ioc, true);
+	trace_iocost_ioc_calib(ioc, u);
+	spin_unlock_irqrestore(&ioc->lock, flags);
+}
+
+static void ioc_rqos_issue(struct rq_qos *rqos, struct request *rq)
+{
+	struct ioc_calib *calib = &rqos_to_ioc(rqos)->calib;
+	unsigned long flags;
+
+	if (!READ_ONCE(calib->active))
+		return;
+
+	spin_lock_irqsave(&calib->lock, flags);
+	if (!ioc_calib_tracked(calib, rq))
+		goto out_unlock;
+
+	/* remember how the first IO after an idle stretch should be costed */
+	if (!calib->nr_inflight) {
+		sector_t pos = blk_rq_pos(rq);
+		sector_t seek = pos > calib->cursor ? pos - calib->cursor :
+						      calib->cursor - pos;
+
+		calib->first_rand = calib->cursor &&
+			(seek >> IOC_SECT_TO_PAGE_SHIFT) > LCOEF_RANDIO_PAGES;
+		calib->nr_issued = 0;
+	}
+	calib->nr_inflight++;
+	calib->nr_issued++;
+	calib->cursor = blk_rq_pos(rq) + blk_rq_sectors(rq);
+out_unlock:
+	spin_unlock_irqrestore(&calib->lock, flags);
+}
+
+static void ioc_rqos_requeue(struct rq_qos *rqos, struct request *rq)
+{
+	struct ioc_calib *calib = &rqos_to_ioc(rqos)->calib;
+	unsigned long flags;
+
+	if (!READ_ONCE(calib->active))
+		return;
+
+	/* the device didn't serve @rq alone, don't sample this stretch */
+	spin_lock_irqsave(&calib->lock, flags);
+	if (ioc_calib_tracked(calib, rq) && calib->nr_inflight) {
+		calib->nr_inflight--;
+		calib->nr_issued++;
+	}
+	spin_unlock_irqrestore(&calib->lock, flags);
+}
+
+/*
+ * Called on each request completion while calibrating.  If @rq was the only
+ * IO the device saw between two idle points, its issue-to-completion
+ * latency is recorded.  Once enough samples of every kind are in, the
+ * fitted model is installed.
+ */
+static void ioc_calib_done(struct ioc *ioc, struct request *rq)
+{
+	struct ioc_calib *calib = &ioc->calib;
+	struct ioc_calib_stat stat[2][2];
+	struct ioc_calib_stat *st;
+	bool finished = false;
+	unsigned long flags;
+	u64 lat_ns, pages;
+	int rw, i;
+
+	spin_lock_irqsave(&calib->lock, flags);
+	if (!ioc_calib_tracked(calib, rq) || !calib->nr_inflight)
+		goto out_unlock;
+	if (--calib->nr_inflight || calib->nr_issued != 1)
+		goto out_unlock;
+
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		rw = READ;
+		break;
+	case REQ_OP_WRITE:
+		rw = WRITE;
+		break;
+	default:
+		goto out_unlock;
+	}
+
+	lat_ns = ktime_get_ns() - rq->io_start_time_ns;
+	if (lat_ns > IOC_CALIB_MAX_LAT_NS)
+		goto out_unlock;
+	pages = max_t(u64, rq->stats_sectors >> IOC_SECT_TO_PAGE_SHIFT, 1);
+
+	st = &calib->stat[rw][calib->first_rand];
+	if (st->nr >= IOC_CALIB_NR_SAMPLES)
+		goto out_unlock;
+
+	st->nr++;
+	st->sum_pages += pages;
+	st->sum_pages_sq += pages * pages;
+	st->sum_ns += lat_ns;
+	st->sum_pages_ns += pages * lat_ns;
+
+	finished = true;
+	for (i = 0; i < 4; i++)
+		if (calib->stat[i / 2][i % 2].nr < IOC_CALIB_NR_SAMPLES)
+			finished = false;
+	if (finished) {
+		memcpy(stat, calib->stat, sizeof(stat));
+		calib->active = false;
+	}
+out_unlock:
+	spin_unlock_irqrestore(&calib->lock, flags);
+
+	if (finished)
+		ioc_calib_apply(ioc, stat);
+}
+
 static void ioc_rqos_done_bio(struct rq_qos *rqos, struct bio *bio)
 {
 	struct ioc_gq *iocg = blkg_to_iocg(bio->bi_blkg);
@@ -1894,6 +2151,9 @@ static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 	u64 on_q_ns, rq_wait_ns;
 	int pidx, rw;
 
+	if (READ_ONCE(ioc->calib.active))
+		ioc_calib_done(ioc, rq);
+
 	if (!ioc->enabled || !rq->alloc_time_ns || !rq->start_time_ns)
 		return;
 
@@ -1948,6 +2208,8 @@ static void ioc_rqos_exit(struct rq_qos *rqos)
 static struct rq_qos_ops ioc_rqos_ops = {
 	.throttle = ioc_rqos_throttle,
 	.merge = ioc_rqos_merge,
+	.issue = ioc_rqos_issue,
+	.requeue = ioc_rqos_requeue,
 	.done_bio = ioc_rqos_done_bio,
 	.done = ioc_rqos_done,
 	.queue_depth_changed = ioc_rqos_queue_depth_changed,
@@ -1976,6 +2238,7 @@ static int blk_iocost_init(struct request_queue *q)
 	rqos->q = q;
 
 	spin_lock_init(&ioc->lock);
+	spin_lock_init(&ioc->calib.lock);
 	timer_setup(&ioc->timer, ioc_timer_fn, 0);
 	INIT_LIST_HEAD(&ioc->active_iocgs);
 
@@ -2360,7 +2623,8 @@ static u64 ioc_cost_model_prfill(struct seq_file *sf,
 	seq_printf(sf, "%s ctrl=%s model=linear "
 		   "rbps=%llu rseqiops=%llu rrandiops=%llu "
 		   "wbps=%llu wseqiops=%llu wrandiops=%llu\n",
-		   dname, ioc->user_cost_model ? "user" : "auto",
+		   dname, READ_ONCE(ioc->calib.active) ? "calib" :
+		   ioc->user_cost_model ? "user" : "auto",
 		   u[I_LCOEF_RBPS], u[I_LCOEF_RSEQIOPS], u[I_LCOEF_RRANDIOPS],
 		   u[I_LCOEF_WBPS], u[I_LCOEF_WSEQIOPS], u[I_LCOEF_WRANDIOPS]);
 	return 0;
@@ -2397,7 +2661,7 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	struct gendisk *disk;
 	struct ioc *ioc;
 	u64 u[NR_I_LCOEFS];
-	bool user;
+	bool user, calib = false;
 	char *p;
 	int ret;
 
@@ -2434,6 +2698,8 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 				user = false;
 			else if (!strcmp(buf, "user"))
 				user = true;
+			else if (!strcmp(buf, "calib"))
+				calib = true;
 			else
 				goto einval;
 			continue;
@@ -2463,6 +2729,12 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	ioc_refresh_params(ioc, true);
 	spin_unlock_irq(&ioc->lock);
 
+	/* the current model stays in effect until calibration finishes */
+	if (calib)
+		ioc_calib_start(ioc);
+	else
+		ioc_calib_stop(ioc);
+
 	put_disk_and_module(disk);
 	return nbytes;
 
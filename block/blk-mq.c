@@ -506,22 +506,17 @@ static void __blk_mq_free_request(struct request *rq)
 	blk_queue_exit(q);
 }
 
-void blk_mq_free_request(struct request *rq)
+/*
+ * Drop the accounting a request holds while it is allocated and mark it idle.
+ * Returns true if the caller dropped the last reference and has to release
+ * the request's tags.
+ */
+static bool blk_mq_release_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
-	struct elevator_queue *e = q->elevator;
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
 	struct blk_mq_hw_ctx *hctx = rq->mq_hctx;
 
-	if (rq->rq_flags & RQF_ELVPRIV) {
-		if (e && e->type->ops.finish_request)
-			e->type->ops.finish_request(rq);
-		if (rq->elv.icq) {
-			put_io_context(rq->elv.icq->ioc);
-			rq->elv.icq = NULL;
-		}
-	}
-
 	ctx->rq_completed[rq_is_sync(rq)]++;
 	if (rq->rq_flags & RQF_MQ_INFLIGHT)
 		atomic_dec(&hctx->nr_active);
@@ -532,7 +527,24 @@ void blk_mq_free_request(struct request *rq)
 	rq_qos_done(q, rq);
 
 	WRITE_ONCE(rq->state, MQ_RQ_IDLE);
-	if (refcount_dec_and_test(&rq->ref))
+	return refcount_dec_and_test(&rq->ref);
+}
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct elevator_queue *e = q->elevator;
+
+	if (rq->rq_flags & RQF_ELVPRIV) {
+		if (e && e->type->ops.finish_request)
+			e->type->ops.finish_request(rq);
+		if (rq->elv.icq) {
+			put_io_context(rq->elv.icq->ioc);
+			rq->elv.icq = NULL;
+		}
+	}
+
+	if (blk_mq_release_request(rq))
 		__blk_mq_free_request(rq);
 }
 EXPORT_SYMBOL_GPL(blk_mq_free_request);
@@ -571,6 +583,114 @@ void blk_mq_end_request(struct request *rq, blk_status_t error)
 }
 EXPORT_SYMBOL(blk_mq_end_request);
 
+/**
+ * blk_mq_add_to_batch - queue a completed request on a completion batch
+ * @rq:		the request being completed
+ * @batch:	the batch to add @rq to, may be %NULL
+ * @error:	the completion status of @rq
+ *
+ * Description:
+ *	Drivers that reap many completions in one pass, e.g. from ->poll(),
+ *	can collect them in a &struct blk_mq_comp_batch and end them all at
+ *	once with blk_mq_end_request_batch(). Only requests that completed
+ *	successfully and need no elevator or ->end_io handling are batched.
+ *	If this returns false, the driver must complete @rq as usual.
+ *	@rq is linked into @batch through rq->queuelist.
+ **/
+bool blk_mq_add_to_batch(struct request *rq, struct blk_mq_comp_batch *batch,
+			 blk_status_t error)
+{
+	struct request_queue *q = rq->q;
+
+	if (!batch || error || rq->end_io || q->elevator)
+		return false;
+	if (unlikely(blk_should_fake_timeout(q)))
+		return false;
+
+	WRITE_ONCE(rq->state, MQ_RQ_COMPLETE);
+	if (blk_mq_need_time_stamp(rq))
+		batch->need_ts = true;
+	list_add_tail(&rq->queuelist, &batch->list);
+	return true;
+}
+EXPORT_SYMBOL_GPL(blk_mq_add_to_batch);
+
+#define BLK_MQ_TAG_COMP_BATCH	32
+
+static void blk_mq_flush_tag_batch(struct blk_mq_hw_ctx *hctx, int *tag_array,
+				   int nr_tags)
+{
+	struct request_queue *q = hctx->queue;
+
+	blk_mq_put_tags(hctx->tags, tag_array, nr_tags);
+	blk_mq_sched_restart(hctx);
+	percpu_ref_put_many(&q->q_usage_counter, nr_tags);
+}
+
+/**
+ * blk_mq_end_request_batch - end all requests of a completion batch
+ * @batch:	requests added with blk_mq_add_to_batch()
+ *
+ * Description:
+ *	Ends every request in @batch like blk_mq_end_request() with
+ *	%BLK_STS_OK would. All requests share one completion time stamp, and
+ *	the tags of consecutive requests on the same hardware queue are
+ *	freed together. @batch is empty on return.
+ **/
+void blk_mq_end_request_batch(struct blk_mq_comp_batch *batch)
+{
+	int tags[BLK_MQ_TAG_COMP_BATCH], nr_tags = 0;
+	struct blk_mq_hw_ctx *cur_hctx = NULL;
+	struct request *rq, *next;
+	u64 now = 0;
+
+	if (list_empty(&batch->list))
+		return;
+
+	if (batch->need_ts)
+		now = ktime_get_ns();
+
+	list_for_each_entry_safe(rq, next, &batch->list, queuelist) {
+		struct blk_mq_hw_ctx *hctx = rq->mq_hctx;
+
+		list_del_init(&rq->queuelist);
+		prefetch(next);
+
+		if (blk_update_request(rq, BLK_STS_OK, blk_rq_bytes(rq)))
+			BUG();
+
+		if (rq->rq_flags & RQF_STATS) {
+			blk_mq_poll_stats_start(rq->q);
+			blk_stat_add(rq, now);
+		}
+
+		blk_account_io_done(rq, now);
+
+		if (!blk_mq_release_request(rq))
+			continue;
+
+		if (blk_mq_tag_is_reserved(hctx->tags, rq->tag)) {
+			__blk_mq_free_request(rq);
+			continue;
+		}
+
+		blk_pm_mark_last_busy(rq);
+		rq->mq_hctx = NULL;
+		if (nr_tags == BLK_MQ_TAG_COMP_BATCH || cur_hctx != hctx) {
+			if (cur_hctx)
+				blk_mq_flush_tag_batch(cur_hctx, tags, nr_tags);
+			nr_tags = 0;
+			cur_hctx = hctx;
+		}
+		tags[nr_tags++] = rq->tag;
+	}
+
+	if (nr_tags)
+		blk_mq_flush_tag_batch(cur_hctx, tags, nr_tags);
+	batch->need_ts = false;
+}
+EXPORT_SYMBOL_GPL(blk_mq_end_request_batch);
+
 static void __blk_mq_complete_request_remote(void *data)
 {
 	struct request *rq = data;
@@ -1990,6 +2110,22 @@ static void blk_add_rq_to_plug(struct blk_plug *plug, struct request *rq)
 	}
 }
 
+static void bio_set_ioprio(struct bio *bio)
+{
+	/*
+	 * Let I/O schedulers that look at priorities see the class set with
+	 * ioprio_set() even if the submitter didn't tag the bio itself.
+	 *
+	 * This is the class of the task submitting the bio, so buffered
+	 * writes written back by the flusher are best-effort whatever the
+	 * class of the task that dirtied the pages: ionice -c3 only lowers
+	 * direct and synchronous writes and reads.  The page cache does not
+	 * remember who dirtied a page, so the owner's class is not known here.
+	 */
+	if (IOPRIO_PRIO_CLASS(bio_prio(bio)) == IOPRIO_CLASS_NONE)
+		bio_set_prio(bio, get_current_ioprio());
+}
+
 static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 {
 	const int is_sync = op_is_sync(bio->bi_opf);
@@ -2007,6 +2143,8 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	if (!bio_integrity_prep(bio))
 		return BLK_QC_T_NONE;
 
+	bio_set_ioprio(bio);
+
 	if (!is_flush_fua && !blk_queue_nomerges(q) &&
 	    blk_attempt_plug_merge(q, bio, nr_segs, &same_queue_rq))
 		return BLK_QC_T_NONE;
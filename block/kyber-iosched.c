@@ -8,6 +8,7 @@
 
 #include <linux/kernel.h>
 #include <linux/blkdev.h>
+#include <linux/blk-cgroup.h>
 #include <linux/blk-mq.h>
 #include <linux/elevator.h>
 #include <linux/module.h>
@@ -177,6 +178,43 @@ struct kyber_queue_data {
 	u64 latency_targets[KYBER_OTHER];
 };
 
+#ifdef CONFIG_BLK_CGROUP
+enum {
+	/*
+	 * A cgroup is considered to be missing its latency target once more
+	 * than this percentage of its requests in a timer window missed it.
+	 */
+	KYBER_GRP_MISS_PCT = 1,
+	/* Don't judge a cgroup until it completed this many requests. */
+	KYBER_GRP_MIN_SAMPLES = 16,
+};
+
+/*
+ * Per-cgroup state. Cgroups can be given latency targets tighter (or looser)
+ * than the queue-wide ones through io.kyber.latency. Requests are sampled
+ * against their cgroup's target, and while a cgroup misses its target, the
+ * cgroups with looser targets in the same domain are limited to a dispatch
+ * depth which is scaled down from kyber_depth.
+ */
+struct kyber_grp {
+	struct blkg_policy_data pd;
+
+	/* Target latencies in nanoseconds, 0 to use the queue's. */
+	u64 latency_targets[KYBER_OTHER];
+
+	unsigned int depth[KYBER_OTHER];
+	atomic_t inflight[KYBER_OTHER];
+
+	/* Target hits and misses since the last evaluation. */
+	atomic_t hits[KYBER_OTHER];
+	atomic_t misses[KYBER_OTHER];
+
+	/* Totals, protected by the queue_lock. */
+	u64 nr_hits[KYBER_OTHER];
+	u64 nr_misses[KYBER_OTHER];
+};
+#endif
+
 struct kyber_hctx_data {
 	spinlock_t lock;
 	struct list_head rqs[KYBER_NUM_DOMAINS];
@@ -206,6 +244,365 @@ static unsigned int kyber_sched_domain(unsigned int op)
 	}
 }
 
+#ifdef CONFIG_BLK_CGROUP
+static struct blkcg_policy blkcg_policy_kyber;
+
+static struct kyber_grp *pd_to_kg(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct kyber_grp, pd) : NULL;
+}
+
+static struct kyber_grp *blkg_to_kg(struct blkcg_gq *blkg)
+{
+	return pd_to_kg(blkg_to_pd(blkg, &blkcg_policy_kyber));
+}
+
+static struct kyber_grp *rq_to_kg(struct request *rq)
+{
+	struct blkcg_gq *blkg;
+
+	/*
+	 * Flushes never went through ->prepare_request(), priv[1] is left
+	 * over from an earlier user of the tag.
+	 */
+	if (!(rq->rq_flags & RQF_ELVPRIV))
+		return NULL;
+	blkg = rq->elv.priv[1];
+	return blkg ? blkg_to_kg(blkg) : NULL;
+}
+
+static u64 kyber_grp_latency_target(struct kyber_queue_data *kqd,
+				    struct kyber_grp *kg,
+				    unsigned int sched_domain)
+{
+	if (kg && kg->latency_targets[sched_domain])
+		return kg->latency_targets[sched_domain];
+	return kqd->latency_targets[sched_domain];
+}
+
+static void kyber_grp_prepare_request(struct request *rq, struct bio *bio)
+{
+	struct blkcg_gq *blkg = bio ? bio->bi_blkg : NULL;
+
+	if (blkg)
+		blkg_get(blkg);
+	rq->elv.priv[1] = blkg;
+}
+
+static void kyber_grp_finish_request(struct request *rq)
+{
+	struct blkcg_gq *blkg = rq->elv.priv[1];
+
+	if (blkg)
+		blkg_put(blkg);
+}
+
+static bool kyber_grp_may_dispatch(struct request *rq,
+				   unsigned int sched_domain)
+{
+	struct kyber_grp *kg;
+
+	if (sched_domain == KYBER_OTHER)
+		return true;
+
+	kg = rq_to_kg(rq);
+	return !kg || atomic_read(&kg->inflight[sched_domain]) <
+		READ_ONCE(kg->depth[sched_domain]);
+}
+
+static void kyber_grp_dispatched(struct request *rq, unsigned int sched_domain)
+{
+	struct kyber_grp *kg = rq_to_kg(rq);
+
+	if (kg && sched_domain != KYBER_OTHER)
+		atomic_inc(&kg->inflight[sched_domain]);
+}
+
+static void kyber_grp_released(struct request *rq, unsigned int sched_domain)
+{
+	struct kyber_grp *kg = rq_to_kg(rq);
+
+	if (!kg || sched_domain == KYBER_OTHER)
+		return;
+
+	/*
+	 * If the cgroup was at its depth, its requests may be held back on
+	 * any of the hardware queues, so kick them all.
+	 */
+	if (atomic_dec_return(&kg->inflight[sched_domain]) + 1 >=
+	    READ_ONCE(kg->depth[sched_domain]))
+		blk_mq_run_hw_queues(rq->q, true);
+}
+
+static void kyber_grp_completed(struct request *rq, unsigned int sched_domain,
+				bool hit)
+{
+	struct kyber_grp *kg = rq_to_kg(rq);
+
+	if (!kg)
+		return;
+
+	if (hit)
+		atomic_inc(&kg->hits[sched_domain]);
+	else
+		atomic_inc(&kg->misses[sched_domain]);
+}
+
+/*
+ * Called from the timer. Find the tightest target which some cgroup missed
+ * in each domain and halve the depth of the cgroups with looser targets.
+ * Everyone else gets a quarter of their depth back.
+ */
+static void kyber_grp_timer_fn(struct kyber_queue_data *kqd)
+{
+	struct request_queue *q = kqd->q;
+	u64 missed_target[KYBER_OTHER];
+	struct blkcg_gq *blkg;
+	unsigned int sched_domain;
+	bool grown = false;
+
+	for (sched_domain = 0; sched_domain < KYBER_OTHER; sched_domain++)
+		missed_target[sched_domain] = U64_MAX;
+
+	spin_lock_irq(&q->queue_lock);
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct kyber_grp *kg = blkg_to_kg(blkg);
+
+		if (!kg)
+			continue;
+
+		for (sched_domain = 0; sched_domain < KYBER_OTHER; sched_domain++) {
+			unsigned int hits, misses;
+
+			hits = atomic_read(&kg->hits[sched_domain]);
+			misses = atomic_read(&kg->misses[sched_domain]);
+			if (hits + misses < KYBER_GRP_MIN_SAMPLES)
+				continue;
+
+			atomic_sub(hits, &kg->hits[sched_domain]);
+			atomic_sub(misses, &kg->misses[sched_domain]);
+			kg->nr_hits[sched_domain] += hits;
+			kg->nr_misses[sched_domain] += misses;
+
+			if (misses * 100 > (hits + misses) * KYBER_GRP_MISS_PCT)
+				missed_target[sched_domain] =
+					min(missed_target[sched_domain],
+					    kyber_grp_latency_target(kqd, kg,
+								     sched_domain));
+		}
+	}
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct kyber_grp *kg = blkg_to_kg(blkg);
+
+		if (!kg)
+			continue;
+
+		for (sched_domain = 0; sched_domain < KYBER_OTHER; sched_domain++) {
+			unsigned int orig_depth, depth;
+
+			orig_depth = kg->depth[sched_domain];
+			if (kyber_grp_latency_target(kqd, kg, sched_domain) >
+			    missed_target[sched_domain])
+				depth = max(orig_depth / 2, 1U);
+			else
+				depth = min(orig_depth + max(orig_depth / 4, 1U),
+					    kyber_depth[sched_domain]);
+			if (depth == orig_depth)
+				continue;
+
+			WRITE_ONCE(kg->depth[sched_domain], depth);
+			if (depth > orig_depth)
+				grown = true;
+		}
+	}
+	spin_unlock_irq(&q->queue_lock);
+
+	if (grown)
+		blk_mq_run_hw_queues(q, true);
+}
+
+static struct blkg_policy_data *kyber_pd_alloc(gfp_t gfp,
+					       struct request_queue *q,
+					       struct blkcg *blkcg)
+{
+	struct kyber_grp *kg;
+
+	kg = kzalloc_node(sizeof(*kg), gfp, q->node);
+	if (!kg)
+		return NULL;
+
+	return &kg->pd;
+}
+
+static void kyber_pd_init(struct blkg_policy_data *pd)
+{
+	struct kyber_grp *kg = pd_to_kg(pd);
+	unsigned int i;
+
+	for (i = 0; i < KYBER_OTHER; i++)
+		kg->depth[i] = kyber_depth[i];
+}
+
+static void kyber_pd_free(struct blkg_policy_data *pd)
+{
+	kfree(pd_to_kg(pd));
+}
+
+static u64 kyber_latency_prfill(struct seq_file *sf,
+				struct blkg_policy_data *pd, int off)
+{
+	const char *dname = blkg_dev_name(pd->blkg);
+	struct kyber_grp *kg = pd_to_kg(pd);
+
+	if (!dname || (!kg->latency_targets[KYBER_READ] &&
+		       !kg->latency_targets[KYBER_WRITE]))
+		return 0;
+
+	seq_printf(sf, "%s read=%llu write=%llu\n", dname,
+		   kg->latency_targets[KYBER_READ],
+		   kg->latency_targets[KYBER_WRITE]);
+	return 0;
+}
+
+static int kyber_latency_show(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), kyber_latency_prfill,
+			  &blkcg_policy_kyber, seq_cft(sf)->private, false);
+	return 0;
+}
+
+/*
+ * "MAJ:MIN read=NSEC write=NSEC", where 0 or "default" makes the cgroup use
+ * the queue's target for the domain again.
+ */
+static ssize_t kyber_latency_write(struct kernfs_open_file *of, char *buf,
+				   size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct kyber_grp *kg;
+	u64 targets[KYBER_OTHER];
+	unsigned int i;
+	char *p, *tok;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_kyber, buf, &ctx);
+	if (ret)
+		return ret;
+
+	kg = blkg_to_kg(ctx.blkg);
+	memcpy(targets, kg->latency_targets, sizeof(targets));
+	p = ctx.body;
+
+	ret = -EINVAL;
+	while ((tok = strsep(&p, " "))) {
+		char key[16];
+		char val[21];	/* 18446744073709551616 */
+		u64 v;
+
+		if (!*tok)
+			continue;
+		if (sscanf(tok, "%15[^=]=%20s", key, val) != 2)
+			goto out;
+
+		if (!strcmp(val, "default"))
+			v = 0;
+		else if (kstrtou64(val, 10, &v))
+			goto out;
+
+		if (!strcmp(key, "read"))
+			targets[KYBER_READ] = v;
+		else if (!strcmp(key, "write"))
+			targets[KYBER_WRITE] = v;
+		else
+			goto out;
+	}
+
+	/* start over with the full depth, the old scaling no longer applies */
+	for (i = 0; i < KYBER_OTHER; i++) {
+		if (targets[i] != kg->latency_targets[i]) {
+			kg->latency_targets[i] = targets[i];
+			WRITE_ONCE(kg->depth[i], kyber_depth[i]);
+		}
+	}
+	ret = 0;
+out:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static struct cftype kyber_blkcg_files[] = {
+	{
+		.name = "kyber.latency",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = kyber_latency_show,
+		.write = kyber_latency_write,
+	},
+	{} /* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_kyber = {
+	.dfl_cftypes		= kyber_blkcg_files,
+	.pd_alloc_fn		= kyber_pd_alloc,
+	.pd_init_fn		= kyber_pd_init,
+	.pd_free_fn		= kyber_pd_free,
+};
+
+static int kyber_grp_activate(struct request_queue *q)
+{
+	return blkcg_activate_policy(q, &blkcg_policy_kyber);
+}
+
+static void kyber_grp_deactivate(struct request_queue *q)
+{
+	blkcg_deactivate_policy(q, &blkcg_policy_kyber);
+}
+
+static int kyber_grp_register(void)
+{
+	return blkcg_policy_register(&blkcg_policy_kyber);
+}
+
+static void kyber_grp_unregister(void)
+{
+	blkcg_policy_unregister(&blkcg_policy_kyber);
+}
+#else	/* CONFIG_BLK_CGROUP */
+struct kyber_grp;
+
+static struct kyber_grp *rq_to_kg(struct request *rq)
+{
+	return NULL;
+}
+
+static u64 kyber_grp_latency_target(struct kyber_queue_data *kqd,
+				    struct kyber_grp *kg,
+				    unsigned int sched_domain)
+{
+	return kqd->latency_targets[sched_domain];
+}
+
+static void kyber_grp_prepare_request(struct request *rq, struct bio *bio) {}
+static void kyber_grp_finish_request(struct request *rq) {}
+static bool kyber_grp_may_dispatch(struct request *rq,
+				   unsigned int sched_domain)
+{
+	return true;
+}
+static void kyber_grp_dispatched(struct request *rq,
+				 unsigned int sched_domain) {}
+static void kyber_grp_released(struct request *rq,
+			       unsigned int sched_domain) {}
+static void kyber_grp_completed(struct request *rq, unsigned int sched_domain,
+				bool hit) {}
+static void kyber_grp_timer_fn(struct kyber_queue_data *kqd) {}
+static int kyber_grp_activate(struct request_queue *q) { return 0; }
+static void kyber_grp_deactivate(struct request_queue *q) {}
+static int kyber_grp_register(void) { return 0; }
+static void kyber_grp_unregister(void) {}
+#endif	/* CONFIG_BLK_CGROUP */
+
 static void flush_latency_buckets(struct kyber_queue_data *kqd,
 				  struct kyber_cpu_latency *cpu_latency,
 				  unsigned int sched_domain, unsigned int type)
@@ -351,6 +748,8 @@ static void kyber_timer_fn(struct timer_list *t)
 			kyber_resize_domain(kqd, sched_domain, depth);
 		}
 	}
+
+	kyber_grp_timer_fn(kqd);
 }
 
 static unsigned int kyber_sched_tags_shift(struct request_queue *q)
@@ -417,13 +816,21 @@ static int kyber_init_sched(struct request_queue *q, struct elevator_type *e)
 {
 	struct kyber_queue_data *kqd;
 	struct elevator_queue *eq;
+	int ret;
 
 	eq = elevator_alloc(q, e);
 	if (!eq)
 		return -ENOMEM;
 
+	ret = kyber_grp_activate(q);
+	if (ret) {
+		kobject_put(&eq->kobj);
+		return ret;
+	}
+
 	kqd = kyber_queue_data_alloc(q);
 	if (IS_ERR(kqd)) {
+		kyber_grp_deactivate(q);
 		kobject_put(&eq->kobj);
 		return PTR_ERR(kqd);
 	}
@@ -442,6 +849,7 @@ static void kyber_exit_sched(struct elevator_queue *e)
 	int i;
 
 	del_timer_sync(&kqd->timer);
+	kyber_grp_deactivate(kqd->q);
 
 	for (i = 0; i < KYBER_NUM_DOMAINS; i++)
 		sbitmap_queue_free(&kqd->domain_tokens[i]);
@@ -546,6 +954,7 @@ static void rq_clear_domain_token(struct kyber_queue_data *kqd,
 		sched_domain = kyber_sched_domain(rq->cmd_flags);
 		sbitmap_queue_clear(&kqd->domain_tokens[sched_domain], nr,
 				    rq->mq_ctx->cpu);
+		kyber_grp_released(rq, sched_domain);
 	}
 }
 
@@ -583,6 +992,7 @@ static bool kyber_bio_merge(struct request_queue *q, struct bio *bio,
 static void kyber_prepare_request(struct request *rq, struct bio *bio)
 {
 	rq_set_domain_token(rq, -1);
+	kyber_grp_prepare_request(rq, bio);
 }
 
 static void kyber_insert_requests(struct blk_mq_hw_ctx *hctx,
@@ -608,16 +1018,23 @@ static void kyber_insert_requests(struct blk_mq_hw_ctx *hctx,
 	}
 }
 
-static void kyber_finish_request(struct request *rq)
+static void kyber_requeue_request(struct request *rq)
 {
 	struct kyber_queue_data *kqd = rq->q->elevator->elevator_data;
 
 	rq_clear_domain_token(kqd, rq);
 }
 
-static void add_latency_sample(struct kyber_cpu_latency *cpu_latency,
-			       unsigned int sched_domain, unsigned int type,
-			       u64 target, u64 latency)
+static void kyber_finish_request(struct request *rq)
+{
+	kyber_requeue_request(rq);
+	kyber_grp_finish_request(rq);
+}
+
+static unsigned int add_latency_sample(struct kyber_cpu_latency *cpu_latency,
+				       unsigned int sched_domain,
+				       unsigned int type, u64 target,
+				       u64 latency)
 {
 	unsigned int bucket;
 	u64 divisor;
@@ -631,27 +1048,35 @@ static void add_latency_sample(struct kyber_cpu_latency *cpu_latency,
 	}
 
 	atomic_inc(&cpu_latency->buckets[sched_domain][type][bucket]);
+	return bucket;
 }
 
 static void kyber_completed_request(struct request *rq, u64 now)
 {
 	struct kyber_queue_data *kqd = rq->q->elevator->elevator_data;
 	struct kyber_cpu_latency *cpu_latency;
-	unsigned int sched_domain;
+	unsigned int sched_domain, bucket;
 	u64 target;
 
 	sched_domain = kyber_sched_domain(rq->cmd_flags);
 	if (sched_domain == KYBER_OTHER)
 		return;
 
+	/*
+	 * Requests are sampled against their cgroup's target, so the domain
+	 * depths also react to the tightest targets being missed.
+	 */
 	cpu_latency = get_cpu_ptr(kqd->cpu_latency);
-	target = kqd->latency_targets[sched_domain];
-	add_latency_sample(cpu_latency, sched_domain, KYBER_TOTAL_LATENCY,
-			   target, now - rq->start_time_ns);
+	target = kyber_grp_latency_target(kqd, rq_to_kg(rq), sched_domain);
+	bucket = add_latency_sample(cpu_latency, sched_domain,
+				    KYBER_TOTAL_LATENCY, target,
+				    now - rq->start_time_ns);
 	add_latency_sample(cpu_latency, sched_domain, KYBER_IO_LATENCY, target,
 			   now - rq->io_start_time_ns);
 	put_cpu_ptr(kqd->cpu_latency);
 
+	kyber_grp_completed(rq, sched_domain, bucket < KYBER_GOOD_BUCKETS);
+
 	timer_reduce(&kqd->timer, jiffies + HZ / 10);
 }
 
@@ -747,6 +1172,23 @@ static int kyber_get_domain_token(struct kyber_queue_data *kqd,
 	return nr;
 }
 
+/*
+ * Find the first request on @rqs whose cgroup hasn't used up its dispatch
+ * depth for @sched_domain.
+ */
+static struct request *kyber_first_dispatchable(struct list_head *rqs,
+						unsigned int sched_domain)
+{
+	struct request *rq;
+
+	list_for_each_entry(rq, rqs, queuelist) {
+		if (kyber_grp_may_dispatch(rq, sched_domain))
+			return rq;
+	}
+
+	return NULL;
+}
+
 static struct request *
 kyber_dispatch_cur_domain(struct kyber_queue_data *kqd,
 			  struct kyber_hctx_data *khd,
@@ -765,13 +1207,17 @@ kyber_dispatch_cur_domain(struct kyber_queue_data *kqd,
 	 * leave the requests in the kcqs so that they can be merged. Note that
 	 * khd->lock serializes the flushes, so if we observed any bit set in
 	 * the kcq_map, we will always get a request.
+	 *
+	 * Requests of cgroups which are at their dispatch depth are passed
+	 * over. If that leaves nothing after a flush, the token is returned.
 	 */
-	rq = list_first_entry_or_null(rqs, struct request, queuelist);
+	rq = kyber_first_dispatchable(rqs, khd->cur_domain);
 	if (rq) {
 		nr = kyber_get_domain_token(kqd, khd, hctx);
 		if (nr >= 0) {
 			khd->batching++;
 			rq_set_domain_token(rq, nr);
+			kyber_grp_dispatched(rq, khd->cur_domain);
 			list_del_init(&rq->queuelist);
 			return rq;
 		} else {
@@ -782,9 +1228,15 @@ kyber_dispatch_cur_domain(struct kyber_queue_data *kqd,
 		nr = kyber_get_domain_token(kqd, khd, hctx);
 		if (nr >= 0) {
 			kyber_flush_busy_kcqs(khd, khd->cur_domain, rqs);
-			rq = list_first_entry(rqs, struct request, queuelist);
+			rq = kyber_first_dispatchable(rqs, khd->cur_domain);
+			if (!rq) {
+				sbitmap_queue_clear(&kqd->domain_tokens[khd->cur_domain],
+						    nr, raw_smp_processor_id());
+				return NULL;
+			}
 			khd->batching++;
 			rq_set_domain_token(rq, nr);
+			kyber_grp_dispatched(rq, khd->cur_domain);
 			list_del_init(&rq->queuelist);
 			return rq;
 		} else {
@@ -963,6 +1415,44 @@ static int kyber_async_depth_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+#ifdef CONFIG_BLK_CGROUP
+static int kyber_cgroup_stats_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct blkcg_gq *blkg;
+	char *path;
+
+	path = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+
+	spin_lock_irq(&q->queue_lock);
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct kyber_grp *kg = blkg_to_kg(blkg);
+		unsigned int sched_domain;
+
+		if (!kg || blkg_path(blkg, path, PATH_MAX) < 0)
+			continue;
+
+		seq_printf(m, "%s", path);
+		for (sched_domain = 0; sched_domain < KYBER_OTHER; sched_domain++) {
+			seq_printf(m, " %s=%llu/%llu:%u",
+				   kyber_domain_names[sched_domain],
+				   kg->nr_hits[sched_domain] +
+				   atomic_read(&kg->hits[sched_domain]),
+				   kg->nr_misses[sched_domain] +
+				   atomic_read(&kg->misses[sched_domain]),
+				   READ_ONCE(kg->depth[sched_domain]));
+		}
+		seq_putc(m, '\n');
+	}
+	spin_unlock_irq(&q->queue_lock);
+
+	kfree(path);
+	return 0;
+}
+#endif
+
 static int kyber_cur_domain_show(void *data, struct seq_file *m)
 {
 	struct blk_mq_hw_ctx *hctx = data;
@@ -989,6 +1479,9 @@ static const struct blk_mq_debugfs_attr kyber_queue_debugfs_attrs[] = {
 	KYBER_QUEUE_DOMAIN_ATTRS(discard),
 	KYBER_QUEUE_DOMAIN_ATTRS(other),
 	{"async_depth", 0400, kyber_async_depth_show},
+#ifdef CONFIG_BLK_CGROUP
+	{"cgroup_stats", 0400, kyber_cgroup_stats_show},
+#endif
 	{},
 };
 #undef KYBER_QUEUE_DOMAIN_ATTRS
@@ -1019,7 +1512,7 @@ static struct elevator_type kyber_sched = {
 		.prepare_request = kyber_prepare_request,
 		.insert_requests = kyber_insert_requests,
 		.finish_request = kyber_finish_request,
-		.requeue_request = kyber_finish_request,
+		.requeue_request = kyber_requeue_request,
 		.completed_request = kyber_completed_request,
 		.dispatch_request = kyber_dispatch_request,
 		.has_work = kyber_has_work,
@@ -1035,12 +1528,22 @@ static struct elevator_type kyber_sched = {
 
 static int __init kyber_init(void)
 {
-	return elv_register(&kyber_sched);
+	int ret;
+
+	ret = kyber_grp_register();
+	if (ret)
+		return ret;
+
+	ret = elv_register(&kyber_sched);
+	if (ret)
+		kyber_grp_unregister();
+	return ret;
 }
 
 static void __exit kyber_exit(void)
 {
 	elv_unregister(&kyber_sched);
+	kyber_grp_unregister();
 }
 
 module_init(kyber_init);
@@ -91,6 +91,10 @@ static int g_submit_queues = 1;
 module_param_named(submit_queues, g_submit_queues, int, 0444);
 MODULE_PARM_DESC(submit_queues, "Number of submission queues");
 
+static int g_poll_queues;
+module_param_named(poll_queues, g_poll_queues, int, 0444);
+MODULE_PARM_DESC(poll_queues, "Number of IOPOLL submission queues");
+
 static int g_home_node = NUMA_NO_NODE;
 module_param_named(home_node, g_home_node, int, 0444);
 MODULE_PARM_DESC(home_node, "Home node for the device");
@@ -284,6 +288,7 @@ CONFIGFS_ATTR(nullb_device_, NAME);
 NULLB_DEVICE_ATTR(size, ulong);
 NULLB_DEVICE_ATTR(completion_nsec, ulong);
 NULLB_DEVICE_ATTR(submit_queues, uint);
+NULLB_DEVICE_ATTR(poll_queues, uint);
 NULLB_DEVICE_ATTR(home_node, uint);
 NULLB_DEVICE_ATTR(queue_mode, uint);
 NULLB_DEVICE_ATTR(blocksize, uint);
@@ -398,6 +403,7 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_size,
 	&nullb_device_attr_completion_nsec,
 	&nullb_device_attr_submit_queues,
+	&nullb_device_attr_poll_queues,
 	&nullb_device_attr_home_node,
 	&nullb_device_attr_queue_mode,
 	&nullb_device_attr_blocksize,
@@ -519,6 +525,7 @@ static struct nullb_device *null_alloc_dev(void)
 	dev->size = g_gb * 1024;
 	dev->completion_nsec = g_completion_nsec;
 	dev->submit_queues = g_submit_queues;
+	dev->poll_queues = g_poll_queues;
 	dev->home_node = g_home_node;
 	dev->queue_mode = g_queue_mode;
 	dev->blocksize = g_bs;
@@ -1233,37 +1240,47 @@ static inline void nullb_complete_cmd(struct nullb_cmd *cmd)
 	}
 }
 
-static blk_status_t null_handle_cmd(struct nullb_cmd *cmd, sector_t sector,
-				    sector_t nr_sectors, enum req_opf op)
+static blk_status_t null_process_cmd(struct nullb_cmd *cmd, sector_t sector,
+				     sector_t nr_sectors, enum req_opf op)
 {
 	struct nullb_device *dev = cmd->nq->dev;
 	struct nullb *nullb = dev->nullb;
 	blk_status_t sts;
 
-	if (test_bit(NULLB_DEV_FL_THROTTLED, &dev->flags)) {
-		sts = null_handle_throttled(cmd);
+	if (op == REQ_OP_FLUSH)
+		return errno_to_blk_status(null_handle_flush(nullb));
+
+	if (nullb->dev->badblocks.shift != -1) {
+		sts = null_handle_badblocks(cmd, sector, nr_sectors);
 		if (sts != BLK_STS_OK)
 			return sts;
 	}
 
-	if (op == REQ_OP_FLUSH) {
-		cmd->error = errno_to_blk_status(null_handle_flush(nullb));
-		goto out;
+	if (dev->memory_backed) {
+		sts = null_handle_memory_backed(cmd, op);
+		if (sts != BLK_STS_OK)
+			return sts;
 	}
 
-	if (nullb->dev->badblocks.shift != -1) {
-		cmd->error = null_handle_badblocks(cmd, sector, nr_sectors);
-		if (cmd->error != BLK_STS_OK)
-			goto out;
-	}
+	if (dev->zoned)
+		return null_handle_zoned(cmd, op, sector, nr_sectors);
 
-	if (dev->memory_backed)
-		cmd->error = null_handle_memory_backed(cmd, op);
+	return BLK_STS_OK;
+}
 
-	if (!cmd->error && dev->zoned)
-		cmd->error = null_handle_zoned(cmd, op, sector, nr_sectors);
+static blk_status_t null_handle_cmd(struct nullb_cmd *cmd, sector_t sector,
+				    sector_t nr_sectors, enum req_opf op)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	blk_status_t sts;
 
-out:
+	if (test_bit(NULLB_DEV_FL_THROTTLED, &dev->flags)) {
+		sts = null_handle_throttled(cmd);
+		if (sts != BLK_STS_OK)
+			return sts;
+	}
+
+	cmd->error = null_process_cmd(cmd, sector, nr_sectors, op);
 	nullb_complete_cmd(cmd);
 	return BLK_STS_OK;
 }
@@ -1338,9 +1355,94 @@ static bool should_requeue_request(struct request *rq)
 	return false;
 }
 
+static int null_map_queues(struct blk_mq_tag_set *set)
+{
+	struct nullb *nullb = set->driver_data;
+	unsigned int submit_queues = g_submit_queues;
+	unsigned int poll_queues = g_poll_queues;
+	int i, qoff;
+
+	if (nullb) {
+		submit_queues = nullb->dev->submit_queues;
+		poll_queues = nullb->dev->poll_queues;
+	}
+
+	for (i = 0, qoff = 0; i < set->nr_maps; i++) {
+		struct blk_mq_queue_map *map = &set->map[i];
+
+		switch (i) {
+		case HCTX_TYPE_DEFAULT:
+			map->nr_queues = submit_queues;
+			break;
+		case HCTX_TYPE_READ:
+			map->nr_queues = 0;
+			continue;
+		case HCTX_TYPE_POLL:
+			map->nr_queues = poll_queues;
+			break;
+		}
+		map->queue_offset = qoff;
+		qoff += map->nr_queues;
+		blk_mq_map_queues(map);
+	}
+
+	return 0;
+}
+
+/*
+ * Requests on poll queues are only processed here, and successful ones are
+ * ended as one batch per call.
+ */
+static int null_poll(struct blk_mq_hw_ctx *hctx)
+{
+	struct nullb_queue *nq = hctx->driver_data;
+	DEFINE_BLK_MQ_COMP_BATCH(batch);
+	struct request *rq;
+	LIST_HEAD(list);
+	int nr = 0;
+
+	spin_lock(&nq->poll_lock);
+	list_splice_init(&nq->poll_list, &list);
+	list_for_each_entry(rq, &list, queuelist)
+		blk_mq_set_request_complete(rq);
+	spin_unlock(&nq->poll_lock);
+
+	while (!list_empty(&list)) {
+		struct nullb_cmd *cmd;
+
+		rq = list_first_entry(&list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		cmd = blk_mq_rq_to_pdu(rq);
+		cmd->error = null_process_cmd(cmd, blk_rq_pos(rq),
+					      blk_rq_sectors(rq), req_op(rq));
+		if (!blk_mq_add_to_batch(rq, &batch, cmd->error))
+			end_cmd(cmd);
+		nr++;
+	}
+
+	blk_mq_end_request_batch(&batch);
+	return nr;
+}
+
 static enum blk_eh_timer_return null_timeout_rq(struct request *rq, bool res)
 {
+	struct blk_mq_hw_ctx *hctx = rq->mq_hctx;
+
 	pr_info("rq %p timed out\n", rq);
+
+	if (hctx->type == HCTX_TYPE_POLL) {
+		struct nullb_queue *nq = hctx->driver_data;
+
+		spin_lock(&nq->poll_lock);
+		/* null_poll() may have picked the request up meanwhile */
+		if (blk_mq_request_completed(rq)) {
+			spin_unlock(&nq->poll_lock);
+			return BLK_EH_DONE;
+		}
+		list_del_init(&rq->queuelist);
+		spin_unlock(&nq->poll_lock);
+	}
+
 	blk_mq_complete_request(rq);
 	return BLK_EH_DONE;
 }
@@ -1381,6 +1483,13 @@ static blk_status_t null_queue_rq(struct blk_mq_hw_ctx *hctx,
 	if (should_timeout_request(bd->rq))
 		return BLK_STS_OK;
 
+	if (hctx->type == HCTX_TYPE_POLL) {
+		spin_lock(&nq->poll_lock);
+		list_add_tail(&bd->rq->queuelist, &nq->poll_list);
+		spin_unlock(&nq->poll_lock);
+		return BLK_STS_OK;
+	}
+
 	return null_handle_cmd(cmd, sector, nr_sectors, req_op(bd->rq));
 }
 
@@ -1388,6 +1497,8 @@ static const struct blk_mq_ops null_mq_ops = {
 	.queue_rq       = null_queue_rq,
 	.complete	= null_complete_rq,
 	.timeout	= null_timeout_rq,
+	.poll		= null_poll,
+	.map_queues	= null_map_queues,
 };
 
 static void cleanup_queue(struct nullb_queue *nq)
@@ -1462,6 +1573,8 @@ static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
 	init_waitqueue_head(&nq->wait);
 	nq->queue_depth = nullb->queue_depth;
 	nq->dev = nullb->dev;
+	INIT_LIST_HEAD(&nq->poll_list);
+	spin_lock_init(&nq->poll_lock);
 }
 
 static void null_init_queues(struct nullb *nullb)
@@ -1509,7 +1622,8 @@ static int setup_commands(struct nullb_queue *nq)
 
 static int setup_queues(struct nullb *nullb)
 {
-	nullb->queues = kcalloc(nullb->dev->submit_queues,
+	nullb->queues = kcalloc(nullb->dev->submit_queues +
+				nullb->dev->poll_queues,
 				sizeof(struct nullb_queue),
 				GFP_KERNEL);
 	if (!nullb->queues)
@@ -1576,9 +1690,18 @@ static int null_gendisk_register(struct nullb *nullb)
 
 static int null_init_tag_set(struct nullb *nullb, struct blk_mq_tag_set *set)
 {
+	unsigned int poll_queues = nullb ? nullb->dev->poll_queues :
+					   g_poll_queues;
+
 	set->ops = &null_mq_ops;
 	set->nr_hw_queues = nullb ? nullb->dev->submit_queues :
 						g_submit_queues;
+	if (poll_queues) {
+		set->nr_hw_queues += poll_queues;
+		set->nr_maps = 3;
+	} else {
+		set->nr_maps = 1;
+	}
 	set->queue_depth = nullb ? nullb->dev->hw_queue_depth :
 						g_hw_queue_depth;
 	set->numa_node = nullb ? nullb->dev->home_node : g_home_node;
@@ -1586,7 +1709,7 @@ static int null_init_tag_set(struct nullb *nullb, struct blk_mq_tag_set *set)
 	set->flags = BLK_MQ_F_SHOULD_MERGE;
 	if (g_no_sched)
 		set->flags |= BLK_MQ_F_NO_SCHED;
-	set->driver_data = NULL;
+	set->driver_data = nullb;
 
 	if ((nullb && nullb->dev->blocking) || g_blocking)
 		set->flags |= BLK_MQ_F_BLOCKING;
@@ -1610,6 +1733,11 @@ static int null_validate_conf(struct nullb_device *dev)
 	dev->queue_mode = min_t(unsigned int, dev->queue_mode, NULL_Q_MQ);
 	dev->irqmode = min_t(unsigned int, dev->irqmode, NULL_IRQ_TIMER);
 
+	if (dev->queue_mode != NULL_Q_MQ || dev->use_per_node_hctx)
+		dev->poll_queues = 0;
+	else if (dev->poll_queues > nr_cpu_ids)
+		dev->poll_queues = nr_cpu_ids;
+
 	/* Do memory allocation, so set blocking */
 	if (dev->memory_backed)
 		dev->blocking = true;
@@ -1809,6 +1937,13 @@ static int __init null_init(void)
 	else if (g_submit_queues <= 0)
 		g_submit_queues = 1;
 
+	if (g_queue_mode != NULL_Q_MQ || g_use_per_node_hctx)
+		g_poll_queues = 0;
+	else if (g_poll_queues > nr_cpu_ids)
+		g_poll_queues = nr_cpu_ids;
+	else if (g_poll_queues < 0)
+		g_poll_queues = 0;
+
 	if (g_queue_mode == NULL_Q_MQ && shared_tags) {
 		ret = null_init_tag_set(NULL, &tag_set);
 		if (ret)
@@ -322,6 +322,21 @@ void nvme_complete_rq(struct request *req)
 }
 EXPORT_SYMBOL_GPL(nvme_complete_rq);
 
+/*
+ * The part of nvme_complete_rq() that still applies to a successful request
+ * that is ended through blk_mq_end_request_batch().
+ */
+void nvme_complete_batch_req(struct request *req)
+{
+	trace_nvme_complete_rq(req);
+
+	if (nvme_req(req)->ctrl->kas)
+		nvme_req(req)->ctrl->comp_seen = true;
+
+	nvme_trace_bio_complete(req, BLK_STS_OK);
+}
+EXPORT_SYMBOL_GPL(nvme_complete_batch_req);
+
 bool nvme_cancel_request(struct request *req, void *data, bool reserved)
 {
 	dev_dbg_ratelimited(((struct nvme_ctrl *) data)->device,
@@ -444,8 +444,13 @@ static inline sector_t nvme_lba_to_sect(struct nvme_ns *ns, u64 lba)
 	return lba << (ns->lba_shift - SECTOR_SHIFT);
 }
 
-static inline void nvme_end_request(struct request *req, __le16 status,
-		union nvme_result result)
+/*
+ * Like nvme_end_request(), but successful requests are queued on @batch when
+ * possible. The transport then has to finish them with
+ * nvme_complete_batch_req() and blk_mq_end_request_batch().
+ */
+static inline void nvme_end_request_batch(struct request *req, __le16 status,
+		union nvme_result result, struct blk_mq_comp_batch *batch)
 {
 	struct nvme_request *rq = nvme_req(req);
 
@@ -453,9 +458,18 @@ static inline void nvme_end_request(struct request *req, __le16 status,
 	rq->result = result;
 	/* inject error when permitted by fault injection framework */
 	nvme_should_fail(req);
+	if (blk_mq_add_to_batch(req, batch,
+				rq->status ? BLK_STS_IOERR : BLK_STS_OK))
+		return;
 	blk_mq_complete_request(req);
 }
 
+static inline void nvme_end_request(struct request *req, __le16 status,
+		union nvme_result result)
+{
+	nvme_end_request_batch(req, status, result, NULL);
+}
+
 static inline void nvme_get_ctrl(struct nvme_ctrl *ctrl)
 {
 	get_device(ctrl->device);
@@ -472,6 +486,7 @@ static inline bool nvme_is_aen_req(u16 qid, __u16 command_id)
 }
 
 void nvme_complete_rq(struct request *req);
+void nvme_complete_batch_req(struct request *req);
 bool nvme_cancel_request(struct request *req, void *data, bool reserved);
 void nvme_cancel_tagset(struct nvme_ctrl *ctrl);
 void nvme_cancel_admin_tagset(struct nvme_ctrl *ctrl);
@@ -948,7 +948,7 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return ret;
 }
 
-static void nvme_pci_complete_rq(struct request *req)
+static void nvme_pci_unmap_rq(struct request *req)
 {
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 	struct nvme_dev *dev = iod->nvmeq->dev;
@@ -959,9 +959,25 @@ static void nvme_pci_complete_rq(struct request *req)
 			       rq_integrity_vec(req)->bv_len, rq_data_dir(req));
 	if (blk_rq_nr_phys_segments(req))
 		nvme_unmap_data(dev, req);
+}
+
+static void nvme_pci_complete_rq(struct request *req)
+{
+	nvme_pci_unmap_rq(req);
 	nvme_complete_rq(req);
 }
 
+static void nvme_pci_complete_batch(struct blk_mq_comp_batch *batch)
+{
+	struct request *req;
+
+	list_for_each_entry(req, &batch->list, queuelist) {
+		nvme_pci_unmap_rq(req);
+		nvme_complete_batch_req(req);
+	}
+	blk_mq_end_request_batch(batch);
+}
+
 /* We read the CQE phase first to check if the rest of the entry is valid */
 static inline bool nvme_cqe_pending(struct nvme_queue *nvmeq)
 {
@@ -986,7 +1002,8 @@ static inline struct blk_mq_tags *nvme_queue_tagset(struct nvme_queue *nvmeq)
 	return nvmeq->dev->tagset.tags[nvmeq->qid - 1];
 }
 
-static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
+static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx,
+				   struct blk_mq_comp_batch *batch)
 {
 	struct nvme_completion *cqe = &nvmeq->cqes[idx];
 	__u16 command_id = READ_ONCE(cqe->command_id);
@@ -1013,13 +1030,14 @@ static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
 	}
 
 	trace_nvme_sq(req, cqe->sq_head, nvmeq->sq_tail);
-	nvme_end_request(req, cqe->status, cqe->result);
+	nvme_end_request_batch(req, cqe->status, cqe->result, batch);
 }
 
-static void nvme_complete_cqes(struct nvme_queue *nvmeq, u16 start, u16 end)
+static void nvme_complete_cqes(struct nvme_queue *nvmeq, u16 start, u16 end,
+			       struct blk_mq_comp_batch *batch)
 {
 	while (start != end) {
-		nvme_handle_cqe(nvmeq, start);
+		nvme_handle_cqe(nvmeq, start, batch);
 		if (++start == nvmeq->q_depth)
 			start = 0;
 	}
@@ -1071,7 +1089,7 @@ static irqreturn_t nvme_irq(int irq, void *data)
 	wmb();
 
 	if (start != end) {
-		nvme_complete_cqes(nvmeq, start, end);
+		nvme_complete_cqes(nvmeq, start, end, NULL);
 		return IRQ_HANDLED;
 	}
 
@@ -1111,13 +1129,14 @@ static int nvme_poll_irqdisable(struct nvme_queue *nvmeq, unsigned int tag)
 		enable_irq(pci_irq_vector(pdev, nvmeq->cq_vector));
 	}
 
-	nvme_complete_cqes(nvmeq, start, end);
+	nvme_complete_cqes(nvmeq, start, end, NULL);
 	return found;
 }
 
 static int nvme_poll(struct blk_mq_hw_ctx *hctx)
 {
 	struct nvme_queue *nvmeq = hctx->driver_data;
+	DEFINE_BLK_MQ_COMP_BATCH(batch);
 	u16 start, end;
 	bool found;
 
@@ -1126,9 +1145,12 @@ static int nvme_poll(struct blk_mq_hw_ctx *hctx)
 
 	spin_lock(&nvmeq->cq_poll_lock);
 	found = nvme_process_cq(nvmeq, &start, &end, -1);
-	nvme_complete_cqes(nvmeq, start, end);
+	nvme_complete_cqes(nvmeq, start, end, &batch);
 	spin_unlock(&nvmeq->cq_poll_lock);
 
+	/* Successful polled requests are ended together, outside the lock */
+	nvme_pci_complete_batch(&batch);
+
 	return found;
 }
 
@@ -1462,7 +1484,7 @@ static void nvme_reap_pending_cqes(struct nvme_dev *dev)
 
 	for (i = dev->ctrl.queue_count - 1; i > 0; i--) {
 		nvme_process_cq(&dev->queues[i], &start, &end, -1);
-		nvme_complete_cqes(&dev->queues[i], start, end);
+		nvme_complete_cqes(&dev->queues[i], start, end, NULL);
 	}
 }
 
@@ -7,7 +7,9 @@
  */
 
 #include <linux/module.h>
-#include <linux/hashtable.h>
+#include <linux/rhashtable.h>
+#include <linux/jhash.h>
+#include <linux/sizes.h>
 #include <linux/atomic.h>
 #include <linux/delay.h>
 #include <linux/slab.h>
@@ -46,6 +48,14 @@
  *     echo 1055 > /config/[config_location]/extension/audio/ext_gid
  *     mkdir /config/[config_location]/extension/audio/
  *
+ * The whole package list can also be replaced at once by writing it to load,
+ * in the format of packages_gid.list. The new list is installed when the file
+ * is closed, and lookups never see it partially applied. Package directories
+ * made before a load keep working: their writes go to the loaded list, but
+ * removing one only drops its package if it was written since the last load.
+ *
+ * ex: cat packages.list > /config/[config_location]/load
+ *
  */
 
 static char *pkglist_config_location = "sdcardfs";
@@ -54,9 +64,19 @@ MODULE_PARM_DESC(pkglist_config_location, "Location of pkglist in configfs");
 
 static struct kmem_cache *hashtable_entry_cachep;
 
-static DEFINE_HASHTABLE(package_to_appid, 8);
-static DEFINE_HASHTABLE(package_to_userid, 8);
-static DEFINE_HASHTABLE(ext_to_groupid, 8);
+/*
+ * The package tables are swapped as a whole by a bulk load, so they hang off
+ * a single RCU protected pointer.  Individual updates are made in place.
+ */
+struct pkglist_tables {
+	struct rhashtable appid;	/* package name -> appid */
+	struct rhltable userid;		/* package name -> excluded userids */
+};
+
+static struct pkglist_tables __rcu *pkglist_tables;
+/* Bumped by each bulk load; 0 marks a package directory never written */
+static unsigned int pkglist_gen = 1;
+static struct rhashtable ext_to_groupid;
 static DEFINE_MUTEX(pkg_list_lock);
 static LIST_HEAD(pkglist_listeners);
 
@@ -67,18 +87,82 @@ struct extensions_value {
 
 struct extension_details {
 	struct config_item item;
-	struct hlist_node hlist;
+	struct rhash_head node;
 	struct qstr name;
 	struct extensions_value *value;
 };
 
 struct hashtable_entry {
-	struct hlist_node hlist;
+	union {
+		struct rhash_head node;		/* in appid */
+		struct rhlist_head list;	/* in userid */
+	};
 	struct hlist_node dlist; /* for deletion cleanup */
 	struct qstr key;
 	atomic_t value;
 };
 
+/* All tables are keyed by a struct qstr, hashed and compared ignoring case */
+static u32 pkglist_key_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct qstr *key = data;
+
+	return jhash_1word(key->hash, seed);
+}
+
+static u32 pkglist_entry_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct hashtable_entry *entry = data;
+
+	return jhash_1word(entry->key.hash, seed);
+}
+
+static int pkglist_entry_cmpfn(struct rhashtable_compare_arg *arg,
+			       const void *obj)
+{
+	const struct hashtable_entry *entry = obj;
+
+	return !qstr_case_eq(arg->key, &entry->key);
+}
+
+static u32 ext_gid_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct extension_details *ed = data;
+
+	return jhash_1word(ed->name.hash, seed);
+}
+
+static int ext_gid_cmpfn(struct rhashtable_compare_arg *arg, const void *obj)
+{
+	const struct extension_details *ed = obj;
+
+	return !qstr_case_eq(arg->key, &ed->name);
+}
+
+static const struct rhashtable_params appid_params = {
+	.head_offset		= offsetof(struct hashtable_entry, node),
+	.hashfn			= pkglist_key_hashfn,
+	.obj_hashfn		= pkglist_entry_hashfn,
+	.obj_cmpfn		= pkglist_entry_cmpfn,
+	.automatic_shrinking	= true,
+};
+
+static const struct rhashtable_params userid_params = {
+	.head_offset		= offsetof(struct hashtable_entry, list),
+	.hashfn			= pkglist_key_hashfn,
+	.obj_hashfn		= pkglist_entry_hashfn,
+	.obj_cmpfn		= pkglist_entry_cmpfn,
+	.automatic_shrinking	= true,
+};
+
+static const struct rhashtable_params ext_gid_params = {
+	.head_offset		= offsetof(struct extension_details, node),
+	.hashfn			= pkglist_key_hashfn,
+	.obj_hashfn		= ext_gid_hashfn,
+	.obj_cmpfn		= ext_gid_cmpfn,
+	.automatic_shrinking	= true,
+};
+
 static unsigned int full_name_case_hash(const unsigned char *name,
 					unsigned int len)
 {
@@ -103,19 +187,24 @@ static inline int qstr_copy(const struct qstr *src, struct qstr *dest)
 	return !!dest->name;
 }
 
+static inline struct pkglist_tables *pkglist_tables_locked(void)
+{
+	return rcu_dereference_protected(pkglist_tables,
+					 lockdep_is_held(&pkg_list_lock));
+}
+
 static kuid_t __get_appid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
 	uid_t ret_id;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return make_kuid(&init_user_ns, ret_id);
-		}
+	hash_cur = rhashtable_lookup(&rcu_dereference(pkglist_tables)->appid,
+				     key, appid_params);
+	if (hash_cur) {
+		ret_id = atomic_read(&hash_cur->value);
+		rcu_read_unlock();
+		return make_kuid(&init_user_ns, ret_id);
 	}
 	rcu_read_unlock();
 	return INVALID_UID;
@@ -133,16 +222,14 @@ EXPORT_SYMBOL_GPL(pkglist_get_appid);
 static kgid_t __get_ext_gid(const struct qstr *key)
 {
 	struct extension_details *hash_cur;
-	unsigned int hash = key->hash;
 	kgid_t ret_id;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->name)) {
-			ret_id = hash_cur->value->gid;
-			rcu_read_unlock();
-			return ret_id;
-		}
+	hash_cur = rhashtable_lookup(&ext_to_groupid, key, ext_gid_params);
+	if (hash_cur) {
+		ret_id = hash_cur->value->gid;
+		rcu_read_unlock();
+		return ret_id;
 	}
 	rcu_read_unlock();
 	return INVALID_GID;
@@ -160,12 +247,13 @@ EXPORT_SYMBOL_GPL(pkglist_get_ext_gid);
 static bool __is_excluded(const struct qstr *app_name, uint32_t user)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = app_name->hash;
+	struct rhlist_head *list, *pos;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == user &&
-				qstr_case_eq(app_name, &hash_cur->key)) {
+	list = rhltable_lookup(&rcu_dereference(pkglist_tables)->userid,
+			       app_name, userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, list) {
+		if (atomic_read(&hash_cur->value) == user) {
 			rcu_read_unlock();
 			return true;
 		}
@@ -203,7 +291,6 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	if (!ret)
 		return NULL;
 	INIT_HLIST_NODE(&ret->dlist);
-	INIT_HLIST_NODE(&ret->hlist);
 
 	if (!qstr_copy(key, &ret->key)) {
 		kmem_cache_free(hashtable_entry_cachep, ret);
@@ -214,62 +301,126 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	return ret;
 }
 
-static int insert_packagelist_appid_entry_locked(const struct qstr *key,
-						kuid_t value)
+static void free_hashtable_entry(struct hashtable_entry *entry)
+{
+	kfree(entry->key.name);
+	kmem_cache_free(hashtable_entry_cachep, entry);
+}
+
+static void free_hashtable_entry_fn(void *ptr, void *arg)
+{
+	free_hashtable_entry(ptr);
+}
+
+static struct pkglist_tables *pkglist_tables_alloc(unsigned int nelem_hint)
+{
+	struct rhashtable_params params = appid_params;
+	struct pkglist_tables *tables;
+
+	tables = kzalloc(sizeof(*tables), GFP_KERNEL);
+	if (!tables)
+		return NULL;
+
+	params.nelem_hint = nelem_hint;
+	if (rhashtable_init(&tables->appid, &params))
+		goto out_free;
+	if (rhltable_init(&tables->userid, &userid_params))
+		goto out_destroy;
+	return tables;
+
+out_destroy:
+	rhashtable_destroy(&tables->appid);
+out_free:
+	kfree(tables);
+	return NULL;
+}
+
+/* The tables must no longer be visible to RCU readers */
+static void pkglist_tables_free(struct pkglist_tables *tables)
+{
+	rhashtable_free_and_destroy(&tables->appid, free_hashtable_entry_fn,
+				    NULL);
+	rhltable_free_and_destroy(&tables->userid, free_hashtable_entry_fn,
+				  NULL);
+	kfree(tables);
+}
+
+static int __insert_appid_entry(struct pkglist_tables *tables,
+				const struct qstr *key, uid_t value)
 {
 	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
+
+	hash_cur = rhashtable_lookup_fast(&tables->appid, key, appid_params);
+	if (hash_cur) {
+		atomic_set(&hash_cur->value, value);
+		return 0;
+	}
+	new_entry = alloc_hashtable_entry(key, value);
+	if (!new_entry)
+		return -ENOMEM;
+	err = rhashtable_insert_fast(&tables->appid, &new_entry->node,
+				     appid_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
+}
 
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			atomic_set(&hash_cur->value, value.val);
+static int __insert_userid_exclude_entry(struct pkglist_tables *tables,
+					 const struct qstr *key,
+					 unsigned int value)
+{
+	struct hashtable_entry *hash_cur;
+	struct hashtable_entry *new_entry;
+	struct rhlist_head *list, *pos;
+	int err;
+
+	/* Only insert if not already present */
+	rcu_read_lock();
+	list = rhltable_lookup(&tables->userid, key, userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, list) {
+		if (atomic_read(&hash_cur->value) == value) {
+			rcu_read_unlock();
 			return 0;
 		}
 	}
-	new_entry = alloc_hashtable_entry(key, value.val);
+	rcu_read_unlock();
+	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_appid, &new_entry->hlist, hash);
-	return 0;
+	err = rhltable_insert(&tables->userid, &new_entry->list,
+			      userid_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
+}
+
+static int insert_packagelist_appid_entry_locked(const struct qstr *key,
+						kuid_t value)
+{
+	return __insert_appid_entry(pkglist_tables_locked(), key, value.val);
 }
 
 static int insert_ext_gid_entry_locked(struct extension_details *ed)
 {
-	struct extension_details *hash_cur;
-	unsigned int hash = ed->name.hash;
+	int err;
 
 	/* An extension can only belong to one gid */
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(&ed->name, &hash_cur->name))
-			return -EINVAL;
-	}
-
-	hash_add_rcu(ext_to_groupid, &ed->hlist, hash);
-	return 0;
+	err = rhashtable_lookup_insert_fast(&ext_to_groupid, &ed->node,
+					    ext_gid_params);
+	return err == -EEXIST ? -EINVAL : err;
 }
 
 static int insert_userid_exclude_entry_locked(const struct qstr *key,
 						unsigned int value)
 {
-	struct hashtable_entry *hash_cur;
-	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
-
-	/* Only insert if not already present */
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == value &&
-				qstr_case_eq(key, &hash_cur->key))
-			return 0;
-	}
-	new_entry = alloc_hashtable_entry(key, value);
-	if (!new_entry)
-		return -ENOMEM;
-	hash_add_rcu(package_to_userid, &new_entry->hlist, hash);
-	return 0;
+	return __insert_userid_exclude_entry(pkglist_tables_locked(), key,
+					     value);
 }
 
-static int insert_packagelist_entry(const struct qstr *key, kuid_t value)
+static int insert_packagelist_entry(const struct qstr *key, kuid_t value,
+				    unsigned int *gen)
 {
 	struct pkg_list *pkg;
 	int err;
@@ -277,6 +428,7 @@ static int insert_packagelist_entry(const struct qstr *key, kuid_t value)
 	mutex_lock(&pkg_list_lock);
 	err = insert_packagelist_appid_entry_locked(key, value);
 	if (!err) {
+		*gen = pkglist_gen;
 		list_for_each_entry(pkg, &pkglist_listeners, list) {
 			pkg->update(BY_NAME, key, 0);
 		}
@@ -297,7 +449,8 @@ static int insert_ext_gid_entry(struct extension_details *ed)
 	return err;
 }
 
-static int insert_userid_exclude_entry(const struct qstr *key, uint32_t value)
+static int insert_userid_exclude_entry(const struct qstr *key, uint32_t value,
+				       unsigned int *gen)
 {
 	int err;
 	struct pkg_list *pkg;
@@ -305,6 +458,7 @@ static int insert_userid_exclude_entry(const struct qstr *key, uint32_t value)
 	mutex_lock(&pkg_list_lock);
 	err = insert_userid_exclude_entry_locked(key, value);
 	if (!err) {
+		*gen = pkglist_gen;
 		list_for_each_entry(pkg, &pkglist_listeners, list) {
 			pkg->update(BY_NAME|BY_USERID, key, value);
 		}
@@ -314,42 +468,43 @@ static int insert_userid_exclude_entry(const struct qstr *key, uint32_t value)
 	return err;
 }
 
-static void free_hashtable_entry(struct hashtable_entry *entry)
-{
-	kfree(entry->key.name);
-	kmem_cache_free(hashtable_entry_cachep, entry);
-}
-
 static void remove_packagelist_entry_locked(const struct qstr *key)
 {
+	struct pkglist_tables *tables = pkglist_tables_locked();
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
+	struct rhlist_head *list, *pos;
 	struct hlist_node *h_t;
 	HLIST_HEAD(free_list);
 
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-		}
+	rcu_read_lock();
+	list = rhltable_lookup(&tables->userid, key, userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, list) {
+		rhltable_remove(&tables->userid, &hash_cur->list,
+				userid_params);
+		hlist_add_head(&hash_cur->dlist, &free_list);
 	}
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-			break;
-		}
+	hash_cur = rhashtable_lookup(&tables->appid, key, appid_params);
+	if (hash_cur) {
+		rhashtable_remove_fast(&tables->appid, &hash_cur->node,
+				       appid_params);
+		hlist_add_head(&hash_cur->dlist, &free_list);
 	}
+	rcu_read_unlock();
 	synchronize_rcu();
 	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
 		free_hashtable_entry(hash_cur);
 }
 
-static void remove_packagelist_entry(const struct qstr *key)
+/* Entries written at @gen are only removed if no bulk load replaced them */
+static void remove_packagelist_entry(const struct qstr *key, unsigned int gen)
 {
 	struct pkg_list *pkg;
 
 	mutex_lock(&pkg_list_lock);
+	if (gen != pkglist_gen) {
+		mutex_unlock(&pkg_list_lock);
+		return;
+	}
 	remove_packagelist_entry_locked(key);
 	list_for_each_entry(pkg, &pkglist_listeners, list) {
 		pkg->update(BY_NAME, key, 0);
@@ -360,16 +515,13 @@ static void remove_packagelist_entry(const struct qstr *key)
 static void remove_ext_gid_entry_locked(struct extension_details *ed)
 {
 	struct extension_details *hash_cur;
-	struct qstr *key = &ed->name;
-	unsigned int hash = key->hash;
 
-	hash_for_each_possible_rcu(ext_to_groupid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->name)
-				&& hash_cur->value == ed->value) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			break;
-		}
+	hash_cur = rhashtable_lookup_fast(&ext_to_groupid, &ed->name,
+					  ext_gid_params);
+	if (hash_cur && hash_cur->value == ed->value) {
+		rhashtable_remove_fast(&ext_to_groupid, &hash_cur->node,
+				       ext_gid_params);
+		synchronize_rcu();
 	}
 }
 
@@ -382,17 +534,31 @@ static void remove_ext_gid_entry(struct extension_details *ed)
 
 static void remove_userid_all_entry_locked(uint32_t userid)
 {
+	struct pkglist_tables *tables = pkglist_tables_locked();
 	struct hashtable_entry *hash_cur;
+	struct rhashtable_iter iter;
 	struct hlist_node *h_t;
 	HLIST_HEAD(free_list);
-	int i;
 
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		if (atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
+	rhltable_walk_enter(&tables->userid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur)) {
+			if (PTR_ERR(hash_cur) == -EAGAIN)
+				continue;
+			break;
 		}
+		/* a resize may make the walk return entries twice */
+		if (atomic_read(&hash_cur->value) == userid &&
+		    hlist_unhashed(&hash_cur->dlist))
+			hlist_add_head(&hash_cur->dlist, &free_list);
 	}
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
+
+	hlist_for_each_entry(hash_cur, &free_list, dlist)
+		rhltable_remove(&tables->userid, &hash_cur->list,
+				userid_params);
 	synchronize_rcu();
 	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist) {
 		free_hashtable_entry(hash_cur);
@@ -415,18 +581,23 @@ static void remove_userid_all_entry(uint32_t userid)
 static void remove_userid_exclude_entry_locked(const struct qstr *key,
 						uint32_t userid)
 {
+	struct pkglist_tables *tables = pkglist_tables_locked();
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
+	struct rhlist_head *list, *pos;
 
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) &&
-				atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
+	rcu_read_lock();
+	list = rhltable_lookup(&tables->userid, key, userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, list) {
+		if (atomic_read(&hash_cur->value) == userid) {
+			rhltable_remove(&tables->userid, &hash_cur->list,
+					userid_params);
+			rcu_read_unlock();
 			synchronize_rcu();
 			free_hashtable_entry(hash_cur);
-			break;
+			return;
 		}
 	}
+	rcu_read_unlock();
 }
 
 static void remove_userid_exclude_entry(const struct qstr *key, uint32_t userid)
@@ -441,26 +612,92 @@ static void remove_userid_exclude_entry(const struct qstr *key, uint32_t userid)
 	mutex_unlock(&pkg_list_lock);
 }
 
-static void packagelist_destroy(void)
+/*
+ * Replace the whole package list with the one in @buf, which uses the format
+ * of packages_gid.list: one "<package> <appid> [<excluded userid>...]" line
+ * per package.  Readers see either the old or the new list, never a mix.
+ * The list is built under pkg_list_lock, so that no configfs update made
+ * meanwhile is lost with the old tables.
+ */
+static int packagelist_load(const char *buf, size_t count)
 {
-	struct hashtable_entry *hash_cur;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-	int i;
+	struct pkglist_tables *tables, *old;
+	char *data, *next, *line, *tok;
+	unsigned int nr = 0, val;
+	struct pkg_list *pkg;
+	struct qstr key;
+	int err = 0;
+
+	data = kmemdup_nul(buf, count, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+	for (next = data; (next = strchr(next, '\n')); next++)
+		nr++;
 
 	mutex_lock(&pkg_list_lock);
-	hash_for_each_rcu(package_to_appid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
+	tables = pkglist_tables_alloc(nr + 1);
+	if (!tables) {
+		mutex_unlock(&pkg_list_lock);
+		kfree(data);
+		return -ENOMEM;
 	}
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
+
+	next = data;
+	while (!err && (line = strsep(&next, "\n"))) {
+		tok = strsep(&line, " \t");
+		if (!tok || !*tok)
+			continue;
+		qstr_init(&key, tok);
+
+		tok = strsep(&line, " \t");
+		if (!tok || kstrtouint(tok, 10, &val)) {
+			err = -EINVAL;
+			break;
+		}
+		err = __insert_appid_entry(tables, &key, val);
+
+		while (!err && (tok = strsep(&line, " \t"))) {
+			if (!*tok)
+				continue;
+			if (kstrtouint(tok, 10, &val)) {
+				err = -EINVAL;
+				break;
+			}
+			err = __insert_userid_exclude_entry(tables, &key, val);
+		}
+	}
+	kfree(data);
+	if (err) {
+		mutex_unlock(&pkg_list_lock);
+		pkglist_tables_free(tables);
+		return err;
+	}
+
+	old = pkglist_tables_locked();
+	rcu_assign_pointer(pkglist_tables, tables);
+	/* package directories no longer own what they wrote */
+	if (!++pkglist_gen)
+		pkglist_gen = 1;
+	list_for_each_entry(pkg, &pkglist_listeners, list) {
+		pkg->update(BY_NAME|BY_USERID, NULL, 0);
 	}
+	mutex_unlock(&pkg_list_lock);
+
 	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
-		free_hashtable_entry(hash_cur);
+	pkglist_tables_free(old);
+	return 0;
+}
+
+static void packagelist_destroy(void)
+{
+	struct pkglist_tables *tables;
+
+	mutex_lock(&pkg_list_lock);
+	tables = pkglist_tables_locked();
+	RCU_INIT_POINTER(pkglist_tables, NULL);
 	mutex_unlock(&pkg_list_lock);
+	synchronize_rcu();
+	pkglist_tables_free(tables);
 	pr_info("pkglist: destroyed pkglist\n");
 }
 
@@ -493,6 +730,7 @@ static struct configfs_attribute _pfx##attr_##_name = {	\
 struct package_details {
 	struct config_item item;
 	struct qstr name;
+	unsigned int gen;	/* pkglist_gen of its last write, or 0 */
 };
 
 static inline struct package_details *to_package_details(
@@ -522,7 +760,8 @@ static ssize_t package_details_appid_store(struct config_item *item,
 
 	uid = make_kuid(current_user_ns(), tmp);
 
-	ret = insert_packagelist_entry(&to_package_details(item)->name, uid);
+	ret = insert_packagelist_entry(&to_package_details(item)->name, uid,
+				       &to_package_details(item)->gen);
 
 	if (ret)
 		return ret;
@@ -535,14 +774,15 @@ static ssize_t package_details_excluded_userids_show(struct config_item *item,
 {
 	struct package_details *package_details = to_package_details(item);
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = package_details->name.hash;
+	struct rhlist_head *list, *pos;
 	int count = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(&package_details->name, &hash_cur->key))
-			count += scnprintf(page + count, PAGE_SIZE - count,
-					   "%d ", atomic_read(&hash_cur->value));
+	list = rhltable_lookup(&rcu_dereference(pkglist_tables)->userid,
+			       &package_details->name, userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, list) {
+		count += scnprintf(page + count, PAGE_SIZE - count,
+				   "%d ", atomic_read(&hash_cur->value));
 	}
 	rcu_read_unlock();
 	if (count)
@@ -561,7 +801,8 @@ static ssize_t package_details_excluded_userids_store(struct config_item *item,
 	if (ret)
 		return ret;
 
-	ret = insert_userid_exclude_entry(&to_package_details(item)->name, tmp);
+	ret = insert_userid_exclude_entry(&to_package_details(item)->name, tmp,
+					  &to_package_details(item)->gen);
 
 	if (ret)
 		return ret;
@@ -587,7 +828,7 @@ static void package_details_release(struct config_item *item)
 	struct package_details *package_details = to_package_details(item);
 
 	pr_debug("pkglist: removing %s\n", package_details->name.name);
-	remove_packagelist_entry(&package_details->name);
+	remove_packagelist_entry(&package_details->name, package_details->gen);
 	kfree(package_details->name.name);
 	kfree(package_details);
 }
@@ -805,27 +1046,35 @@ static struct config_item *packages_make_item(struct config_group *group,
 
 static ssize_t packages_list_show(struct config_item *item, char *page)
 {
+	struct pkglist_tables *tables;
 	struct hashtable_entry *hash_cur_app;
 	struct hashtable_entry *hash_cur_user;
-	int i;
+	struct rhlist_head *list, *pos;
+	struct rhashtable_iter iter;
 	int count = 0, written = 0;
 	const char errormsg[] = "<truncated>\n";
-	unsigned int hash;
 
 	rcu_read_lock();
-	hash_for_each_rcu(package_to_appid, i, hash_cur_app, hlist) {
+	tables = rcu_dereference(pkglist_tables);
+	rhashtable_walk_enter(&tables->appid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur_app = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur_app)) {
+			if (PTR_ERR(hash_cur_app) == -EAGAIN)
+				continue;
+			break;
+		}
 		written = scnprintf(page + count,
 				    PAGE_SIZE - sizeof(errormsg) - count,
 				    "%s %d\n",
 				    hash_cur_app->key.name,
 				    atomic_read(&hash_cur_app->value));
-		hash = hash_cur_app->key.hash;
-		hash_for_each_possible_rcu(package_to_userid, hash_cur_user, hlist, hash) {
-			if (qstr_case_eq(&hash_cur_app->key, &hash_cur_user->key)) {
-				written += scnprintf(page + count + written - 1,
-					PAGE_SIZE - sizeof(errormsg) - count - written + 1,
-					" %d\n", atomic_read(&hash_cur_user->value)) - 1;
-			}
+		list = rhltable_lookup(&tables->userid, &hash_cur_app->key,
+				       userid_params);
+		rhl_for_each_entry_rcu(hash_cur_user, pos, list, list) {
+			written += scnprintf(page + count + written - 1,
+				PAGE_SIZE - sizeof(errormsg) - count - written + 1,
+				" %d\n", atomic_read(&hash_cur_user->value)) - 1;
 		}
 		if (count + written == PAGE_SIZE - sizeof(errormsg) - 1) {
 			count += scnprintf(page + count, PAGE_SIZE - count, errormsg);
@@ -833,6 +1082,8 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 		}
 		count += written;
 	}
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
 	rcu_read_unlock();
 
 	return count;
@@ -851,6 +1102,17 @@ static ssize_t packages_remove_userid_store(struct config_item *item,
 	return count;
 }
 
+static ssize_t packages_load_write(struct config_item *item,
+				   const void *buf, size_t count)
+{
+	int ret;
+
+	ret = packagelist_load(buf, count);
+	if (ret)
+		return ret;
+	return count;
+}
+
 static struct configfs_attribute packages_attr_packages_gid_list = {
     .ca_name	= "packages_gid.list",
     .ca_mode	= S_IRUGO,
@@ -858,6 +1120,7 @@ static struct configfs_attribute packages_attr_packages_gid_list = {
     .show	= packages_list_show,
 };
 PACKAGE_DETAILS_ATTR_WO(packages_, remove_userid);
+CONFIGFS_BIN_ATTR_WO(packages_, load, NULL, SZ_1M);
 
 static struct configfs_attribute *packages_attrs[] = {
 	&packages_attr_packages_gid_list,
@@ -865,6 +1128,11 @@ static struct configfs_attribute *packages_attrs[] = {
 	NULL,
 };
 
+static struct configfs_bin_attribute *packages_bin_attrs[] = {
+	&packages_attr_load,
+	NULL,
+};
+
 /*
  * Note that, since no extra work is required on ->drop_item(),
  * no ->drop_item() is provided.
@@ -876,6 +1144,7 @@ static struct configfs_group_operations packages_group_ops = {
 static struct config_item_type packages_type = {
 	.ct_group_ops	= &packages_group_ops,
 	.ct_attrs	= packages_attrs,
+	.ct_bin_attrs	= packages_bin_attrs,
 	.ct_owner	= THIS_MODULE,
 };
 
@@ -940,6 +1209,9 @@ EXPORT_SYMBOL_GPL(pkglist_unregister_update_listener);
 
 static int __init pkglist_init(void)
 {
+	struct pkglist_tables *tables;
+	int ret;
+
 	hashtable_entry_cachep =
 		kmem_cache_create("packagelist_hashtable_entry",
 				sizeof(struct hashtable_entry), 0, 0, NULL);
@@ -948,7 +1220,29 @@ static int __init pkglist_init(void)
 		return -ENOMEM;
 	}
 
-	return configfs_pkglist_init();
+	ret = -ENOMEM;
+	tables = pkglist_tables_alloc(0);
+	if (!tables)
+		goto out_cache;
+	RCU_INIT_POINTER(pkglist_tables, tables);
+
+	ret = rhashtable_init(&ext_to_groupid, &ext_gid_params);
+	if (ret)
+		goto out_tables;
+
+	ret = configfs_pkglist_init();
+	if (ret)
+		goto out_ext;
+	return 0;
+
+out_ext:
+	rhashtable_destroy(&ext_to_groupid);
+out_tables:
+	RCU_INIT_POINTER(pkglist_tables, NULL);
+	pkglist_tables_free(tables);
+out_cache:
+	kmem_cache_destroy(hashtable_entry_cachep);
+	return ret;
 }
 module_init(pkglist_init);
 
@@ -956,6 +1250,7 @@ static void __exit pkglist_exit(void)
 {
 	configfs_pkglist_exit();
 	packagelist_destroy();
+	rhashtable_destroy(&ext_to_groupid);
 	kmem_cache_destroy(hashtable_entry_cachep);
 }
 
@@ -26,18 +26,35 @@
 #include <linux/namei.h>
 #include "fscrypt_private.h"
 
+/*
+ * Decrypt all the pagecache blocks of a read bio.  The bio only holds pages of
+ * one file, so a single request is set up and reused for all of its blocks.
+ */
 void fscrypt_decrypt_bio(struct bio *bio)
 {
+	const struct inode *inode = bio_first_page_all(bio)->mapping->host;
+	const unsigned int blockbits = inode->i_blkbits;
+	struct fscrypt_blocks_req breq;
 	struct bio_vec *bv;
 	struct bvec_iter_all iter_all;
+	int err;
+
+	err = fscrypt_blocks_req_init(&breq, inode, GFP_NOFS);
 
 	bio_for_each_segment_all(bv, bio, iter_all) {
 		struct page *page = bv->bv_page;
-		int ret = fscrypt_decrypt_pagecache_blocks(page, bv->bv_len,
-							   bv->bv_offset);
-		if (ret)
+		u64 lblk_num = ((u64)page->index << (PAGE_SHIFT - blockbits)) +
+			       (bv->bv_offset >> blockbits);
+
+		if (err || fscrypt_crypt_blocks(&breq, FS_DECRYPT, lblk_num,
+						page, page, bv->bv_len,
+						bv->bv_offset,
+						1 << blockbits))
 			SetPageError(page);
 	}
+
+	if (!err)
+		fscrypt_blocks_req_free(&breq);
 }
 EXPORT_SYMBOL(fscrypt_decrypt_bio);
 
@@ -119,6 +136,7 @@ int fscrypt_zeroout_range(const struct inode *inode, pgoff_t lblk,
 	unsigned int nr_pages;
 	unsigned int i;
 	unsigned int offset;
+	struct fscrypt_blocks_req breq;
 	struct bio *bio;
 	int ret, err;
 
@@ -150,6 +168,10 @@ int fscrypt_zeroout_range(const struct inode *inode, pgoff_t lblk,
 	if (WARN_ON(nr_pages <= 0))
 		return -EINVAL;
 
+	err = fscrypt_blocks_req_init(&breq, inode, GFP_NOFS);
+	if (err)
+		goto out_free_pages;
+
 	/* This always succeeds since __GFP_DIRECT_RECLAIM is set. */
 	bio = bio_alloc(GFP_NOFS, nr_pages);
 
@@ -159,25 +181,24 @@ int fscrypt_zeroout_range(const struct inode *inode, pgoff_t lblk,
 		bio_set_op_attrs(bio, REQ_OP_WRITE, 0);
 
 		i = 0;
-		offset = 0;
 		do {
-			err = fscrypt_crypt_block(inode, FS_ENCRYPT, lblk,
-						  ZERO_PAGE(0), pages[i],
-						  blocksize, offset, GFP_NOFS);
+			unsigned int blocks_this_page =
+				min(len, blocks_per_page);
+
+			offset = blocks_this_page << blockbits;
+			err = fscrypt_crypt_blocks(&breq, FS_ENCRYPT, lblk,
+						   ZERO_PAGE(0), pages[i],
+						   offset, 0, blocksize);
 			if (err)
 				goto out;
-			lblk++;
-			pblk++;
-			len--;
-			offset += blocksize;
-			if (offset == PAGE_SIZE || len == 0) {
-				ret = bio_add_page(bio, pages[i++], offset, 0);
-				if (WARN_ON(ret != offset)) {
-					err = -EIO;
-					goto out;
-				}
-				offset = 0;
+			ret = bio_add_page(bio, pages[i++], offset, 0);
+			if (WARN_ON(ret != offset)) {
+				err = -EIO;
+				goto out;
 			}
+			lblk += blocks_this_page;
+			pblk += blocks_this_page;
+			len -= blocks_this_page;
 		} while (i != nr_pages && len != 0);
 
 		err = submit_bio_wait(bio);
@@ -188,6 +209,8 @@ int fscrypt_zeroout_range(const struct inode *inode, pgoff_t lblk,
 	err = 0;
 out:
 	bio_put(bio);
+	fscrypt_blocks_req_free(&breq);
+out_free_pages:
 	for (i = 0; i < nr_pages; i++)
 		fscrypt_free_bounce_page(pages[i]);
 	return err;
@@ -97,53 +97,96 @@ void fscrypt_generate_iv(union fscrypt_iv *iv, u64 lblk_num,
 	iv->lblk_num = cpu_to_le64(lblk_num);
 }
 
-/* Encrypt or decrypt a single filesystem block of file contents */
-int fscrypt_crypt_block(const struct inode *inode, fscrypt_direction_t rw,
-			u64 lblk_num, struct page *src_page,
-			struct page *dest_page, unsigned int len,
-			unsigned int offs, gfp_t gfp_flags)
+/* Allocate the request that fscrypt_crypt_blocks() will reuse */
+int fscrypt_blocks_req_init(struct fscrypt_blocks_req *breq,
+			    const struct inode *inode, gfp_t gfp_flags)
 {
+	breq->inode = inode;
+	breq->req = skcipher_request_alloc(inode->i_crypt_info->ci_key.tfm,
+					   gfp_flags);
+	if (!breq->req)
+		return -ENOMEM;
+
+	crypto_init_wait(&breq->wait);
+	skcipher_request_set_callback(
+		breq->req, CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+		crypto_req_done, &breq->wait);
+	return 0;
+}
+
+void fscrypt_blocks_req_free(struct fscrypt_blocks_req *breq)
+{
+	skcipher_request_free(breq->req);
+	breq->req = NULL;
+}
+
+/*
+ * Encrypt or decrypt the @len bytes at @offs in @src_page into @dest_page as a
+ * run of @blocksize byte blocks, starting at file block @lblk_num.  Each block
+ * has its own IV, so the request is issued once per block, but it is only set
+ * up once by fscrypt_blocks_req_init().
+ */
+int fscrypt_crypt_blocks(struct fscrypt_blocks_req *breq,
+			 fscrypt_direction_t rw, u64 lblk_num,
+			 struct page *src_page, struct page *dest_page,
+			 unsigned int len, unsigned int offs,
+			 unsigned int blocksize)
+{
+	const struct inode *inode = breq->inode;
+	struct skcipher_request *req = breq->req;
 	union fscrypt_iv iv;
-	struct skcipher_request *req = NULL;
-	DECLARE_CRYPTO_WAIT(wait);
 	struct scatterlist dst, src;
-	struct fscrypt_info *ci = inode->i_crypt_info;
-	struct crypto_skcipher *tfm = ci->ci_key.tfm;
-	int res = 0;
+	unsigned int end = offs + len;
+	int res;
 
-	if (WARN_ON_ONCE(len <= 0))
+	if (WARN_ON_ONCE(len <= 0 || blocksize <= 0))
 		return -EINVAL;
-	if (WARN_ON_ONCE(len % FS_CRYPTO_BLOCK_SIZE != 0))
+	if (WARN_ON_ONCE(blocksize % FS_CRYPTO_BLOCK_SIZE != 0 ||
+			 len % blocksize != 0))
 		return -EINVAL;
 
-	fscrypt_generate_iv(&iv, lblk_num, ci);
-
-	req = skcipher_request_alloc(tfm, gfp_flags);
-	if (!req)
-		return -ENOMEM;
-
-	skcipher_request_set_callback(
-		req, CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
-		crypto_req_done, &wait);
-
 	sg_init_table(&dst, 1);
-	sg_set_page(&dst, dest_page, len, offs);
 	sg_init_table(&src, 1);
-	sg_set_page(&src, src_page, len, offs);
-	skcipher_request_set_crypt(req, &src, &dst, len, &iv);
-	if (rw == FS_DECRYPT)
-		res = crypto_wait_req(crypto_skcipher_decrypt(req), &wait);
-	else
-		res = crypto_wait_req(crypto_skcipher_encrypt(req), &wait);
-	skcipher_request_free(req);
-	if (res) {
-		fscrypt_err(inode, "%scryption failed for block %llu: %d",
-			    (rw == FS_DECRYPT ? "De" : "En"), lblk_num, res);
-		return res;
+	for (; offs < end; offs += blocksize, lblk_num++) {
+		fscrypt_generate_iv(&iv, lblk_num, inode->i_crypt_info);
+		sg_set_page(&dst, dest_page, blocksize, offs);
+		sg_set_page(&src, src_page, blocksize, offs);
+		skcipher_request_set_crypt(req, &src, &dst, blocksize, &iv);
+		if (rw == FS_DECRYPT)
+			res = crypto_wait_req(crypto_skcipher_decrypt(req),
+					      &breq->wait);
+		else
+			res = crypto_wait_req(crypto_skcipher_encrypt(req),
+					      &breq->wait);
+		if (res) {
+			fscrypt_err(inode,
+				    "%scryption failed for block %llu: %d",
+				    (rw == FS_DECRYPT ? "De" : "En"), lblk_num,
+				    res);
+			return res;
+		}
 	}
 	return 0;
 }
 
+/* Encrypt or decrypt a single filesystem block of file contents */
+int fscrypt_crypt_block(const struct inode *inode, fscrypt_direction_t rw,
+			u64 lblk_num, struct page *src_page,
+			struct page *dest_page, unsigned int len,
+			unsigned int offs, gfp_t gfp_flags)
+{
+	struct fscrypt_blocks_req breq;
+	int res;
+
+	res = fscrypt_blocks_req_init(&breq, inode, gfp_flags);
+	if (res)
+		return res;
+	res = fscrypt_crypt_blocks(&breq, rw, lblk_num, src_page, dest_page,
+				   len, offs, len);
+	fscrypt_blocks_req_free(&breq);
+	return res;
+}
+
 /**
  * fscrypt_encrypt_pagecache_blocks() - Encrypt filesystem blocks from a
  *					pagecache page
@@ -178,10 +221,10 @@ struct page *fscrypt_encrypt_pagecache_blocks(struct page *page,
 	const struct inode *inode = page->mapping->host;
 	const unsigned int blockbits = inode->i_blkbits;
 	const unsigned int blocksize = 1 << blockbits;
+	struct fscrypt_blocks_req breq;
 	struct page *ciphertext_page;
 	u64 lblk_num = ((u64)page->index << (PAGE_SHIFT - blockbits)) +
 		       (offs >> blockbits);
-	unsigned int i;
 	int err;
 
 	if (WARN_ON_ONCE(!PageLocked(page)))
@@ -194,14 +237,16 @@ struct page *fscrypt_encrypt_pagecache_blocks(struct page *page,
 	if (!ciphertext_page)
 		return ERR_PTR(-ENOMEM);
 
-	for (i = offs; i < offs + len; i += blocksize, lblk_num++) {
-		err = fscrypt_crypt_block(inode, FS_ENCRYPT, lblk_num,
-					  page, ciphertext_page,
-					  blocksize, i, gfp_flags);
-		if (err) {
-			fscrypt_free_bounce_page(ciphertext_page);
-			return ERR_PTR(err);
-		}
+	err = fscrypt_blocks_req_init(&breq, inode, gfp_flags);
+	if (!err) {
+		err = fscrypt_crypt_blocks(&breq, FS_ENCRYPT, lblk_num, page,
+					   ciphertext_page, len, offs,
+					   blocksize);
+		fscrypt_blocks_req_free(&breq);
+	}
+	if (err) {
+		fscrypt_free_bounce_page(ciphertext_page);
+		return ERR_PTR(err);
 	}
 	SetPagePrivate(ciphertext_page);
 	set_page_private(ciphertext_page, (unsigned long)page);
@@ -260,7 +305,7 @@ int fscrypt_decrypt_pagecache_blocks(struct page *page, unsigned int len,
 	const unsigned int blocksize = 1 << blockbits;
 	u64 lblk_num = ((u64)page->index << (PAGE_SHIFT - blockbits)) +
 		       (offs >> blockbits);
-	unsigned int i;
+	struct fscrypt_blocks_req breq;
 	int err;
 
 	if (WARN_ON_ONCE(!PageLocked(page)))
@@ -269,13 +314,13 @@ int fscrypt_decrypt_pagecache_blocks(struct page *page, unsigned int len,
 	if (WARN_ON_ONCE(len <= 0 || !IS_ALIGNED(len | offs, blocksize)))
 		return -EINVAL;
 
-	for (i = offs; i < offs + len; i += blocksize, lblk_num++) {
-		err = fscrypt_crypt_block(inode, FS_DECRYPT, lblk_num, page,
-					  page, blocksize, i, GFP_NOFS);
-		if (err)
-			return err;
-	}
-	return 0;
+	err = fscrypt_blocks_req_init(&breq, inode, GFP_NOFS);
+	if (err)
+		return err;
+	err = fscrypt_crypt_blocks(&breq, FS_DECRYPT, lblk_num, page, page,
+				   len, offs, blocksize);
+	fscrypt_blocks_req_free(&breq);
+	return err;
 }
 EXPORT_SYMBOL(fscrypt_decrypt_pagecache_blocks);
 
@@ -263,6 +263,25 @@ typedef enum {
 /* crypto.c */
 extern struct kmem_cache *fscrypt_info_cachep;
 int fscrypt_initialize(unsigned int cop_flags);
+
+/*
+ * An skcipher request that is set up once and then reused for each block of
+ * a page range, a bio or a zeroout, with the IV stepped from block to block.
+ */
+struct fscrypt_blocks_req {
+	const struct inode *inode;
+	struct skcipher_request *req;
+	struct crypto_wait wait;
+};
+
+int fscrypt_blocks_req_init(struct fscrypt_blocks_req *breq,
+			    const struct inode *inode, gfp_t gfp_flags);
+void fscrypt_blocks_req_free(struct fscrypt_blocks_req *breq);
+int fscrypt_crypt_blocks(struct fscrypt_blocks_req *breq,
+			 fscrypt_direction_t rw, u64 lblk_num,
+			 struct page *src_page, struct page *dest_page,
+			 unsigned int len, unsigned int offs,
+			 unsigned int blocksize);
 int fscrypt_crypt_block(const struct inode *inode, fscrypt_direction_t rw,
 			u64 lblk_num, struct page *src_page,
 			struct page *dest_page, unsigned int len,
@@ -32,6 +32,8 @@
 #include <linux/bit_spinlock.h>
 #include <linux/rculist_bl.h>
 #include <linux/list_lru.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include "internal.h"
 #include "mount.h"
 
@@ -74,6 +76,12 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/*
+ * Unused negative dentries a superblock may keep on its LRU before the excess
+ * is trimmed in the background, 0 for no limit.  Set up in dcache_init().
+ */
+unsigned long sysctl_negative_dentry_limit __read_mostly;
+
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(rename_lock);
@@ -123,6 +131,26 @@ static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 static DEFINE_PER_CPU(long, nr_dentry_negative);
 
+static inline void d_negative_inc(struct dentry *dentry)
+{
+	this_cpu_inc(nr_dentry_negative);
+	percpu_counter_inc(&dentry->d_sb->s_nr_dentry_negative);
+}
+
+static inline void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry_negative);
+}
+
+static bool d_negative_over_limit(struct super_block *sb)
+{
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	return limit &&
+	       percpu_counter_read_positive(&sb->s_nr_dentry_negative) > limit;
+}
+
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
 /*
@@ -175,6 +203,37 @@ int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 }
 #endif
 
+#ifdef CONFIG_PROC_FS
+static void negative_dentries_show_sb(struct super_block *sb, void *arg)
+{
+	struct seq_file *m = arg;
+
+	seq_printf(m, "%u:%u %s %lld %lu\n", MAJOR(sb->s_dev), MINOR(sb->s_dev),
+		   sb->s_type->name,
+		   percpu_counter_sum_positive(&sb->s_nr_dentry_negative),
+		   list_lru_count(&sb->s_dentry_lru));
+}
+
+/*
+ * /proc/fs/negative-dentries has a line per superblock with its device, its
+ * filesystem type, and the number of unused negative and of all unused
+ * dentries it keeps.
+ */
+static int negative_dentries_proc_show(struct seq_file *m, void *v)
+{
+	iterate_supers(negative_dentries_show_sb, m);
+	return 0;
+}
+
+static int __init proc_negative_dentries_init(void)
+{
+	proc_create_single("fs/negative-dentries", 0, NULL,
+			   negative_dentries_proc_show);
+	return 0;
+}
+fs_initcall(proc_negative_dentries_init);
+#endif
+
 /*
  * Compare 2 name strings, return 0 if they match, otherwise non-zero.
  * The strings are both count bytes long, and count is non-zero.
@@ -330,7 +389,7 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -385,10 +444,11 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * The per-cpu "nr_dentry_unused" counters are updated with
  * the DCACHE_LRU_LIST bit.
  *
- * The per-cpu "nr_dentry_negative" counters are only updated
- * when deleted from or added to the per-superblock LRU list, not
- * from/to the shrink list. That is to avoid an unneeded dec/inc
- * pair when moving from LRU to shrink list in select_collect().
+ * The per-cpu "nr_dentry_negative" counters, and the per-superblock
+ * s_nr_dentry_negative ones, are only updated when deleted from or
+ * added to the per-superblock LRU list, not from/to the shrink list.
+ * That is to avoid an unneeded dec/inc pair when moving from LRU to
+ * shrink list in select_collect().
  *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
@@ -396,12 +456,17 @@ static void dentry_unlink_inode(struct dentry * dentry)
 #define D_FLAG_VERIFY(dentry,x) WARN_ON_ONCE(((dentry)->d_flags & (DCACHE_LRU_LIST | DCACHE_SHRINK_LIST)) != (x))
 static void d_lru_add(struct dentry *dentry)
 {
+	struct super_block *sb = dentry->d_sb;
+
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
-	if (d_is_negative(dentry))
-		this_cpu_inc(nr_dentry_negative);
-	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
+	WARN_ON_ONCE(!list_lru_add(&sb->s_dentry_lru, &dentry->d_lru));
+	if (d_is_negative(dentry)) {
+		d_negative_inc(dentry);
+		if (d_negative_over_limit(sb))
+			queue_work(system_unbound_wq, &sb->s_dentry_trim_work);
+	}
 }
 
 static void d_lru_del(struct dentry *dentry)
@@ -410,7 +475,7 @@ static void d_lru_del(struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -442,7 +507,7 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -452,7 +517,7 @@ static void d_lru_shrink_move(struct list_lru_one *lru, struct dentry *dentry,
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate_move(lru, &dentry->d_lru, list);
 }
 
@@ -559,6 +624,10 @@ static void __dentry_kill(struct dentry *dentry)
 	 */
 	lockref_mark_dead(&dentry->d_lockref);
 
+	/* Path walks must no longer jump to it from a path prefix cache */
+	if (unlikely(dentry->d_flags & DCACHE_PATH_PREFIX))
+		path_prefix_cache_forget();
+
 	/*
 	 * inform the fs via d_prune that this dentry is about to be
 	 * unhashed and destroyed.
@@ -1149,7 +1218,12 @@ static enum lru_status dentry_lru_isolate(struct list_head *item,
 		return LRU_REMOVED;
 	}
 
-	if (dentry->d_flags & DCACHE_REFERENCED) {
+	/*
+	 * Negative dentries beyond the limit of the superblock get no second
+	 * pass, so that they go before the dentries worth keeping.
+	 */
+	if ((dentry->d_flags & DCACHE_REFERENCED) &&
+	    !(d_is_negative(dentry) && d_negative_over_limit(dentry->d_sb))) {
 		dentry->d_flags &= ~DCACHE_REFERENCED;
 		spin_unlock(&dentry->d_lock);
 
@@ -1204,6 +1278,90 @@ long prune_dcache_sb(struct super_block *sb, struct shrink_control *sc)
 	return freed;
 }
 
+static enum lru_status dentry_lru_isolate_negative(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	/*
+	 * Whatever is not freed here is rotated rather than skipped, as every
+	 * batch starts over at the head of the LRU and would otherwise never
+	 * get past the first entries it cannot free.  Moving the dentry only
+	 * needs the lru lock, see dentry_lru_isolate().
+	 */
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_ROTATE;
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	/* Positive dentries are left to the shrinker */
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, freeable);
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+#define NEGATIVE_DENTRY_TRIM_BATCH	1024
+
+/**
+ * prune_dcache_negative - trim the negative dentries of a superblock
+ * @work: the s_dentry_trim_work of the superblock
+ *
+ * Queued by d_lru_add() when a superblock holds more unused negative
+ * dentries than sysctl_negative_dentry_limit.  Frees the least recently used
+ * ones, NEGATIVE_DENTRY_TRIM_BATCH LRU entries at a time, until an eighth of
+ * the limit is free again, so that a stream of failed lookups does not
+ * requeue the work for every new dentry.  Entries it does not free go to the
+ * tail, so the batches walk the LRU once at most, at the price of positive
+ * dentries looking younger to the shrinker.
+ */
+void prune_dcache_negative(struct work_struct *work)
+{
+	struct super_block *sb = container_of(work, struct super_block,
+					      s_dentry_trim_work);
+	unsigned long limit, nr_batches;
+
+	/* Unmount holds s_umount, and cancels the work after kill_sb */
+	if (!trylock_super(sb))
+		return;
+	if (!sb->s_root || !(sb->s_flags & SB_BORN))
+		goto out;
+
+	nr_batches = list_lru_count(&sb->s_dentry_lru) /
+		     NEGATIVE_DENTRY_TRIM_BATCH + 1;
+	while (nr_batches--) {
+		LIST_HEAD(dispose);
+
+		limit = READ_ONCE(sysctl_negative_dentry_limit);
+		if (!limit || percpu_counter_sum_positive(
+				&sb->s_nr_dentry_negative) <= limit - limit / 8)
+			break;
+
+		list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate_negative,
+			      &dispose, NEGATIVE_DENTRY_TRIM_BATCH);
+		shrink_dentry_list(&dispose);
+		cond_resched();
+	}
+out:
+	up_read(&sb->s_umount);
+}
+
 static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
 {
@@ -1923,7 +2081,7 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	 * Decrement negative dentry count if it was in the LRU list.
 	 */
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
 	raw_write_seqcount_begin(&dentry->d_seq);
 	__d_set_inode_and_type(dentry, inode, add_flags);
@@ -3162,6 +3320,10 @@ static void __init dcache_init_early(void)
 
 static void __init dcache_init(void)
 {
+	/* Let negative dentries take up to 1/64 of memory per superblock */
+	sysctl_negative_dentry_limit = totalram_pages() / 64 *
+				       (PAGE_SIZE / sizeof(struct dentry));
+
 	/*
 	 * A constructor could be added for stable state like the lists,
 	 * but it is probably not worth it because of the cache nature
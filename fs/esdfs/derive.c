@@ -246,8 +246,8 @@ static int lookup_link_source(struct dentry *dentry, struct dentry *parent)
 	esdfs_get_lower_path(parent, &lower_parent_path);
 
 	/* Check if the stub user profile folder is there. */
-	err = esdfs_lookup_nocase(&lower_parent_path, &dentry->d_name,
-					&lower_path);
+	err = esdfs_lookup_nocase(d_inode(parent), &lower_parent_path,
+					&dentry->d_name, &lower_path);
 	/* Remember it to handle renames and removal. */
 	if (!err)
 		esdfs_set_lower_stub_path(dentry, &lower_path);
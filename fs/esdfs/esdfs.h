@@ -60,6 +60,7 @@
 #define ESDFS_MOUNT_GID_DERIVATION	0x00000040
 #define ESDFS_MOUNT_DEFAULT_NORMAL	0x00000080
 #define ESDFS_MOUNT_SPECIAL_DOWNLOAD	0x00000100
+#define ESDFS_MOUNT_PASSTHROUGH		0x00000200
 
 #define clear_opt(sbi, option)	(sbi->options &= ~ESDFS_MOUNT_##option)
 #define set_opt(sbi, option)	(sbi->options |= ESDFS_MOUNT_##option)
@@ -157,13 +158,20 @@ extern int esdfs_derived_revalidate(struct dentry *dentry,
 				    struct dentry *parent);
 extern int esdfs_check_derived_permission(struct inode *inode, int mask);
 extern int esdfs_derive_mkdir_contents(struct dentry *dentry);
-extern int esdfs_lookup_nocase(struct path *lower_parent_path,
+extern int esdfs_lookup_nocase(struct inode *dir,
+		struct path *lower_parent_path,
 		const struct qstr *name, struct path *lower_path);
+extern void esdfs_drop_name_index(struct inode *dir);
+extern long esdfs_nr_name_index_objs(struct super_block *sb,
+		struct shrink_control *sc);
+extern long esdfs_free_name_indexes(struct super_block *sb,
+		struct shrink_control *sc);
 
 /* file private data */
 struct esdfs_file_info {
 	struct file *lower_file;
 	const struct vm_operations_struct *lower_vm_ops;
+	const struct cred *cred;	/* derived at open, for passthrough */
 };
 
 struct esdfs_perms {
@@ -178,7 +186,10 @@ struct esdfs_perms {
 /* esdfs inode data in memory */
 struct esdfs_inode_info {
 	struct inode *lower_inode;
+	struct esdfs_name_index *name_index;	/* case-insensitive lookups */
 	struct inode vfs_inode;
+	struct mutex name_index_lock;	/* protects name_index */
+	struct list_head name_index_lru;	/* on sbi->name_index_lru */
 	unsigned version;	/* package list version this was derived from */
 	int tree;		/* storage tree location */
 	uint32_t userid;	/* Android User ID (not Linux UID) */
@@ -210,6 +221,9 @@ struct esdfs_sb_info {
 	struct user_namespace *dl_ns;	   /* lower downloads namespace */
 	int ns_fd;
 	unsigned int options;
+	struct list_head name_index_lru;   /* dirs with a name index */
+	spinlock_t name_index_lock;	   /* protects the list and the count */
+	unsigned long nr_name_index_objs;  /* for the superblock shrinker */
 };
 
 extern struct esdfs_perms esdfs_perms_table[ESDFS_PERMS_TABLE_SIZE];
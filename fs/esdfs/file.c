@@ -13,15 +13,67 @@
 
 #include "esdfs.h"
 
+/*
+ * With the passthrough mount option, regular files keep the credentials
+ * derived at open time and use them for all data I/O, instead of deriving
+ * them again for every call.  Attributes are not copied up after each I/O
+ * either, esdfs_getattr() refreshes them from the lower inode anyway.  Only
+ * the size is kept in sync, since llseek relies on it.
+ */
+static inline bool esdfs_passthrough(struct file *file)
+{
+	return ESDFS_F(file)->cred != NULL;
+}
+
+static void esdfs_passthrough_size(struct file *file)
+{
+	struct inode *inode = file_inode(file);
+	struct inode *lower_inode = file_inode(esdfs_lower_file(file));
+
+	if (i_size_read(inode) != i_size_read(lower_inode))
+		fsstack_copy_inode_size(inode, lower_inode);
+}
+
+static ssize_t esdfs_passthrough_read(struct file *file, char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	const struct cred *old_cred;
+	ssize_t err;
+
+	old_cred = override_creds(ESDFS_F(file)->cred);
+	err = vfs_read(esdfs_lower_file(file), buf, count, ppos);
+	revert_creds(old_cred);
+	return err;
+}
+
+static ssize_t esdfs_passthrough_write(struct file *file,
+				       const char __user *buf, size_t count,
+				       loff_t *ppos)
+{
+	const struct cred *old_cred;
+	ssize_t err;
+
+	old_cred = override_creds(ESDFS_F(file)->cred);
+	err = vfs_write(esdfs_lower_file(file), buf, count, ppos);
+	revert_creds(old_cred);
+	if (err > 0)
+		esdfs_passthrough_size(file);
+	return err;
+}
+
 static ssize_t esdfs_read(struct file *file, char __user *buf,
 			   size_t count, loff_t *ppos)
 {
 	int err;
 	struct file *lower_file;
 	struct dentry *dentry = file->f_path.dentry;
-	const struct cred *creds =
-			esdfs_override_creds(ESDFS_SB(dentry->d_sb),
-					ESDFS_I(file->f_inode), NULL);
+	const struct cred *creds;
+
+	if (esdfs_passthrough(file))
+		return esdfs_passthrough_read(file, buf, count, ppos);
+
+	creds = esdfs_override_creds(ESDFS_SB(dentry->d_sb),
+				     ESDFS_I(file->f_inode), NULL);
 	if (!creds)
 		return -ENOMEM;
 
@@ -43,9 +95,13 @@ static ssize_t esdfs_write(struct file *file, const char __user *buf,
 
 	struct file *lower_file;
 	struct dentry *dentry = file->f_path.dentry;
-	const struct cred *creds =
-			esdfs_override_creds(ESDFS_SB(dentry->d_sb),
-					ESDFS_I(file->f_inode), NULL);
+	const struct cred *creds;
+
+	if (esdfs_passthrough(file))
+		return esdfs_passthrough_write(file, buf, count, ppos);
+
+	creds = esdfs_override_creds(ESDFS_SB(dentry->d_sb),
+				     ESDFS_I(file->f_inode), NULL);
 	if (!creds)
 		return -ENOMEM;
 
@@ -148,6 +204,40 @@ static long esdfs_compat_ioctl(struct file *file, unsigned int cmd,
 }
 #endif
 
+/*
+ * Hand the mapping over to the lower file, so that faults are served by the
+ * lower file system directly without going through esdfs_vm_ops.
+ */
+static int esdfs_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct file *lower_file = esdfs_lower_file(file);
+	const struct cred *old_cred;
+	int err;
+
+	if (!lower_file->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(lower_file);
+
+	old_cred = override_creds(ESDFS_F(file)->cred);
+	err = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (err) {
+		/* Drop reference count from new vm_file value */
+		fput(lower_file);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	file_accessed(file);
+	return err;
+}
+
 static int esdfs_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	int err = 0;
@@ -155,8 +245,12 @@ static int esdfs_mmap(struct file *file, struct vm_area_struct *vma)
 	struct file *lower_file;
 	const struct vm_operations_struct *saved_vm_ops = NULL;
 	struct esdfs_sb_info *sbi = ESDFS_SB(file->f_path.dentry->d_sb);
-	const struct cred *creds = esdfs_override_creds(sbi,
-					ESDFS_I(file->f_inode), NULL);
+	const struct cred *creds;
+
+	if (esdfs_passthrough(file))
+		return esdfs_passthrough_mmap(file, vma);
+
+	creds = esdfs_override_creds(sbi, ESDFS_I(file->f_inode), NULL);
 	if (!creds)
 		return -ENOMEM;
 
@@ -258,6 +352,9 @@ static int esdfs_open(struct inode *inode, struct file *file)
 		}
 	} else {
 		esdfs_set_lower_file(file, lower_file);
+		/* keep the derived creds around for passthrough I/O */
+		if (test_opt(sbi, PASSTHROUGH) && S_ISREG(inode->i_mode))
+			ESDFS_F(file)->cred = get_cred(current_cred());
 	}
 
 	if (err)
@@ -300,6 +397,8 @@ static int esdfs_file_release(struct inode *inode, struct file *file)
 		fput(lower_file);
 	}
 
+	if (ESDFS_F(file)->cred)
+		put_cred(ESDFS_F(file)->cred);
 	kfree(ESDFS_F(file));
 	return 0;
 }
@@ -383,6 +482,7 @@ esdfs_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
 	int err;
 	struct file *file = iocb->ki_filp, *lower_file;
+	const struct cred *old_cred = NULL;
 
 	lower_file = esdfs_lower_file(file);
 	if (!lower_file->f_op->read_iter) {
@@ -390,11 +490,17 @@ esdfs_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 		goto out;
 	}
 
+	if (esdfs_passthrough(file))
+		old_cred = override_creds(ESDFS_F(file)->cred);
 	get_file(lower_file); /* prevent lower_file from being released */
 	iocb->ki_filp = lower_file;
 	err = lower_file->f_op->read_iter(iocb, iter);
 	iocb->ki_filp = file;
 	fput(lower_file);
+	if (old_cred) {
+		revert_creds(old_cred);
+		return err;
+	}
 	/* update upper inode atime as needed */
 	if (err >= 0 || err == -EIOCBQUEUED)
 		fsstack_copy_attr_atime(file->f_path.dentry->d_inode,
@@ -411,6 +517,7 @@ esdfs_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
 	int err;
 	struct file *file = iocb->ki_filp, *lower_file;
+	const struct cred *old_cred = NULL;
 
 	lower_file = esdfs_lower_file(file);
 	if (!lower_file->f_op->write_iter) {
@@ -418,11 +525,19 @@ esdfs_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 		goto out;
 	}
 
+	if (esdfs_passthrough(file))
+		old_cred = override_creds(ESDFS_F(file)->cred);
 	get_file(lower_file); /* prevent lower_file from being released */
 	iocb->ki_filp = lower_file;
 	err = lower_file->f_op->write_iter(iocb, iter);
 	iocb->ki_filp = file;
 	fput(lower_file);
+	if (old_cred) {
+		revert_creds(old_cred);
+		if (err > 0)
+			esdfs_passthrough_size(file);
+		return err;
+	}
 	/* update upper inode times/sizes as needed */
 	if (err >= 0 || err == -EIOCBQUEUED) {
 		fsstack_copy_inode_size(file->f_path.dentry->d_inode,
@@ -61,6 +61,8 @@ static int esdfs_create(struct inode *dir, struct dentry *dentry,
 
 out:
 	unlock_dir(lower_parent_dentry);
+	if (!err)
+		esdfs_drop_name_index(dir);
 	esdfs_put_lower_path(dentry, &lower_path);
 	esdfs_revert_creds(creds, &mask);
 	return err;
@@ -122,6 +124,8 @@ static int esdfs_unlink(struct inode *dir, struct dentry *dentry)
 	d_drop(dentry); /* this is needed, else LTP fails (VFS won't do it) */
 out:
 	unlock_dir(lower_dir_dentry);
+	if (!err)
+		esdfs_drop_name_index(dir);
 	dput(lower_dentry);
 	esdfs_put_lower_path(dentry, &lower_path);
 	esdfs_revert_creds(creds, NULL);
@@ -176,6 +180,8 @@ static int esdfs_mkdir(struct inode *dir, struct dentry *dentry, umode_t mode)
 unlock_lower_parent:
 	unlock_dir(lower_parent_dentry);
 out:
+	if (!err)
+		esdfs_drop_name_index(dir);
 	esdfs_put_lower_path(dentry, &lower_path);
 	esdfs_revert_creds(creds, &mask);
 	return err;
@@ -221,6 +227,8 @@ static int esdfs_rmdir(struct inode *dir, struct dentry *dentry)
 
 out:
 	unlock_dir(lower_dir_dentry);
+	if (!err)
+		esdfs_drop_name_index(dir);
 	esdfs_put_lower_path(dentry, &lower_path);
 	esdfs_revert_creds(creds, NULL);
 	return err;
@@ -319,6 +327,11 @@ static int esdfs_rename(struct inode *old_dir, struct dentry *old_dentry,
 	esdfs_derive_lower_ownership(old_dentry, new_dentry->d_name.name);
 out:
 	unlock_rename(lower_old_dir_dentry, lower_new_dir_dentry);
+	if (!err) {
+		esdfs_drop_name_index(old_dir);
+		if (new_dir != old_dir)
+			esdfs_drop_name_index(new_dir);
+	}
 	esdfs_put_lower_parent(old_dentry, &lower_old_dir_dentry);
 	esdfs_put_lower_parent(new_dentry, &lower_new_dir_dentry);
 	esdfs_put_lower_path(old_dentry, &lower_old_path);
@@ -11,6 +11,11 @@
  * published by the Free Software Foundation.
  */
 
+#include <linux/ctype.h>
+#include <linux/hash.h>
+#include <linux/iversion.h>
+#include <linux/log2.h>
+
 #include "esdfs.h"
 
 struct esdfs_name_data {
@@ -35,13 +40,380 @@ static int esdfs_name_match(struct dir_context *ctx, const char *name, int namel
 	return 0;
 }
 
-int esdfs_lookup_nocase(struct path *parent,
+/*
+ * Case-insensitive index of the names in a lower directory.  It hangs off
+ * the upper directory inode and is built the first time a lookup in that
+ * directory misses with the exact case, so that further case-mismatched and
+ * negative lookups don't have to scan the whole lower directory.
+ *
+ * The index is dropped when esdfs itself modifies the directory.  Changes
+ * made through the lower file system or another esdfs view are caught with
+ * the lower directory's i_version if the lower file system maintains it.
+ * Otherwise we fall back to its mtime and ctime, and refuse to keep an index
+ * built in the same timestamp tick as the last change, since a second change
+ * in that tick would go unnoticed.
+ *
+ * At most ESDFS_NAME_INDEX_MAX names are indexed per directory.  Lookups
+ * that miss in a truncated index still scan the lower directory.  Indexes
+ * are kept on a per-superblock LRU list and freed by the superblock
+ * shrinker under memory pressure.
+ */
+#define ESDFS_NAME_INDEX_MAX	8192
+
+struct esdfs_name_index {
+	u64 version;
+	struct timespec64 mtime;
+	struct timespec64 ctime;
+	unsigned int nr;	/* number of indexed names */
+	bool complete;		/* false if the directory was too big */
+	unsigned int bits;
+	struct hlist_head buckets[];
+};
+
+struct esdfs_name_ent {
+	struct hlist_node node;
+	unsigned int hash;
+	unsigned int len;
+	char name[];
+};
+
+struct esdfs_index_data {
+	struct dir_context ctx;
+	struct hlist_head ents;
+	unsigned int nr;
+	bool full;
+	int err;
+};
+
+static unsigned int esdfs_name_hash(const char *name, unsigned int len)
+{
+	unsigned long hash = init_name_hash(NULL);
+
+	while (len--)
+		hash = partial_name_hash(tolower(*name++), hash);
+	return end_name_hash(hash);
+}
+
+/* what an index counts for towards the shrinker, itself included */
+static inline unsigned long esdfs_name_index_objs(struct esdfs_name_index *index)
+{
+	return index->nr + 1;
+}
+
+static void esdfs_free_name_ents(struct hlist_head *head)
+{
+	struct esdfs_name_ent *ent;
+	struct hlist_node *tmp;
+
+	hlist_for_each_entry_safe(ent, tmp, head, node)
+		kfree(ent);
+}
+
+static void esdfs_free_name_index(struct esdfs_name_index *index)
+{
+	unsigned int i;
+
+	if (!index)
+		return;
+
+	for (i = 0; i < (1U << index->bits); i++)
+		esdfs_free_name_ents(&index->buckets[i]);
+	kvfree(index);
+}
+
+static int esdfs_index_fill(struct dir_context *ctx, const char *name,
+		int namelen, loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct esdfs_index_data *buf =
+		container_of(ctx, struct esdfs_index_data, ctx);
+	struct esdfs_name_ent *ent;
+
+	if (namelen == 1 && name[0] == '.')
+		return 0;
+	if (namelen == 2 && name[0] == '.' && name[1] == '.')
+		return 0;
+
+	if (buf->nr >= ESDFS_NAME_INDEX_MAX) {
+		buf->full = true;
+		return -ENOSPC;
+	}
+
+	ent = kmalloc(sizeof(*ent) + namelen + 1, GFP_KERNEL);
+	if (!ent) {
+		buf->err = -ENOMEM;
+		return -ENOMEM;
+	}
+	ent->hash = esdfs_name_hash(name, namelen);
+	ent->len = namelen;
+	memcpy(ent->name, name, namelen);
+	ent->name[namelen] = 0;
+	hlist_add_head(&ent->node, &buf->ents);
+	buf->nr++;
+	return 0;
+}
+
+static bool esdfs_name_index_valid(struct esdfs_name_index *index,
+		struct inode *lower_dir)
+{
+	if (IS_I_VERSION(lower_dir))
+		return inode_eq_iversion(lower_dir, index->version);
+	return timespec64_equal(&index->mtime, &lower_dir->i_mtime) &&
+	       timespec64_equal(&index->ctime, &lower_dir->i_ctime);
+}
+
+static struct esdfs_name_index *esdfs_build_name_index(struct path *parent)
+{
+	struct inode *lower_dir = d_inode(parent->dentry);
+	struct esdfs_index_data buffer = {
+		.ctx.actor = esdfs_index_fill,
+		.ents = HLIST_HEAD_INIT,
+	};
+	struct esdfs_name_index *index;
+	struct esdfs_name_ent *ent;
+	struct timespec64 mtime, ctime, now;
+	struct hlist_node *tmp;
+	struct file *file;
+	unsigned int bits;
+	u64 version = 0;
+	int err;
+
+	file = dentry_open(parent, O_RDONLY | O_DIRECTORY, current_cred());
+	if (IS_ERR(file))
+		return ERR_CAST(file);
+
+	/* snapshot the version first so that racing changes make us stale */
+	inode_lock_shared(lower_dir);
+	if (IS_I_VERSION(lower_dir))
+		version = inode_query_iversion(lower_dir);
+	mtime = lower_dir->i_mtime;
+	ctime = lower_dir->i_ctime;
+	inode_unlock_shared(lower_dir);
+
+	err = iterate_dir(file, &buffer.ctx);
+	fput(file);
+	if (!err)
+		err = buffer.err;
+	if (err)
+		goto out_free_ents;
+
+	/* a later change in the current tick would leave the times alone */
+	if (!IS_I_VERSION(lower_dir)) {
+		now = current_time(lower_dir);
+		if (timespec64_compare(&mtime, &now) >= 0 ||
+		    timespec64_compare(&ctime, &now) >= 0) {
+			err = -EAGAIN;
+			goto out_free_ents;
+		}
+	}
+
+	bits = ilog2(roundup_pow_of_two(max(buffer.nr, 16U)));
+	index = kvzalloc(struct_size(index, buckets, 1U << bits), GFP_KERNEL);
+	if (!index) {
+		err = -ENOMEM;
+		goto out_free_ents;
+	}
+	index->bits = bits;
+	index->nr = buffer.nr;
+	index->complete = !buffer.full;
+	index->version = version;
+	index->mtime = mtime;
+	index->ctime = ctime;
+
+	/*
+	 * The entries were collected in reverse, so adding them back to the
+	 * head of each bucket restores readdir order among names which only
+	 * differ in case.
+	 */
+	hlist_for_each_entry_safe(ent, tmp, &buffer.ents, node) {
+		hlist_del(&ent->node);
+		hlist_add_head(&ent->node,
+			       &index->buckets[hash_32(ent->hash, bits)]);
+	}
+	return index;
+
+out_free_ents:
+	esdfs_free_name_ents(&buffer.ents);
+	return ERR_PTR(err);
+}
+
+/* Must be called with the name_index_lock of @dir held. */
+static void esdfs_attach_name_index(struct inode *dir,
+		struct esdfs_name_index *index)
+{
+	struct esdfs_sb_info *sbi = ESDFS_SB(dir->i_sb);
+	struct esdfs_inode_info *info = ESDFS_I(dir);
+
+	info->name_index = index;
+	spin_lock(&sbi->name_index_lock);
+	list_add_tail(&info->name_index_lru, &sbi->name_index_lru);
+	sbi->nr_name_index_objs += esdfs_name_index_objs(index);
+	spin_unlock(&sbi->name_index_lock);
+}
+
+/* Must be called with the name_index_lock of @dir held. */
+static struct esdfs_name_index *esdfs_detach_name_index(struct inode *dir)
+{
+	struct esdfs_sb_info *sbi = ESDFS_SB(dir->i_sb);
+	struct esdfs_inode_info *info = ESDFS_I(dir);
+	struct esdfs_name_index *index = info->name_index;
+
+	if (!index)
+		return NULL;
+
+	spin_lock(&sbi->name_index_lock);
+	list_del_init(&info->name_index_lru);
+	sbi->nr_name_index_objs -= esdfs_name_index_objs(index);
+	spin_unlock(&sbi->name_index_lock);
+	info->name_index = NULL;
+	return index;
+}
+
+void esdfs_drop_name_index(struct inode *dir)
+{
+	struct esdfs_inode_info *info = ESDFS_I(dir);
+	struct esdfs_name_index *index;
+
+	mutex_lock(&info->name_index_lock);
+	index = esdfs_detach_name_index(dir);
+	mutex_unlock(&info->name_index_lock);
+
+	esdfs_free_name_index(index);
+}
+
+long esdfs_nr_name_index_objs(struct super_block *sb,
+		struct shrink_control *sc)
+{
+	return READ_ONCE(ESDFS_SB(sb)->nr_name_index_objs);
+}
+
+/*
+ * Free the least recently used name indexes of @sb.  Directories busy with
+ * a lookup are skipped, their index is in use anyway.
+ */
+long esdfs_free_name_indexes(struct super_block *sb,
+		struct shrink_control *sc)
+{
+	struct esdfs_sb_info *sbi = ESDFS_SB(sb);
+	struct esdfs_inode_info *info;
+	struct esdfs_name_index *index;
+	unsigned long nr = sc->nr_to_scan;
+	unsigned long objs;
+	long freed = 0;
+
+	while (nr) {
+		index = NULL;
+		spin_lock(&sbi->name_index_lock);
+		info = list_first_entry_or_null(&sbi->name_index_lru,
+				struct esdfs_inode_info, name_index_lru);
+		if (!info) {
+			spin_unlock(&sbi->name_index_lock);
+			break;
+		}
+		if (mutex_trylock(&info->name_index_lock)) {
+			index = info->name_index;
+			info->name_index = NULL;
+			list_del_init(&info->name_index_lru);
+			sbi->nr_name_index_objs -= esdfs_name_index_objs(index);
+			mutex_unlock(&info->name_index_lock);
+		} else {
+			list_move_tail(&info->name_index_lru,
+				       &sbi->name_index_lru);
+		}
+		spin_unlock(&sbi->name_index_lock);
+
+		if (!index) {
+			nr--;
+			continue;
+		}
+		objs = esdfs_name_index_objs(index);
+		esdfs_free_name_index(index);
+		freed += objs;
+		nr -= min(nr, objs);
+	}
+	return freed;
+}
+
+/*
+ * Look @name up in the name index of @dir, building it if needed.  Returns 0
+ * and the lower name in @match_name, -ENOENT if there is no such name, or
+ * another error if the index couldn't answer and the caller has to scan.
+ */
+static int esdfs_index_lookup(struct inode *dir, struct path *parent,
+		const struct qstr *name, char *match_name)
+{
+	struct esdfs_sb_info *sbi = ESDFS_SB(dir->i_sb);
+	struct esdfs_inode_info *info = ESDFS_I(dir);
+	struct inode *lower_dir = d_inode(parent->dentry);
+	struct esdfs_name_index *index;
+	struct esdfs_name_ent *ent;
+	unsigned int hash;
+	int err;
+
+	mutex_lock(&info->name_index_lock);
+	index = info->name_index;
+	if (index && !esdfs_name_index_valid(index, lower_dir)) {
+		esdfs_free_name_index(esdfs_detach_name_index(dir));
+		index = NULL;
+	}
+	if (!index) {
+		index = esdfs_build_name_index(parent);
+		if (IS_ERR(index)) {
+			err = PTR_ERR(index);
+			goto out_unlock;
+		}
+		esdfs_attach_name_index(dir, index);
+	} else {
+		spin_lock(&sbi->name_index_lock);
+		list_move_tail(&info->name_index_lru, &sbi->name_index_lru);
+		spin_unlock(&sbi->name_index_lock);
+	}
+
+	err = index->complete ? -ENOENT : -EAGAIN;
+	hash = esdfs_name_hash(name->name, name->len);
+	hlist_for_each_entry(ent, &index->buckets[hash_32(hash, index->bits)],
+			     node) {
+		if (ent->hash == hash && ent->len == name->len &&
+		    str_n_case_eq(ent->name, name->name, name->len)) {
+			memcpy(match_name, ent->name, ent->len + 1);
+			err = 0;
+			break;
+		}
+	}
+out_unlock:
+	mutex_unlock(&info->name_index_lock);
+	return err;
+}
+
+/*
+ * @dir is the upper directory whose lower directory is @parent.  If it is
+ * given, case-insensitive lookups go through its name index.
+ */
+int esdfs_lookup_nocase(struct inode *dir,
+		struct path *parent,
 		const struct qstr *name,
 		struct path *path) {
 	int err = 0;
+	char match_name[NAME_MAX+1];
+
 	/* Use vfs_path_lookup to check if the dentry exists or not */
 	err = vfs_path_lookup(parent->dentry, parent->mnt, name->name, 0, path);
+	if (err != -ENOENT || !dir)
+		goto scan;
+
 	/* check for other cases */
+	err = esdfs_index_lookup(dir, parent, name, match_name);
+	if (err == -ENOENT)
+		return err;
+	if (!err) {
+		err = vfs_path_lookup(parent->dentry, parent->mnt,
+					match_name, 0, path);
+		if (err != -ENOENT)
+			return err;
+		/* the index went stale under us, start over */
+		esdfs_drop_name_index(dir);
+	}
+	err = -ENOENT;
+scan:
 	if (err == -ENOENT) {
 		struct file *file;
 		const struct cred *cred = current_cred();
@@ -295,6 +667,7 @@ int esdfs_interpose(struct dentry *dentry, struct super_block *sb,
  */
 static struct dentry *__esdfs_lookup(struct dentry *dentry,
 				     unsigned int flags,
+				     struct inode *dir,
 				     struct path *lower_parent_path,
 				     uint32_t id, bool use_dl)
 {
@@ -332,7 +705,7 @@ static struct dentry *__esdfs_lookup(struct dentry *dentry,
 		pathcpy(&lower_path, &ESDFS_SB(dentry->d_sb)->dl_path);
 		path_get(&ESDFS_SB(dentry->d_sb)->dl_path);
 	} else {
-		err = esdfs_lookup_nocase(lower_parent_path, &dname,
+		err = esdfs_lookup_nocase(dir, lower_parent_path, &dname,
 					  &lower_path);
 	}
 
@@ -430,7 +803,8 @@ struct dentry *esdfs_lookup(struct inode *dir, struct dentry *dentry,
 	/* Check if the lookup corresponds to the Download directory */
 	use_dl = esdfs_is_dl_lookup(dentry, parent);
 
-	ret = __esdfs_lookup(dentry, flags, &lower_parent_path,
+	ret = __esdfs_lookup(dentry, flags, d_inode(parent),
+					&lower_parent_path,
 					ESDFS_I(dir)->userid,
 					use_dl);
 	if (IS_ERR(ret))
@@ -36,6 +36,7 @@ enum {
 	Opt_dl_uid,
 	Opt_dl_gid,
 	Opt_ns_fd,
+	Opt_passthrough,
 
 	/* From sdcardfs */
 	Opt_fsuid,
@@ -65,6 +66,7 @@ static match_table_t esdfs_tokens = {
 	{Opt_dl_uid, "dl_uid=%u"},
 	{Opt_dl_gid, "dl_gid=%u"},
 	{Opt_ns_fd, "ns_fd=%d"},
+	{Opt_passthrough, "passthrough"},
 	/* compatibility with sdcardfs options */
 	{Opt_fsuid, "fsuid=%u"},
 	{Opt_fsgid, "fsgid=%u"},
@@ -289,6 +291,9 @@ static int parse_options(struct super_block *sb, char *options)
 		case Opt_default_normal:
 			set_opt(sbi, DEFAULT_NORMAL);
 			break;
+		case Opt_passthrough:
+			set_opt(sbi, PASSTHROUGH);
+			break;
 		case Opt_dl_loc:
 			set_opt(sbi, SPECIAL_DOWNLOAD);
 			sbi->dl_loc = match_strdup(args);
@@ -381,6 +386,8 @@ static int esdfs_read_super(struct super_block *sb, const char *dev_name,
 		goto out_pput;
 	}
 	INIT_LIST_HEAD(&sbi->s_list);
+	INIT_LIST_HEAD(&sbi->name_index_lru);
+	spin_lock_init(&sbi->name_index_lock);
 
 	/* set defaults and then parse the mount options */
 
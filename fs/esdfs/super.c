@@ -158,6 +158,8 @@ static void esdfs_evict_inode(struct inode *inode)
 	lower_inode = esdfs_lower_inode(inode);
 	esdfs_set_lower_inode(inode, NULL);
 	iput(lower_inode);
+	if (S_ISDIR(inode->i_mode))
+		esdfs_drop_name_index(inode);
 }
 
 static struct inode *esdfs_alloc_inode(struct super_block *sb)
@@ -193,6 +195,8 @@ static void init_once(void *obj)
 	struct esdfs_inode_info *i = obj;
 
 	inode_init_once(&i->vfs_inode);
+	mutex_init(&i->name_index_lock);
+	INIT_LIST_HEAD(&i->name_index_lru);
 }
 
 int esdfs_init_inode_cache(void)
@@ -269,6 +273,8 @@ static int esdfs_show_options(struct seq_file *seq, struct dentry *root)
 		seq_puts(seq, ",derive_gid");
 	if (test_opt(sbi, DEFAULT_NORMAL))
 		seq_puts(seq, ",default_normal");
+	if (test_opt(sbi, PASSTHROUGH))
+		seq_puts(seq, ",passthrough");
 	if (test_opt(sbi, SPECIAL_DOWNLOAD)) {
 		seq_printf(seq, ",dl_loc=%s", sbi->dl_loc);
 		seq_printf(seq, ",dl_uid=%d", sbi->lower_dl_perms.raw_uid);
@@ -287,4 +293,6 @@ const struct super_operations esdfs_sops = {
 	.alloc_inode	= esdfs_alloc_inode,
 	.destroy_inode	= esdfs_destroy_inode,
 	.drop_inode	= generic_delete_inode,
+	.nr_cached_objects = esdfs_nr_name_index_objs,
+	.free_cached_objects = esdfs_free_name_indexes,
 };
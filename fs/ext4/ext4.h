@@ -1456,6 +1456,10 @@ struct ext4_sb_info {
 	unsigned int s_mb_free_pending;
 	struct list_head s_freed_data_list;	/* List of blocks to be freed
 						   after commit completed */
+	struct list_head *s_mb_largest_free_orders; /* groups by order of
+						       their largest free
+						       extent */
+	rwlock_t *s_mb_largest_free_orders_locks;
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -1465,6 +1469,7 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_optimize_scan;
 	unsigned int s_max_dir_size_kb;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
@@ -1478,6 +1483,11 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_groups_scanned;	/* groups whose buddy was scanned */
+	atomic_t s_bal_cr_hits[4];	/* allocations found per criteria */
+	atomic_t s_bal_idx_hits;	/* order index lookups that found */
+	atomic_t s_bal_idx_misses;	/* order index lookups that did not */
+	atomic64_t s_bal_scan_ns;	/* time spent scanning groups */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -2591,6 +2601,7 @@ extern void ext4_end_bitmap_read(struct buffer_head *bh, int uptodate);
 
 /* mballoc.c */
 extern const struct seq_operations ext4_mb_seq_groups_ops;
+extern int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset);
 extern long ext4_mb_stats;
 extern long ext4_mb_max_to_scan;
 extern int ext4_mb_init(struct super_block *);
@@ -3061,6 +3072,10 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number */
+	struct          list_head bb_largest_free_order_node; /* on the
+					 * s_mb_largest_free_orders list of
+					 * bb_largest_free_order */
 	struct          list_head bb_prealloc_list;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
@@ -688,23 +688,40 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the matching list of the order index.  Called
+ * with the group lock held.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
+	int order = -1; /* uninit */
 	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			order = i;
 			break;
 		}
 	}
+	grp->bb_largest_free_order = order;
+
+	if (order == old && (order < 0 ||
+			     !list_empty(&grp->bb_largest_free_order_node)))
+		return;
+
+	if (!list_empty(&grp->bb_largest_free_order_node)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	if (order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[order]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
 }
 
 static noinline_for_stack
@@ -2105,6 +2122,137 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Scan @group for the best extent at criteria @cr.  Groups not good for @cr
+ * are skipped; the first error ext4_mb_good_group() returns for one is kept
+ * in @first_err.  Returns an error only if the buddy could not be loaded.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr, int *first_err)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_buddy e4b;
+	int ret, err;
+
+	/* This now checks without needing the buddy page */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(&e4b);
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (cr == 0)
+		ext4_mb_simple_scan_group(ac, &e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, &e4b);
+	else
+		ext4_mb_complex_scan_group(ac, &e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+	return 0;
+}
+
+/*
+ * Cheap check of a group on the order index, done without the group lock.
+ * ext4_mb_scan_group() has the final say.
+ */
+static bool ext4_mb_index_good_group(struct ext4_allocation_context *ac,
+				     struct ext4_group_info *grp,
+				     ext4_group_t ngroups, int cr)
+{
+	int flex_size = ext4_flex_bg_size(EXT4_SB(ac->ac_sb));
+
+	if (grp->bb_group >= ngroups)
+		return false;
+	if (READ_ONCE(grp->bb_free) < ac->ac_g_ex.fe_len)
+		return false;
+	if (unlikely(EXT4_MB_GRP_BBITMAP_CORRUPT(grp)))
+		return false;
+
+	/* Avoid using the first bg of a flexgroup for data files */
+	if (cr == 0 && (ac->ac_flags & EXT4_MB_HINT_DATA) &&
+	    (flex_size >= EXT4_FLEX_SIZE_DIR_ALLOC_SCHEME) &&
+	    ((grp->bb_group % flex_size) == 0))
+		return false;
+
+	return true;
+}
+
+/*
+ * Try the groups whose largest free extent covers the request, taken from
+ * the order index smallest order first, instead of walking all groups.  A
+ * group is only a hint until it is scanned under its lock: it can change
+ * order in between.  Groups whose buddy was never loaded are not indexed
+ * yet, the linear scan picks those up.
+ */
+static int ext4_mb_scan_by_order(struct ext4_allocation_context *ac, int cr,
+				 ext4_group_t ngroups, int *first_err)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t groups[MB_INDEX_BATCH];
+	struct ext4_group_info *grp;
+	int order, nr, i, err;
+
+	order = cr == 0 ? ac->ac_2order : order_base_2(ac->ac_g_ex.fe_len);
+	for (; order < MB_NUM_ORDERS(sb); order++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[order]))
+			continue;
+
+		nr = 0;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[order],
+				    bb_largest_free_order_node) {
+			if (!ext4_mb_index_good_group(ac, grp, ngroups, cr))
+				continue;
+			groups[nr++] = grp->bb_group;
+			if (nr == MB_INDEX_BATCH)
+				break;
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+
+		for (i = 0; i < nr; i++) {
+			cond_resched();
+			err = ext4_mb_scan_group(ac, groups[i], cr, first_err);
+			if (err)
+				return err;
+			if (ac->ac_status != AC_STATUS_CONTINUE) {
+				if (sbi->s_mb_stats)
+					atomic_inc(&sbi->s_bal_idx_hits);
+				return 0;
+			}
+		}
+	}
+
+	if (sbi->s_mb_stats)
+		atomic_inc(&sbi->s_bal_idx_misses);
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2114,6 +2262,7 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
 	struct ext4_buddy e4b;
+	u64 start_ns = 0;
 
 	sb = ac->ac_sb;
 	sbi = EXT4_SB(sb);
@@ -2164,6 +2313,9 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		spin_unlock(&sbi->s_md_lock);
 	}
 
+	if (sbi->s_mb_stats)
+		start_ns = ktime_get_ns();
+
 	/* Let's just scan groups to find more-less suitable blocks */
 	cr = ac->ac_2order ? 0 : 1;
 	/*
@@ -2173,6 +2325,20 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+
+		if (cr <= 1 && sbi->s_mb_optimize_scan) {
+			err = ext4_mb_scan_by_order(ac, cr, ngroups,
+						    &first_err);
+			if (err)
+				goto out;
+			/*
+			 * Only a group with a free extent of the
+			 * requested order can satisfy cr 0.
+			 */
+			if (cr == 0 || ac->ac_status != AC_STATUS_CONTINUE)
+				continue;
+		}
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
@@ -2180,7 +2346,6 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		group = ac->ac_g_ex.fe_group;
 
 		for (i = 0; i < ngroups; group++, i++) {
-			int ret = 0;
 			cond_resched();
 			/*
 			 * Artificially restricted ngroups for non-extent
@@ -2189,50 +2354,18 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 			if (group >= ngroups)
 				group = 0;
 
-			/* This now checks without needing the buddy page */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				if (!first_err)
-					first_err = ret;
-				continue;
-			}
-
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr, &first_err);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				if (!first_err)
-					first_err = ret;
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
 	}
 
+	if (sbi->s_mb_stats && ac->ac_status == AC_STATUS_FOUND)
+		atomic_inc(&sbi->s_bal_cr_hits[ac->ac_criteria]);
+
 	if (ac->ac_b_ex.fe_len > 0 && ac->ac_status != AC_STATUS_FOUND &&
 	    !(ac->ac_flags & EXT4_MB_HINT_FIRST)) {
 		/*
@@ -2259,11 +2392,58 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		}
 	}
 out:
+	if (start_ns)
+		atomic64_add(ktime_get_ns() - start_ns, &sbi->s_bal_scan_ns);
 	if (!err && ac->ac_status != AC_STATUS_FOUND && first_err)
 		err = first_err;
 	return err;
 }
 
+int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int cr;
+
+	seq_puts(seq, "mballoc:\n");
+	if (!sbi->s_mb_stats) {
+		seq_puts(seq, "\tmb stats collection turned off.\n");
+		seq_puts(seq, "\tTo enable, please write \"1\" to sysfs file mb_stats.\n");
+		return 0;
+	}
+	seq_printf(seq, "\treqs: %u\n", atomic_read(&sbi->s_bal_reqs));
+	seq_printf(seq, "\tsuccess: %u\n", atomic_read(&sbi->s_bal_success));
+	seq_printf(seq, "\tallocated: %u\n",
+		   atomic_read(&sbi->s_bal_allocated));
+	seq_printf(seq, "\tgroups_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_groups_scanned));
+	seq_printf(seq, "\textents_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_ex_scanned));
+	seq_printf(seq, "\t\tgoal_hits: %u\n", atomic_read(&sbi->s_bal_goals));
+	seq_printf(seq, "\t\t2^n_hits: %u\n",
+		   atomic_read(&sbi->s_bal_2orders));
+	seq_printf(seq, "\t\tbreaks: %u\n", atomic_read(&sbi->s_bal_breaks));
+	seq_printf(seq, "\t\tlost: %u\n", atomic_read(&sbi->s_mb_lost_chunks));
+	for (cr = 0; cr < 4; cr++)
+		seq_printf(seq, "\tcr%d_hits: %u\n", cr,
+			   atomic_read(&sbi->s_bal_cr_hits[cr]));
+	seq_printf(seq, "\toptimize_scan: %u\n", sbi->s_mb_optimize_scan);
+	seq_printf(seq, "\t\tindex_hits: %u\n",
+		   atomic_read(&sbi->s_bal_idx_hits));
+	seq_printf(seq, "\t\tindex_misses: %u\n",
+		   atomic_read(&sbi->s_bal_idx_misses));
+	seq_printf(seq, "\tscan_time_ns: %llu\n",
+		   (unsigned long long)atomic64_read(&sbi->s_bal_scan_ns));
+	seq_printf(seq, "\tbuddies_generated: %lu\n",
+		   sbi->s_mb_buddies_generated);
+	seq_printf(seq, "\tbuddies_time_used: %llu\n",
+		   sbi->s_mb_generation_time);
+	seq_printf(seq, "\tpreallocated: %u\n",
+		   atomic_read(&sbi->s_mb_preallocated));
+	seq_printf(seq, "\tdiscarded: %u\n", atomic_read(&sbi->s_mb_discarded));
+	return 0;
+}
+
 static void *ext4_mb_seq_groups_start(struct seq_file *seq, loff_t *pos)
 {
 	struct super_block *sb = PDE_DATA(file_inode(seq->file));
@@ -2452,6 +2632,8 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2633,6 +2815,25 @@ int ext4_mb_init(struct super_block *sb)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 	sbi->s_mb_free_pending = 0;
@@ -2643,6 +2844,7 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2695,6 +2897,10 @@ int ext4_mb_init(struct super_block *sb)
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2751,6 +2957,8 @@ int ext4_mb_release(struct super_block *sb)
 		kvfree(group_info);
 		rcu_read_unlock();
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -3291,6 +3499,7 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 		if (ac->ac_b_ex.fe_len >= ac->ac_o_ex.fe_len)
 			atomic_inc(&sbi->s_bal_success);
 		atomic_add(ac->ac_found, &sbi->s_bal_ex_scanned);
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
 		if (ac->ac_g_ex.fe_start == ac->ac_b_ex.fe_start &&
 				ac->ac_g_ex.fe_group == ac->ac_b_ex.fe_group)
 			atomic_inc(&sbi->s_bal_goals);
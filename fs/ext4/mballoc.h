@@ -77,6 +77,21 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * look up groups by the order of their largest free extent for
+ * exact and good-chunk requests instead of scanning every group;
+ * off by default, as cr 0 then never tries groups whose buddy is
+ * not loaded yet
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	0
+
+/*
+ * groups taken from one order list of the index at a time
+ */
+#define MB_INDEX_BATCH			8
+
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
@@ -9,6 +9,7 @@
 #include <linux/f2fs_fs.h>
 #include <linux/writeback.h>
 #include <linux/backing-dev.h>
+#include <linux/pagevec.h>
 #include <linux/lzo.h>
 #include <linux/lz4.h>
 #include <linux/zstd.h>
@@ -655,23 +656,135 @@ static int f2fs_compress_pages(struct compress_ctx *cc)
 	return ret;
 }
 
-void f2fs_decompress_pages(struct bio *bio, struct page *page, bool verity)
+static bool f2fs_compress_cache_enabled(struct inode *inode)
+{
+	/* cpages hold decrypted data, and verity needs the bio */
+	return F2FS_I_SB(inode)->compress_cache_pages &&
+		!f2fs_encrypted_file(inode) && !fsverity_active(inode);
+}
+
+/*
+ * Keep the compressed pages of a cluster read from disk in the meta mapping,
+ * indexed by block address like the pages GC moves.  Blocks are dropped from
+ * there whenever they are invalidated or reallocated.  The pages are tagged
+ * COMPRESS_CACHED_PAGE, so that compress_cache_cnt counts them apart from the
+ * checkpoint, NAT, SIT and SSA pages sharing the mapping.
+ *
+ * A block freed while the cluster was read may already belong to someone
+ * else, so nothing is cached if compress_cache_seq moved since the block
+ * addresses were looked up.  Pages cached before a free that races with us
+ * are dropped again here, or by the free's own invalidation otherwise.
+ */
+static void f2fs_cache_compressed_pages(struct decompress_io_ctx *dic)
 {
-	struct decompress_io_ctx *dic =
-			(struct decompress_io_ctx *)page_private(page);
 	struct f2fs_sb_info *sbi = F2FS_I_SB(dic->inode);
-	struct f2fs_inode_info *fi= F2FS_I(dic->inode);
-	const struct f2fs_compress_ops *cops =
-			f2fs_cops[fi->i_compress_algorithm];
-	int ret;
+	struct address_space *mapping = META_MAPPING(sbi);
+	DECLARE_BITMAP(cached, 1 << MAX_COMPRESS_LOG_SIZE);
+	struct page *page;
+	int i;
 
-	dec_page_count(sbi, F2FS_RD_DATA);
+	bitmap_zero(cached, dic->nr_cpages);
+	for (i = 0; i < dic->nr_cpages; i++) {
+		if (atomic_read(&sbi->compress_cache_cnt) >=
+				READ_ONCE(sbi->compress_cache_pages) ||
+		    atomic_read(&sbi->compress_cache_seq) != dic->cache_seq)
+			break;
 
-	if (bio->bi_status || PageError(page))
-		dic->failed = true;
+		page = grab_cache_page_nowait(mapping, dic->cblkaddrs[i]);
+		if (!page)
+			continue;
+		if (!PageUptodate(page) && !PagePrivate(page)) {
+			copy_highpage(page, dic->cpages[i]);
+			SetPageUptodate(page);
+			f2fs_set_page_private(page, COMPRESS_CACHED_PAGE);
+			atomic_inc(&sbi->compress_cache_cnt);
+			__set_bit(i, cached);
+		}
+		f2fs_put_page(page, 1);
+	}
 
-	if (refcount_dec_not_one(&dic->ref))
+	/* Pairs with smp_mb__after_atomic() in f2fs_compress_cache_forget() */
+	smp_mb();
+	if (atomic_read(&sbi->compress_cache_seq) == dic->cache_seq)
 		return;
+	for_each_set_bit(i, cached, dic->nr_cpages)
+		invalidate_mapping_pages(mapping, dic->cblkaddrs[i],
+						dic->cblkaddrs[i]);
+}
+
+/* Called by ->invalidatepage and ->releasepage of the meta mapping */
+void f2fs_uncache_compressed_page(struct page *page)
+{
+	if (IS_COMPRESS_CACHED_PAGE(page))
+		atomic_dec(&F2FS_P_SB(page)->compress_cache_cnt);
+}
+
+/*
+ * Drop cached compressed pages until there are no more than
+ * compress_cache_pages of them, after the limit was lowered.
+ */
+void f2fs_shrink_compress_cache(struct f2fs_sb_info *sbi)
+{
+	struct address_space *mapping = META_MAPPING(sbi);
+	pgoff_t index = 0, cached[PAGEVEC_SIZE];
+	struct pagevec pvec;
+	int i, nr;
+
+	pagevec_init(&pvec);
+	while (atomic_read(&sbi->compress_cache_cnt) >
+				READ_ONCE(sbi->compress_cache_pages) &&
+			pagevec_lookup(&pvec, mapping, &index)) {
+		nr = 0;
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			if (IS_COMPRESS_CACHED_PAGE(pvec.pages[i]))
+				cached[nr++] = pvec.pages[i]->index;
+		}
+		/* our references would keep the pages from being dropped */
+		pagevec_release(&pvec);
+
+		for (i = 0; i < nr; i++) {
+			if (atomic_read(&sbi->compress_cache_cnt) <=
+					READ_ONCE(sbi->compress_cache_pages))
+				break;
+			invalidate_mapping_pages(mapping, cached[i], cached[i]);
+		}
+		cond_resched();
+	}
+}
+
+/*
+ * Finish the page cache pages f2fs_alloc_dic() added for holes in the
+ * cluster, so that later reads of them don't decompress the cluster again.
+ */
+static void f2fs_put_sibling_pages(struct decompress_io_ctx *dic,
+							bool uptodate)
+{
+	unsigned int nr = 0;
+	int i;
+
+	for_each_set_bit(i, dic->sibling_map, dic->cluster_size) {
+		struct page *page = dic->tpages[i];
+
+		if (uptodate) {
+			SetPageUptodate(page);
+			nr++;
+		}
+		unlock_page(page);
+		put_page(page);
+		dic->tpages[i] = NULL;
+	}
+	bitmap_zero(dic->sibling_map, dic->cluster_size);
+
+	stat_add_decompr_sibling(F2FS_I_SB(dic->inode), nr);
+}
+
+static void __f2fs_decompress_cluster(struct decompress_io_ctx *dic,
+							bool verity)
+{
+	struct f2fs_inode_info *fi = F2FS_I(dic->inode);
+	const struct f2fs_compress_ops *cops =
+			f2fs_cops[fi->i_compress_algorithm];
+	int ret;
 
 	trace_f2fs_decompress_pages_start(dic->inode, dic->cluster_idx,
 				dic->cluster_size, fi->i_compress_algorithm);
@@ -709,6 +822,11 @@ void f2fs_decompress_pages(struct bio *bio, struct page *page, bool verity)
 	}
 
 	ret = cops->decompress_pages(dic);
+	if (!ret) {
+		f2fs_put_sibling_pages(dic, true);
+		if (dic->cblkaddrs && !dic->cache_hit)
+			f2fs_cache_compressed_pages(dic);
+	}
 
 out_vunmap_cbuf:
 	vunmap(dic->cbuf);
@@ -730,6 +848,75 @@ void f2fs_decompress_pages(struct bio *bio, struct page *page, bool verity)
 		f2fs_free_dic(dic);
 }
 
+void f2fs_decompress_pages(struct bio *bio, struct page *page, bool verity)
+{
+	struct decompress_io_ctx *dic =
+			(struct decompress_io_ctx *)page_private(page);
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dic->inode);
+
+	dec_page_count(sbi, F2FS_RD_DATA);
+
+	if (bio->bi_status || PageError(page))
+		dic->failed = true;
+
+	if (refcount_dec_not_one(&dic->ref))
+		return;
+
+	__f2fs_decompress_cluster(dic, verity);
+}
+
+/*
+ * Fill the compressed pages of @dic from the compressed page cache and
+ * decompress the cluster right away.  Returns false if a page is missing; the
+ * cluster is then read from disk and cached once it is decompressed.
+ */
+bool f2fs_load_compressed_cluster(struct decompress_io_ctx *dic,
+						struct dnode_of_data *dn)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dic->inode);
+	struct page *page;
+	int i;
+
+	if (!f2fs_compress_cache_enabled(dic->inode))
+		return false;
+
+	dic->cblkaddrs = f2fs_kzalloc(sbi, sizeof(block_t) * dic->nr_cpages,
+							GFP_NOFS);
+	if (!dic->cblkaddrs)
+		return false;
+
+	/* frees from now on keep the cluster out of the cache */
+	dic->cache_seq = atomic_read(&sbi->compress_cache_seq);
+	smp_rmb();
+
+	for (i = 0; i < dic->nr_cpages; i++)
+		dic->cblkaddrs[i] = data_blkaddr(dn->inode, dn->node_page,
+						dn->ofs_in_node + i + 1);
+
+	/* GC and encrypted block migration leave their own pages there */
+	for (i = 0; i < dic->nr_cpages; i++) {
+		page = find_lock_page(META_MAPPING(sbi), dic->cblkaddrs[i]);
+		if (!page)
+			break;
+		if (!PageUptodate(page) || !IS_COMPRESS_CACHED_PAGE(page)) {
+			f2fs_put_page(page, 1);
+			break;
+		}
+		copy_highpage(dic->cpages[i], page);
+		f2fs_put_page(page, 1);
+	}
+
+	if (i < dic->nr_cpages) {
+		stat_inc_compr_cache_miss(sbi);
+		return false;
+	}
+
+	stat_inc_compr_cache_hit(sbi);
+	dic->cache_hit = true;
+	__f2fs_decompress_cluster(dic, false);
+	return true;
+}
+
 static bool is_page_in_cluster(struct compress_ctx *cc, pgoff_t index)
 {
 	if (cc->cluster_idx == NULL_CLUSTER)
@@ -1332,7 +1519,11 @@ static int f2fs_write_raw_pages(struct compress_ctx *cc,
 	return err;
 }
 
-int f2fs_write_multi_pages(struct compress_ctx *cc,
+/*
+ * Write the cluster in @cc, given the result of compressing it: 0 if cc->cpages
+ * hold the compressed data, -EAGAIN to write the raw pages.
+ */
+static int __f2fs_write_multi_pages(struct compress_ctx *cc, int compress_err,
 					int *submitted,
 					struct writeback_control *wbc,
 					enum iostat_type io_type)
@@ -1340,25 +1531,21 @@ int f2fs_write_multi_pages(struct compress_ctx *cc,
 	struct f2fs_inode_info *fi = F2FS_I(cc->inode);
 	const struct f2fs_compress_ops *cops =
 			f2fs_cops[fi->i_compress_algorithm];
-	int err;
+	int err = compress_err;
 
 	*submitted = 0;
-	if (cluster_may_compress(cc)) {
-		err = f2fs_compress_pages(cc);
-		if (err == -EAGAIN) {
-			goto write;
-		} else if (err) {
-			f2fs_put_rpages_wbc(cc, wbc, true, 1);
-			goto destroy_out;
-		}
-
-		err = f2fs_write_compressed_pages(cc, submitted,
-							wbc, io_type);
-		cops->destroy_compress_ctx(cc);
-		if (!err)
-			return 0;
-		f2fs_bug_on(F2FS_I_SB(cc->inode), err != -EAGAIN);
+	if (err == -EAGAIN) {
+		goto write;
+	} else if (err) {
+		f2fs_put_rpages_wbc(cc, wbc, true, 1);
+		goto destroy_out;
 	}
+
+	err = f2fs_write_compressed_pages(cc, submitted, wbc, io_type);
+	cops->destroy_compress_ctx(cc);
+	if (!err)
+		return 0;
+	f2fs_bug_on(F2FS_I_SB(cc->inode), err != -EAGAIN);
 write:
 	f2fs_bug_on(F2FS_I_SB(cc->inode), *submitted);
 
@@ -1369,6 +1556,177 @@ int f2fs_write_multi_pages(struct compress_ctx *cc,
 	return err;
 }
 
+int f2fs_write_multi_pages(struct compress_ctx *cc,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	int err = -EAGAIN;
+
+	if (cluster_may_compress(cc))
+		err = f2fs_compress_pages(cc);
+
+	return __f2fs_write_multi_pages(cc, err, submitted, wbc, io_type);
+}
+
+static void f2fs_compress_work(struct work_struct *work)
+{
+	struct compress_work *cw = container_of(work, struct compress_work,
+						work);
+
+	cw->err = f2fs_compress_pages(&cw->cc);
+}
+
+/*
+ * Writeback of a compressed file hands each cluster to a batch, which
+ * compresses it on sbi->compress_wq right away.  The clusters are written in
+ * file order once the batch is full, so block allocation and bio merging
+ * stay the same as with inline compression.
+ *
+ * Returns NULL if clusters should be compressed inline.
+ */
+struct compress_batch *f2fs_alloc_compress_batch(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int max_ccs = READ_ONCE(sbi->compress_batch_clusters);
+	struct compress_batch *batch;
+	int i;
+
+	/*
+	 * Compressed pages of a batch are only freed once it is written, keep
+	 * them to a fraction of the mempool the workers may have to wait on.
+	 */
+	max_ccs = min_t(unsigned int, max_ccs, num_compress_pages /
+				(4 * F2FS_I(inode)->i_cluster_size));
+	/* reclaim should not wait on clusters queued behind others */
+	if (!sbi->compress_wq || max_ccs <= 1 ||
+			(current->flags & PF_MEMALLOC))
+		return NULL;
+
+	batch = f2fs_kzalloc(sbi, struct_size(batch, works, max_ccs),
+							GFP_NOFS);
+	if (!batch)
+		return NULL;
+
+	batch->sbi = sbi;
+	batch->max_ccs = max_ccs;
+	for (i = 0; i < max_ccs; i++)
+		INIT_WORK(&batch->works[i].work, f2fs_compress_work);
+	return batch;
+}
+
+void f2fs_free_compress_batch(struct compress_batch *batch)
+{
+	if (!batch)
+		return;
+	f2fs_bug_on(batch->sbi, batch->nr_ccs);
+	kfree(batch);
+}
+
+/* Write all clusters of @batch in the order they were added */
+int f2fs_flush_compress_batch(struct compress_batch *batch, int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct compress_work *cw;
+	int _submitted, ret, err = 0;
+	int i;
+
+	*submitted = 0;
+	for (i = 0; i < batch->nr_ccs; i++) {
+		cw = &batch->works[i];
+		flush_work(&cw->work);
+
+		ret = __f2fs_write_multi_pages(&cw->cc, cw->err, &_submitted,
+							wbc, io_type);
+		*submitted += _submitted;
+		if (ret && !err)
+			err = ret;
+	}
+	batch->nr_ccs = 0;
+	return err;
+}
+
+/*
+ * Move the cluster in @cc to @batch and start compressing it.  @cc is left
+ * empty for the next cluster.  Writes the batch once it is full.
+ */
+int f2fs_compress_batch_add(struct compress_batch *batch,
+					struct compress_ctx *cc,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct compress_work *cw = &batch->works[batch->nr_ccs++];
+
+	cw->cc = *cc;
+	cc->rpages = NULL;
+	cc->nr_rpages = 0;
+	cc->cpages = NULL;
+	cc->nr_cpages = 0;
+	cc->cluster_idx = NULL_CLUSTER;
+
+	if (cluster_may_compress(&cw->cc))
+		queue_work(batch->sbi->compress_wq, &cw->work);
+	else
+		cw->err = -EAGAIN;
+
+	*submitted = 0;
+	if (batch->nr_ccs < batch->max_ccs)
+		return 0;
+	return f2fs_flush_compress_batch(batch, submitted, wbc, io_type);
+}
+
+int f2fs_init_compress_wq(struct f2fs_sb_info *sbi)
+{
+	if (!f2fs_sb_has_compression(sbi))
+		return 0;
+
+	sbi->compress_batch_clusters = min_t(unsigned int, num_online_cpus(),
+						F2FS_MAX_COMPRESS_BATCH);
+	/* flushed from writeback, which runs on the WQ_MEM_RECLAIM bdi_wq */
+	sbi->compress_wq = alloc_workqueue("f2fs_compress-%s",
+					WQ_UNBOUND | WQ_MEM_RECLAIM, 0,
+					sbi->sb->s_id);
+	if (!sbi->compress_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi)
+{
+	if (sbi->compress_wq)
+		destroy_workqueue(sbi->compress_wq);
+}
+
+/*
+ * Add a locked page cache page for @index to decompress into, if it is not
+ * cached yet.  This is opportunistic, so it fails rather than waits.
+ */
+static struct page *f2fs_grab_sibling_page(struct inode *inode, pgoff_t index)
+{
+	struct address_space *mapping = inode->i_mapping;
+	gfp_t gfp = readahead_gfp_mask(mapping);
+	struct page *page;
+
+	/* fs-verity checks pages against the bio they were read by */
+	if (fsverity_active(inode))
+		return NULL;
+
+	if (index >= DIV_ROUND_UP(i_size_read(inode), PAGE_SIZE))
+		return NULL;
+
+	page = __page_cache_alloc(gfp);
+	if (!page)
+		return NULL;
+
+	if (add_to_page_cache_lru(page, mapping, index, gfp)) {
+		put_page(page);
+		return NULL;
+	}
+	return page;
+}
+
 struct decompress_io_ctx *f2fs_alloc_dic(struct compress_ctx *cc)
 {
 	struct f2fs_sb_info *sbi = F2FS_I_SB(cc->inode);
@@ -1428,11 +1786,19 @@ struct decompress_io_ctx *f2fs_alloc_dic(struct compress_ctx *cc)
 			continue;
 		}
 
+		dic->tpages[i] = f2fs_grab_sibling_page(cc->inode,
+							start_idx + i);
+		if (dic->tpages[i]) {
+			__set_bit(i, dic->sibling_map);
+			continue;
+		}
+
 		dic->tpages[i] = f2fs_compress_alloc_page();
 		if (!dic->tpages[i])
 			goto out_free;
 	}
 
+	stat_inc_decompr_cluster(sbi, cc->nr_rpages);
 	return dic;
 
 out_free:
@@ -1445,6 +1811,9 @@ void f2fs_free_dic(struct decompress_io_ctx *dic)
 	int i;
 
 	if (dic->tpages) {
+		/* the cluster could not be decompressed */
+		f2fs_put_sibling_pages(dic, false);
+
 		for (i = 0; i < dic->cluster_size; i++) {
 			if (dic->rpages[i])
 				continue;
@@ -1464,6 +1833,7 @@ void f2fs_free_dic(struct decompress_io_ctx *dic)
 		kfree(dic->cpages);
 	}
 
+	kfree(dic->cblkaddrs);
 	kfree(dic->rpages);
 	kfree(dic);
 }
@@ -2246,6 +2246,13 @@ int f2fs_read_multi_pages(struct compress_ctx *cc, struct bio **bio_ret,
 		goto out_put_dnode;
 	}
 
+	/* all compressed pages are cached, the cluster is decompressed */
+	if (f2fs_load_compressed_cluster(dic, &dn)) {
+		f2fs_put_dnode(&dn);
+		*bio_ret = bio;
+		return 0;
+	}
+
 	for (i = 0; i < dic->nr_cpages; i++) {
 		struct page *page = dic->cpages[i];
 		block_t blkaddr;
@@ -2918,6 +2925,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 		.rlen = PAGE_SIZE * F2FS_I(inode)->i_cluster_size,
 		.private = NULL,
 	};
+	struct compress_batch *batch = NULL;
 #endif
 	int nr_pages;
 	pgoff_t uninitialized_var(writeback_index);
@@ -2932,6 +2940,11 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 
 	pagevec_init(&pvec);
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	if (f2fs_compressed_file(inode))
+		batch = f2fs_alloc_compress_batch(inode);
+#endif
+
 	if (get_dirty_pages(mapping->host) <=
 				SM_I(F2FS_M_SB(mapping))->min_hot_blocks)
 		set_inode_flag(mapping->host, FI_HOT_DATA);
@@ -2978,8 +2991,13 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 
 				if (!f2fs_cluster_can_merge_page(&cc,
 								page->index)) {
-					ret = f2fs_write_multi_pages(&cc,
-						&submitted, wbc, io_type);
+					if (batch)
+						ret = f2fs_compress_batch_add(batch,
+							&cc, &submitted, wbc,
+							io_type);
+					else
+						ret = f2fs_write_multi_pages(&cc,
+							&submitted, wbc, io_type);
 					if (!ret)
 						need_readd = true;
 					goto result;
@@ -3102,7 +3120,22 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 #ifdef CONFIG_F2FS_FS_COMPRESSION
 	/* flush remained pages in compress cluster */
 	if (f2fs_compressed_file(inode) && !f2fs_cluster_is_empty(&cc)) {
-		ret = f2fs_write_multi_pages(&cc, &submitted, wbc, io_type);
+		if (batch)
+			ret = f2fs_compress_batch_add(batch, &cc, &submitted,
+							wbc, io_type);
+		else
+			ret = f2fs_write_multi_pages(&cc, &submitted,
+							wbc, io_type);
+		nwritten += submitted;
+		wbc->nr_to_write -= submitted;
+		if (ret) {
+			done = 1;
+			retry = 0;
+		}
+	}
+	/* and the clusters still being compressed */
+	if (batch && batch->nr_ccs) {
+		ret = f2fs_flush_compress_batch(batch, &submitted, wbc, io_type);
 		nwritten += submitted;
 		wbc->nr_to_write -= submitted;
 		if (ret) {
@@ -3128,6 +3161,9 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 	if (bio)
 		f2fs_submit_merged_ipu_write(sbi, &bio, NULL);
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	f2fs_free_compress_batch(batch);
+#endif
 	return ret;
 }
 
@@ -3727,6 +3763,7 @@ void f2fs_invalidate_page(struct page *page, unsigned int offset,
 	if (IS_ATOMIC_WRITTEN_PAGE(page))
 		return f2fs_drop_inmem_page(inode, page);
 
+	f2fs_uncache_compressed_page(page);
 	f2fs_clear_page_private(page);
 }
 
@@ -3741,6 +3778,7 @@ int f2fs_release_page(struct page *page, gfp_t wait)
 		return 0;
 
 	clear_cold_data(page);
+	f2fs_uncache_compressed_page(page);
 	f2fs_clear_page_private(page);
 	return 1;
 }
@@ -132,6 +132,11 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->inline_dir = atomic_read(&sbi->inline_dir);
 	si->compr_inode = atomic_read(&sbi->compr_inode);
 	si->compr_blocks = atomic_read(&sbi->compr_blocks);
+	si->decompr_cluster = atomic64_read(&sbi->decompr_cluster);
+	si->decompr_rpages = atomic64_read(&sbi->decompr_rpages);
+	si->decompr_sibling = atomic64_read(&sbi->decompr_sibling);
+	si->compr_cache_hit = atomic64_read(&sbi->compr_cache_hit);
+	si->compr_cache_miss = atomic64_read(&sbi->compr_cache_miss);
 	si->append = sbi->im[APPEND_INO].ino_num;
 	si->update = sbi->im[UPDATE_INO].ino_num;
 	si->orphans = sbi->im[ORPHAN_INO].ino_num;
@@ -325,6 +330,16 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->inline_dir);
 		seq_printf(s, "  - Compressed Inode: %u, Blocks: %u\n",
 			   si->compr_inode, si->compr_blocks);
+		seq_printf(s, "  - Decompressed Cluster: %llu, Read Pages: %llu, "
+			   "Sibling Pages: %llu\n",
+			   si->decompr_cluster, si->decompr_rpages,
+			   si->decompr_sibling);
+		if (si->decompr_rpages)
+			seq_printf(s, "  - Decompressions per 100 Read Pages: "
+				   "%llu\n", div64_u64(si->decompr_cluster * 100,
+						si->decompr_rpages));
+		seq_printf(s, "  - Compressed Page Cache: hit %llu, miss %llu\n",
+			   si->compr_cache_hit, si->compr_cache_miss);
 		seq_printf(s, "  - Orphan/Append/Update Inode: %u, %u, %u\n",
 			   si->orphans, si->append, si->update);
 		seq_printf(s, "\nMain area: %d segs, %d secs %d zones\n",
@@ -504,6 +519,11 @@ int f2fs_build_stats(struct f2fs_sb_info *sbi)
 	atomic_set(&sbi->inline_dir, 0);
 	atomic_set(&sbi->compr_inode, 0);
 	atomic_set(&sbi->compr_blocks, 0);
+	atomic64_set(&sbi->decompr_cluster, 0);
+	atomic64_set(&sbi->decompr_rpages, 0);
+	atomic64_set(&sbi->decompr_sibling, 0);
+	atomic64_set(&sbi->compr_cache_hit, 0);
+	atomic64_set(&sbi->compr_cache_miss, 0);
 	atomic_set(&sbi->inplace_count, 0);
 	for (i = META_CP; i < META_MAX; i++)
 		atomic_set(&sbi->meta_count[i], 0);
@@ -1318,11 +1318,15 @@ enum fsync_mode {
  */
 #define ATOMIC_WRITTEN_PAGE		((unsigned long)-1)
 #define DUMMY_WRITTEN_PAGE		((unsigned long)-2)
+/* a compressed page kept in the meta mapping, see compress_cache_cnt */
+#define COMPRESS_CACHED_PAGE		((unsigned long)-3)
 
 #define IS_ATOMIC_WRITTEN_PAGE(page)			\
 		(page_private(page) == (unsigned long)ATOMIC_WRITTEN_PAGE)
 #define IS_DUMMY_WRITTEN_PAGE(page)			\
 		(page_private(page) == (unsigned long)DUMMY_WRITTEN_PAGE)
+#define IS_COMPRESS_CACHED_PAGE(page)			\
+		(page_private(page) == (unsigned long)COMPRESS_CACHED_PAGE)
 
 #ifdef CONFIG_FS_ENCRYPTION
 #define DUMMY_ENCRYPTION_ENABLED(sbi) \
@@ -1351,6 +1355,11 @@ struct compress_data {
 
 #define F2FS_COMPRESSED_PAGE_MAGIC	0xF5F2C000
 
+#define NULL_CLUSTER			((unsigned int)(~0))
+#define MIN_COMPRESS_LOG_SIZE		2
+#define MAX_COMPRESS_LOG_SIZE		8
+#define MAX_COMPRESS_WINDOW_SIZE	((PAGE_SIZE) << MAX_COMPRESS_LOG_SIZE)
+
 /* compress context */
 struct compress_ctx {
 	struct inode *inode;		/* inode the context belong to */
@@ -1378,6 +1387,24 @@ struct compress_io_ctx {
 	refcount_t ref;			/* referrence count of raw page */
 };
 
+/* max clusters of one writeback pass being compressed in parallel */
+#define F2FS_MAX_COMPRESS_BATCH		16
+
+/* compress work for one cluster of a batch */
+struct compress_work {
+	struct work_struct work;
+	struct compress_ctx cc;		/* cluster owned by the batch */
+	int err;			/* result of compressing the cluster */
+};
+
+/* clusters compressed in parallel and written in file order */
+struct compress_batch {
+	struct f2fs_sb_info *sbi;
+	unsigned int nr_ccs;		/* clusters in works */
+	unsigned int max_ccs;		/* clusters before the batch is written */
+	struct compress_work works[];
+};
+
 /* decompress io context for read IO path */
 struct decompress_io_ctx {
 	u32 magic;			/* magic number to indicate page is compressed */
@@ -1390,21 +1417,21 @@ struct decompress_io_ctx {
 	struct page **cpages;		/* pages store compressed data in cluster */
 	unsigned int nr_cpages;		/* total page number in cpages */
 	struct page **tpages;		/* temp pages to pad holes in cluster */
+	/* holes in tpages filled with page cache pages of the file */
+	DECLARE_BITMAP(sibling_map, 1 << MAX_COMPRESS_LOG_SIZE);
+	block_t *cblkaddrs;		/* block addresses of cpages, for caching */
 	void *rbuf;			/* virtual mapped address on rpages */
 	struct compress_data *cbuf;	/* virtual mapped address on cpages */
 	size_t rlen;			/* valid data length in rbuf */
 	size_t clen;			/* valid data length in cbuf */
 	refcount_t ref;			/* referrence count of compressed page */
 	bool failed;			/* indicate IO error during decompression */
+	bool cache_hit;			/* cpages came from the compressed page cache */
+	int cache_seq;			/* compress_cache_seq at block lookup */
 	void *private;			/* payload buffer for specified decompression algorithm */
 	void *private2;			/* extra payload buffer */
 };
 
-#define NULL_CLUSTER			((unsigned int)(~0))
-#define MIN_COMPRESS_LOG_SIZE		2
-#define MAX_COMPRESS_LOG_SIZE		8
-#define MAX_COMPRESS_WINDOW_SIZE	((PAGE_SIZE) << MAX_COMPRESS_LOG_SIZE)
-
 struct f2fs_sb_info {
 	struct super_block *sb;			/* pointer to VFS super block */
 	struct proc_dir_entry *s_proc;		/* proc entry */
@@ -1556,6 +1583,11 @@ struct f2fs_sb_info {
 	atomic_t inline_dir;			/* # of inline_dentry inodes */
 	atomic_t compr_inode;			/* # of compressed inodes */
 	atomic_t compr_blocks;			/* # of compressed blocks */
+	atomic64_t decompr_cluster;		/* # of decompressed clusters */
+	atomic64_t decompr_rpages;		/* # of pages read by decompression */
+	atomic64_t decompr_sibling;		/* # of sibling pages cached */
+	atomic64_t compr_cache_hit;		/* # of clusters hit in cpage cache */
+	atomic64_t compr_cache_miss;		/* # of clusters missed in cpage cache */
 	atomic_t vw_cnt;			/* # of volatile writes */
 	atomic_t max_aw_cnt;			/* max # of atomic writes */
 	atomic_t max_vw_cnt;			/* max # of volatile writes */
@@ -1602,6 +1634,14 @@ struct f2fs_sb_info {
 
 	struct workqueue_struct *post_read_wq;	/* post read workqueue */
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	struct workqueue_struct *compress_wq;	/* cluster compression workqueue */
+	unsigned int compress_batch_clusters;	/* clusters compressed in parallel */
+	unsigned int compress_cache_pages;	/* max meta pages to cache cpages */
+	atomic_t compress_cache_cnt;		/* # of cpages cached in meta pages */
+	atomic_t compress_cache_seq;		/* bumped when a block is freed */
+#endif
+
 	struct kmem_cache *inline_xattr_slab;	/* inline xattr entry */
 	unsigned int inline_xattr_slab_size;	/* default inline xattr slab size */
 };
@@ -3540,6 +3580,8 @@ struct f2fs_stat_info {
 	unsigned int undiscard_blks;
 	int inline_xattr, inline_inode, inline_dir, append, update, orphans;
 	int compr_inode, compr_blocks;
+	unsigned long long decompr_cluster, decompr_rpages, decompr_sibling;
+	unsigned long long compr_cache_hit, compr_cache_miss;
 	int aw_cnt, max_aw_cnt, vw_cnt, max_vw_cnt;
 	unsigned int valid_count, valid_node_count, valid_inode_count, discard_blks;
 	unsigned int bimodal, avg_vblocks;
@@ -3624,6 +3666,17 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 		(atomic_add(blocks, &F2FS_I_SB(inode)->compr_blocks))
 #define stat_sub_compr_blocks(inode, blocks)				\
 		(atomic_sub(blocks, &F2FS_I_SB(inode)->compr_blocks))
+#define stat_inc_decompr_cluster(sbi, rpages)				\
+	do {								\
+		atomic64_inc(&(sbi)->decompr_cluster);			\
+		atomic64_add(rpages, &(sbi)->decompr_rpages);		\
+	} while (0)
+#define stat_add_decompr_sibling(sbi, pages)				\
+		(atomic64_add(pages, &(sbi)->decompr_sibling))
+#define stat_inc_compr_cache_hit(sbi)					\
+		(atomic64_inc(&(sbi)->compr_cache_hit))
+#define stat_inc_compr_cache_miss(sbi)					\
+		(atomic64_inc(&(sbi)->compr_cache_miss))
 #define stat_inc_meta_count(sbi, blkaddr)				\
 	do {								\
 		if (blkaddr < SIT_I(sbi)->sit_base_addr)		\
@@ -3719,6 +3772,10 @@ void f2fs_update_sit_info(struct f2fs_sb_info *sbi);
 #define stat_dec_compr_inode(inode)			do { } while (0)
 #define stat_add_compr_blocks(inode, blocks)		do { } while (0)
 #define stat_sub_compr_blocks(inode, blocks)		do { } while (0)
+#define stat_inc_decompr_cluster(sbi, rpages)		do { } while (0)
+#define stat_add_decompr_sibling(sbi, pages)		do { } while (0)
+#define stat_inc_compr_cache_hit(sbi)			do { } while (0)
+#define stat_inc_compr_cache_miss(sbi)			do { } while (0)
 #define stat_inc_atomic_write(inode)			do { } while (0)
 #define stat_dec_atomic_write(inode)			do { } while (0)
 #define stat_update_max_atomic_write(inode)		do { } while (0)
@@ -3884,12 +3941,36 @@ int f2fs_write_multi_pages(struct compress_ctx *cc,
 						int *submitted,
 						struct writeback_control *wbc,
 						enum iostat_type io_type);
+struct compress_batch *f2fs_alloc_compress_batch(struct inode *inode);
+void f2fs_free_compress_batch(struct compress_batch *batch);
+int f2fs_compress_batch_add(struct compress_batch *batch,
+						struct compress_ctx *cc,
+						int *submitted,
+						struct writeback_control *wbc,
+						enum iostat_type io_type);
+int f2fs_flush_compress_batch(struct compress_batch *batch,
+						int *submitted,
+						struct writeback_control *wbc,
+						enum iostat_type io_type);
+int f2fs_init_compress_wq(struct f2fs_sb_info *sbi);
+void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi);
 int f2fs_is_compressed_cluster(struct inode *inode, pgoff_t index);
 int f2fs_read_multi_pages(struct compress_ctx *cc, struct bio **bio_ret,
 				unsigned nr_pages, sector_t *last_block_in_bio,
 				bool is_readahead, bool for_write);
 struct decompress_io_ctx *f2fs_alloc_dic(struct compress_ctx *cc);
 void f2fs_free_dic(struct decompress_io_ctx *dic);
+bool f2fs_load_compressed_cluster(struct decompress_io_ctx *dic,
+						struct dnode_of_data *dn);
+void f2fs_uncache_compressed_page(struct page *page);
+void f2fs_shrink_compress_cache(struct f2fs_sb_info *sbi);
+
+/* A block is freed, reads in flight must not cache what they read from it */
+static inline void f2fs_compress_cache_forget(struct f2fs_sb_info *sbi)
+{
+	atomic_inc(&sbi->compress_cache_seq);
+	smp_mb__after_atomic();
+}
 void f2fs_decompress_end_io(struct page **rpages,
 			unsigned int cluster_size, bool err, bool verity);
 int f2fs_init_compress_ctx(struct compress_ctx *cc);
@@ -3911,6 +3992,10 @@ static inline struct page *f2fs_compress_control_page(struct page *page)
 }
 static inline int f2fs_init_compress_mempool(void) { return 0; }
 static inline void f2fs_destroy_compress_mempool(void) { }
+static inline int f2fs_init_compress_wq(struct f2fs_sb_info *sbi) { return 0; }
+static inline void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi) { }
+static inline void f2fs_uncache_compressed_page(struct page *page) { }
+static inline void f2fs_compress_cache_forget(struct f2fs_sb_info *sbi) { }
 #endif
 
 static inline void set_compress_context(struct inode *inode)
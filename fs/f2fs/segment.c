@@ -2180,6 +2180,9 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 				se->ckpt_valid_blocks++;
 		}
 	} else {
+		/* see f2fs_cache_compressed_pages() */
+		f2fs_compress_cache_forget(sbi);
+
 		exist = f2fs_test_and_clear_bit(offset, se->cur_valid_map);
 #ifdef CONFIG_F2FS_CHECK_FS
 		mir_exist = f2fs_test_and_clear_bit(offset,
@@ -3149,6 +3152,11 @@ void f2fs_allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 	if (GET_SEGNO(sbi, old_blkaddr) != NULL_SEGNO)
 		update_sit_entry(sbi, old_blkaddr, -1);
 
+	/* drop a compressed page cached by a read racing with the last free */
+	if (f2fs_sb_has_compression(sbi))
+		invalidate_mapping_pages(META_MAPPING(sbi),
+					*new_blkaddr, *new_blkaddr);
+
 	if (!__has_curseg_space(sbi, type))
 		sit_i->s_ops->allocate_segment(sbi, type, false);
 
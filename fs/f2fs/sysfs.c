@@ -351,6 +351,19 @@ static ssize_t __sbi_store(struct f2fs_attr *a,
 	if (!strcmp(a->attr.name, "trim_sections"))
 		return -EINVAL;
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	if (!strcmp(a->attr.name, "compress_batch_clusters")) {
+		if (t > F2FS_MAX_COMPRESS_BATCH)
+			return -EINVAL;
+	}
+
+	if (!strcmp(a->attr.name, "compress_cache_pages")) {
+		*ui = (unsigned int)t;
+		f2fs_shrink_compress_cache(sbi);
+		return count;
+	}
+#endif
+
 	if (!strcmp(a->attr.name, "gc_urgent")) {
 		if (t >= 1) {
 			sbi->gc_mode = GC_URGENT;
@@ -559,6 +572,12 @@ F2FS_RW_ATTR(FAULT_INFO_TYPE, f2fs_fault_info, inject_type, inject_type);
 #endif
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, data_io_flag, data_io_flag);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, node_io_flag, node_io_flag);
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, compress_batch_clusters,
+					compress_batch_clusters);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, compress_cache_pages,
+					compress_cache_pages);
+#endif
 F2FS_GENERAL_RO_ATTR(dirty_segments);
 F2FS_GENERAL_RO_ATTR(free_segments);
 F2FS_GENERAL_RO_ATTR(lifetime_write_kbytes);
@@ -644,6 +663,10 @@ static struct attribute *f2fs_attrs[] = {
 #endif
 	ATTR_LIST(data_io_flag),
 	ATTR_LIST(node_io_flag),
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	ATTR_LIST(compress_batch_clusters),
+	ATTR_LIST(compress_cache_pages),
+#endif
 	ATTR_LIST(dirty_segments),
 	ATTR_LIST(free_segments),
 	ATTR_LIST(unusable),
@@ -948,6 +971,10 @@ int f2fs_register_sysfs(struct f2fs_sb_info *sbi)
 				iostat_info_seq_show, sb);
 		proc_create_single_data("victim_bits", S_IRUGO, sbi->s_proc,
 				victim_bits_seq_show, sb);
+		if (IS_ENABLED(CONFIG_FS_VERITY))
+			proc_create_single_data("verity_stats", S_IRUGO,
+					sbi->s_proc, fsverity_seq_stats_show,
+					sb);
 	}
 	return 0;
 }
@@ -959,6 +986,8 @@ void f2fs_unregister_sysfs(struct f2fs_sb_info *sbi)
 		remove_proc_entry("segment_info", sbi->s_proc);
 		remove_proc_entry("segment_bits", sbi->s_proc);
 		remove_proc_entry("victim_bits", sbi->s_proc);
+		if (IS_ENABLED(CONFIG_FS_VERITY))
+			remove_proc_entry("verity_stats", sbi->s_proc);
 		remove_proc_entry(sbi->sb->s_id, f2fs_proc_root);
 	}
 	kobject_del(&sbi->s_kobj);
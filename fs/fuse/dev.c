@@ -190,8 +190,7 @@ EXPORT_SYMBOL_GPL(fuse_len_args);
 
 u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	fiq->reqctr += FUSE_REQ_ID_STEP;
-	return fiq->reqctr;
+	return atomic64_add_return(FUSE_REQ_ID_STEP, &fiq->reqctr);
 }
 EXPORT_SYMBOL_GPL(fuse_get_unique);
 
@@ -229,6 +228,47 @@ __releases(fiq->lock)
 	fiq->ops->wake_pending_and_unlock(fiq);
 }
 
+/*
+ * Put @req on the current CPU's queue if a device channel is bound to it.
+ * Returns false if the request should go on fiq->pending instead.
+ *
+ * A channel sleeping on the CPU queue is woken if there is one.  Otherwise
+ * all bound channels of this CPU are busy, so wake a reader on fiq->waitq to
+ * steal the request.
+ */
+static bool queue_request_cpu(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	struct fuse_cpu_queue __percpu *queues;
+	struct fuse_cpu_queue *cq;
+
+	/* Pairs with smp_store_release() in fuse_cpu_queues_get() */
+	queues = smp_load_acquire(&fiq->cpu_queues);
+	if (!queues)
+		return false;
+
+	/* Any queue will do if we get migrated */
+	cq = raw_cpu_ptr(queues);
+	spin_lock(&cq->lock);
+	if (!cq->connected || !cq->nr_chans) {
+		spin_unlock(&cq->lock);
+		return false;
+	}
+	req->in.h.unique = fuse_get_unique(fiq);
+	req->in.h.len = sizeof(struct fuse_in_header) +
+		fuse_len_args(req->args->in_numargs,
+			      (struct fuse_arg *) req->args->in_args);
+	req->cq = cq;
+	list_add_tail(&req->list, &cq->pending);
+	if (wq_has_sleeper(&cq->waitq))
+		wake_up(&cq->waitq);
+	else
+		wake_up(&fiq->waitq);
+	spin_unlock(&cq->lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+
+	return true;
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -259,6 +299,8 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_first_entry(&fc->bg_queue, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
+		if (queue_request_cpu(fiq, req))
+			continue;
 		spin_lock(&fiq->lock);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request_and_unlock(fiq, req);
@@ -357,6 +399,21 @@ static int queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 	return 0;
 }
 
+/* Take @req off the queue it is pending on, if it hasn't been read yet */
+static bool fuse_remove_pending(struct fuse_iqueue *fiq, struct fuse_req *req)
+{
+	spinlock_t *lock = req->cq ? &req->cq->lock : &fiq->lock;
+	bool pending;
+
+	spin_lock(lock);
+	pending = test_bit(FR_PENDING, &req->flags);
+	if (pending)
+		list_del(&req->list);
+	spin_unlock(lock);
+
+	return pending;
+}
+
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
 	struct fuse_iqueue *fiq = &fc->iq;
@@ -383,16 +440,12 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->lock);
 		/* Request is not yet in userspace, bail out */
-		if (test_bit(FR_PENDING, &req->flags)) {
-			list_del(&req->list);
-			spin_unlock(&fiq->lock);
+		if (fuse_remove_pending(fiq, req)) {
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->lock);
 	}
 
 	/*
@@ -407,21 +460,24 @@ static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_iqueue *fiq = &fc->iq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->lock);
-		req->out.h.error = -ENOTCONN;
-	} else {
+	/* acquire extra reference, since request is still needed
+	   after fuse_request_end() */
+	__fuse_get_request(req);
+	if (!queue_request_cpu(fiq, req)) {
+		spin_lock(&fiq->lock);
+		if (!fiq->connected) {
+			spin_unlock(&fiq->lock);
+			__fuse_put_request(req);
+			req->out.h.error = -ENOTCONN;
+			return;
+		}
 		req->in.h.unique = fuse_get_unique(fiq);
-		/* acquire extra reference, since request is still needed
-		   after fuse_request_end() */
-		__fuse_get_request(req);
 		queue_request_and_unlock(fiq, req);
-
-		request_wait_answer(fc, req);
-		/* Pairs with smp_wmb() in fuse_request_end() */
-		smp_rmb();
 	}
+
+	request_wait_answer(fc, req);
+	/* Pairs with smp_wmb() in fuse_request_end() */
+	smp_rmb();
 }
 
 static void fuse_adjust_compat(struct fuse_conn *fc, struct fuse_args *args)
@@ -1020,6 +1076,108 @@ static int request_pending(struct fuse_iqueue *fiq)
 		forget_pending(fiq);
 }
 
+static bool cpu_request_pending(struct fuse_iqueue *fiq)
+{
+	struct fuse_cpu_queue __percpu *queues;
+	int cpu;
+
+	queues = smp_load_acquire(&fiq->cpu_queues);
+	if (!queues)
+		return false;
+
+	for_each_possible_cpu(cpu) {
+		if (!list_empty_careful(&per_cpu_ptr(queues, cpu)->pending))
+			return true;
+	}
+	return false;
+}
+
+static struct fuse_req *dequeue_cpu_request(struct fuse_cpu_queue *cq)
+{
+	struct fuse_req *req = NULL;
+
+	spin_lock(&cq->lock);
+	if (!list_empty(&cq->pending)) {
+		req = list_first_entry(&cq->pending, struct fuse_req, list);
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+	}
+	spin_unlock(&cq->lock);
+
+	return req;
+}
+
+/*
+ * Get the next request from the per-CPU queues: the channel's own queue
+ * first, then steal from the other CPUs' queues.
+ */
+static struct fuse_req *fuse_dev_dequeue_cpu(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = &fud->fc->iq;
+	struct fuse_cpu_queue __percpu *queues;
+	struct fuse_cpu_queue *cq;
+	struct fuse_req *req;
+	int cpu;
+
+	queues = smp_load_acquire(&fiq->cpu_queues);
+	if (!queues)
+		return NULL;
+
+	/* Interrupts and forgets on fiq go first */
+	if (!list_empty_careful(&fiq->interrupts) || forget_pending(fiq))
+		return NULL;
+
+	if (fud->cq) {
+		req = dequeue_cpu_request(fud->cq);
+		if (req)
+			return req;
+	}
+
+	for_each_possible_cpu(cpu) {
+		cq = per_cpu_ptr(queues, cpu);
+		if (cq == fud->cq || list_empty_careful(&cq->pending))
+			continue;
+		req = dequeue_cpu_request(cq);
+		if (req)
+			return req;
+	}
+	return NULL;
+}
+
+/*
+ * Wait for a request on fiq or any per-CPU queue.  A bound channel also waits
+ * on its own queue, so that requests submitted on its CPU wake it first.
+ */
+static int fuse_dev_wait(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = &fud->fc->iq;
+	struct fuse_cpu_queue *cq = fud->cq;
+	DEFINE_WAIT(wait);
+	DEFINE_WAIT(cq_wait);
+	int err = 0;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&fiq->waitq, &wait,
+					  TASK_INTERRUPTIBLE);
+		if (cq)
+			prepare_to_wait_exclusive(&cq->waitq, &cq_wait,
+						  TASK_INTERRUPTIBLE);
+		if (!fiq->connected || request_pending(fiq) ||
+		    cpu_request_pending(fiq))
+			break;
+		if (signal_pending(current)) {
+			err = -ERESTARTSYS;
+			break;
+		}
+		schedule();
+	}
+	finish_wait(&fiq->waitq, &wait);
+	if (cq)
+		finish_wait(&cq->waitq, &cq_wait);
+
+	return err;
+}
+
 /*
  * Transfer an interrupt request to userspace
  *
@@ -1215,6 +1373,10 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 
  restart:
 	for (;;) {
+		req = fuse_dev_dequeue_cpu(fud);
+		if (req)
+			goto found;
+
 		spin_lock(&fiq->lock);
 		if (!fiq->connected || request_pending(fiq))
 			break;
@@ -1222,8 +1384,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 
 		if (file->f_flags & O_NONBLOCK)
 			return -EAGAIN;
-		err = wait_event_interruptible_exclusive(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
+		err = fuse_dev_wait(fud);
 		if (err)
 			return err;
 	}
@@ -1252,6 +1413,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	list_del_init(&req->list);
 	spin_unlock(&fiq->lock);
 
+found:
 	args = req->args;
 	reqsize = req->in.h.len;
 
@@ -2047,11 +2209,13 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 
 	fiq = &fud->fc->iq;
 	poll_wait(file, &fiq->waitq, wait);
+	if (fud->cq)
+		poll_wait(file, &fud->cq->waitq, wait);
 
 	spin_lock(&fiq->lock);
 	if (!fiq->connected)
 		mask = EPOLLERR;
-	else if (request_pending(fiq))
+	else if (request_pending(fiq) || cpu_request_pending(fiq))
 		mask |= EPOLLIN | EPOLLRDNORM;
 	spin_unlock(&fiq->lock);
 
@@ -2086,6 +2250,28 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/* Called with fiq->lock held */
+static void abort_cpu_queues(struct fuse_iqueue *fiq, struct list_head *to_end)
+{
+	struct fuse_cpu_queue *cq;
+	struct fuse_req *req;
+	int cpu;
+
+	if (!fiq->cpu_queues)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		cq = per_cpu_ptr(fiq->cpu_queues, cpu);
+		spin_lock(&cq->lock);
+		cq->connected = 0;
+		list_for_each_entry(req, &cq->pending, list)
+			clear_bit(FR_PENDING, &req->flags);
+		list_splice_tail_init(&cq->pending, to_end);
+		wake_up_all(&cq->waitq);
+		spin_unlock(&cq->lock);
+	}
+}
+
 /*
  * Abort all requests.
  *
@@ -2153,6 +2339,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		list_for_each_entry(req, &fiq->pending, list)
 			clear_bit(FR_PENDING, &req->flags);
 		list_splice_tail_init(&fiq->pending, &to_end);
+		abort_cpu_queues(fiq, &to_end);
 		while (forget_pending(fiq))
 			kfree(fuse_dequeue_forget(fiq, 1, NULL));
 		wake_up_all(&fiq->waitq);
@@ -2194,6 +2381,14 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		end_requests(fc, &to_end);
 
+		if (fud->cq) {
+			spin_lock(&fud->cq->lock);
+			fud->cq->nr_chans--;
+			spin_unlock(&fud->cq->lock);
+			/* Let the remaining channels steal what is left */
+			wake_up(&fc->iq.waitq);
+		}
+
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2233,6 +2428,70 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+static struct fuse_cpu_queue __percpu *fuse_cpu_queues_get(
+						struct fuse_iqueue *fiq)
+{
+	struct fuse_cpu_queue __percpu *queues;
+	struct fuse_cpu_queue *cq;
+	int cpu;
+
+	lockdep_assert_held(&fuse_mutex);
+
+	if (fiq->cpu_queues)
+		return fiq->cpu_queues;
+
+	queues = alloc_percpu(struct fuse_cpu_queue);
+	if (!queues)
+		return NULL;
+
+	spin_lock(&fiq->lock);
+	for_each_possible_cpu(cpu) {
+		cq = per_cpu_ptr(queues, cpu);
+		spin_lock_init(&cq->lock);
+		cq->connected = fiq->connected;
+		INIT_LIST_HEAD(&cq->pending);
+		init_waitqueue_head(&cq->waitq);
+	}
+	/* Pairs with smp_load_acquire() in queue_request_cpu() */
+	smp_store_release(&fiq->cpu_queues, queues);
+	spin_unlock(&fiq->lock);
+
+	return queues;
+}
+
+/*
+ * Make @fud serve the request queue of @cpu.  Requests submitted on that CPU
+ * are then read from this channel in preference to others.
+ */
+static int fuse_dev_bind_queue(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_cpu_queue __percpu *queues;
+	struct fuse_cpu_queue *cq;
+	int err = 0;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	mutex_lock(&fuse_mutex);
+	if (fud->cq) {
+		err = -EBUSY;
+		goto out_unlock;
+	}
+	queues = fuse_cpu_queues_get(&fud->fc->iq);
+	if (!queues) {
+		err = -ENOMEM;
+		goto out_unlock;
+	}
+	cq = per_cpu_ptr(queues, cpu);
+	spin_lock(&cq->lock);
+	cq->nr_chans++;
+	spin_unlock(&cq->lock);
+	fud->cq = cq;
+out_unlock:
+	mutex_unlock(&fuse_mutex);
+	return err;
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
@@ -2265,6 +2524,28 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN) {
+		struct fuse_passthrough_out pto;
+		struct fuse_dev *fud = fuse_get_dev(file);
+
+		err = -EINVAL;
+		if (!fud)
+			return err;
+
+		err = -EFAULT;
+		if (!copy_from_user(&pto, (void __user *) arg, sizeof(pto)))
+			err = fuse_passthrough_open(fud, &pto);
+	} else if (cmd == FUSE_DEV_IOC_BIND_QUEUE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 cpu;
+
+		err = -EINVAL;
+		if (!fud)
+			return err;
+
+		err = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *) arg))
+			err = fuse_dev_bind_queue(fud, cpu);
 	}
 	return err;
 }
@@ -31,6 +31,8 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
+#include <linux/percpu.h>
 
 /** Default max number of pages that can be used in a single read request */
 #define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
@@ -179,6 +181,15 @@ enum {
 struct fuse_conn;
 struct fuse_release_args;
 
+/** Stack depth of a passthrough mount, whose backing files are unstacked */
+#define FUSE_PASSTHROUGH_STACK_DEPTH	1
+
+/** Backing file and daemon credentials of a passthrough file */
+struct fuse_passthrough {
+	struct file *filp;
+	const struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -232,6 +243,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file for FOPEN_PASSTHROUGH, if any */
+	struct fuse_passthrough passthrough;
 };
 
 /** One input argument of a request */
@@ -372,6 +386,9 @@ struct fuse_req {
 	/** Used to wake up the task waiting for completion of request*/
 	wait_queue_head_t waitq;
 
+	/** Per-CPU queue the request was put on, NULL for fiq->pending */
+	struct fuse_cpu_queue *cq;
+
 #if IS_ENABLED(CONFIG_VIRTIO_FS)
 	/** virtio-fs's physically contiguous buffer for in and out args */
 	void *argbuf;
@@ -416,6 +433,30 @@ struct fuse_iqueue_ops {
 /** /dev/fuse input queue operations */
 extern const struct fuse_iqueue_ops fuse_dev_fiq_ops;
 
+/**
+ * Per-CPU input queue
+ *
+ * Regular requests are put on the queue of the submitting CPU when the daemon
+ * has bound at least one device channel to it with FUSE_DEV_IOC_BIND_QUEUE.
+ * Interrupts, forgets and notify replies always go through fuse_iqueue.
+ */
+struct fuse_cpu_queue {
+	/** Lock protecting accesses to members of this structure */
+	spinlock_t lock;
+
+	/** Queue accepts requests */
+	unsigned connected;
+
+	/** Number of device channels bound to this queue */
+	unsigned nr_chans;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Bound channels are waiting on this */
+	wait_queue_head_t waitq;
+};
+
 struct fuse_iqueue {
 	/** Connection established */
 	unsigned connected;
@@ -427,7 +468,7 @@ struct fuse_iqueue {
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** The list of pending requests */
 	struct list_head pending;
@@ -450,6 +491,9 @@ struct fuse_iqueue {
 
 	/** Device-specific state */
 	void *priv;
+
+	/** Per-CPU queues, allocated when the first channel binds */
+	struct fuse_cpu_queue __percpu *cpu_queues;
 };
 
 #define FUSE_PQ_HASH_BITS 8
@@ -481,6 +525,9 @@ struct fuse_dev {
 
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Per-CPU queue this channel serves first, or NULL */
+	struct fuse_cpu_queue *cq;
 };
 
 struct fuse_fs_context {
@@ -744,6 +791,9 @@ struct fuse_conn {
 	/** Initialize security xattrs when creating a new inode */
 	unsigned int init_security:1;
 
+	/** Passthrough of file I/O to backing files is negotiated */
+	unsigned int passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -780,6 +830,12 @@ struct fuse_conn {
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
 
+	/** Backing files registered for passthrough, not yet opened */
+	struct idr passthrough_req;
+
+	/** Protects passthrough_req */
+	spinlock_t passthrough_req_lock;
+
 #ifdef CONFIG_FUSE_DAX
 	/* Dax specific conn data, non-NULL if DAX is enabled */
 	struct fuse_conn_dax *dax;
@@ -1150,4 +1206,16 @@ void fuse_dax_inode_cleanup(struct inode *inode);
 bool fuse_dax_check_alignment(struct fuse_conn *fc, unsigned int map_alignment);
 void fuse_dax_cancel_work(struct fuse_conn *fc);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_dev *fud,
+			  struct fuse_passthrough_out *pto);
+int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			   struct fuse_open_out *openarg);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+void fuse_passthrough_free_reqs(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb,
+				    struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
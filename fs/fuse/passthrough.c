@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * FUSE passthrough: read, write and mmap of files whose open was handled by
+ * the daemon go straight to a backing file the daemon handed over.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/uio.h>
+
+static rwf_t fuse_iocb_to_rwf(struct kiocb *iocb)
+{
+	int ifl = iocb->ki_flags;
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+	if (ifl & IOCB_APPEND)
+		flags |= RWF_APPEND;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = vfs_iter_read(backing, to, &iocb->ki_pos,
+			    fuse_iocb_to_rwf(iocb));
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	inode_lock(inode);
+	old_cred = override_creds(ff->passthrough.cred);
+	file_start_write(backing);
+	ret = vfs_iter_write(backing, from, &iocb->ki_pos,
+			     fuse_iocb_to_rwf(iocb));
+	file_end_write(backing);
+	revert_creds(old_cred);
+
+	/* The daemon reports the backing file's times on the next getattr */
+	fuse_invalidate_attr(inode);
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(backing);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* Drop reference count from new vm_file value */
+		fput(backing);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	fuse_invalidate_atime(file_inode(file));
+	return ret;
+}
+
+/*
+ * Register the file behind @pto->fd as a backing file.  The returned id is
+ * passed back in fuse_open_out.passthrough_fh of the OPEN or CREATE reply
+ * that should use it.  Each id can be used by one open only.  This needs
+ * CAP_SYS_ADMIN, as the daemon picks the files that opens get redirected to.
+ */
+int fuse_passthrough_open(struct fuse_dev *fud,
+			  struct fuse_passthrough_out *pto)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_passthrough *passthrough;
+	struct file *backing;
+	int ret;
+
+	if (!fc->passthrough || !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (pto->flags)
+		return -EINVAL;
+
+	backing = fget(pto->fd);
+	if (!backing)
+		return -EBADF;
+
+	/*
+	 * Backing files must not be stacked themselves, a backing file on a
+	 * passthrough mount could lead to recursion.
+	 */
+	ret = -EINVAL;
+	if (file_inode(backing)->i_sb->s_stack_depth >=
+	    FUSE_PASSTHROUGH_STACK_DEPTH)
+		goto out_fput;
+
+	if (!S_ISREG(file_inode(backing)->i_mode) ||
+	    !backing->f_op->read_iter || !backing->f_op->write_iter)
+		goto out_fput;
+
+	ret = -ENOMEM;
+	passthrough = kmalloc(sizeof(*passthrough), GFP_KERNEL);
+	if (!passthrough)
+		goto out_fput;
+
+	passthrough->filp = backing;
+	passthrough->cred = prepare_creds();
+	if (!passthrough->cred)
+		goto out_free;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->passthrough_req_lock);
+	ret = idr_alloc(&fc->passthrough_req, passthrough, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->passthrough_req_lock);
+	idr_preload_end();
+	if (ret > 0)
+		return ret;
+
+	put_cred(passthrough->cred);
+out_free:
+	kfree(passthrough);
+out_fput:
+	fput(backing);
+	return ret;
+}
+
+/*
+ * Attach the backing file named by an open reply to @ff.  On failure the file
+ * keeps working through the daemon.
+ */
+int fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			   struct fuse_open_out *openarg)
+{
+	struct fuse_passthrough *passthrough;
+	int passthrough_fh = openarg->passthrough_fh;
+
+	if (!fc->passthrough || passthrough_fh <= 0)
+		return -EINVAL;
+
+	spin_lock(&fc->passthrough_req_lock);
+	passthrough = idr_remove(&fc->passthrough_req, passthrough_fh);
+	spin_unlock(&fc->passthrough_req_lock);
+	if (!passthrough)
+		return -EINVAL;
+
+	ff->passthrough = *passthrough;
+	kfree(passthrough);
+	return 0;
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough)
+{
+	if (passthrough->filp) {
+		fput(passthrough->filp);
+		passthrough->filp = NULL;
+	}
+	if (passthrough->cred) {
+		put_cred(passthrough->cred);
+		passthrough->cred = NULL;
+	}
+}
+
+static int fuse_passthrough_free_req(int id, void *p, void *data)
+{
+	struct fuse_passthrough *passthrough = p;
+
+	fuse_passthrough_release(passthrough);
+	kfree(passthrough);
+	return 0;
+}
+
+/* Drop backing files the daemon registered but never used */
+void fuse_passthrough_free_reqs(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_req, NULL);
+	idr_destroy(&fc->passthrough_req);
+}
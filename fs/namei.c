@@ -38,6 +38,7 @@
 #include <linux/hash.h>
 #include <linux/bitops.h>
 #include <linux/init_task.h>
+#include <linux/nsproxy.h>
 #include <linux/uaccess.h>
 
 #include "internal.h"
@@ -2104,6 +2105,294 @@ static inline u64 hash_name(const void *salt, const char *name)
 
 #endif
 
+/*
+ * Path prefix cache.
+ *
+ * Hot absolute paths are resolved over and over, one component at a time.
+ * With fs.path_prefix_cache set, RCU-walk remembers per mount namespace the
+ * directories that the dir part of such a path led to, and the next walk of
+ * the same string from the same root jumps straight to the last of them.
+ * The jump is only taken if:
+ *
+ * - no mount changed since, per mount_lock;
+ * - none of the directories was freed since, per path_prefix_gen, which
+ *   __dentry_kill() bumps for dentries marked DCACHE_PATH_PREFIX;
+ * - none of them was renamed, dropped or changed type since, per d_seq;
+ * - the walker may still search each directory that is skipped.
+ *
+ * Only walks through plain names are remembered: no "." or "..", symlinks,
+ * revalidated dentries or automount points.
+ */
+int sysctl_path_prefix_cache __read_mostly;
+
+#define PREFIX_CACHE_BITS	8
+#define PREFIX_CACHE_DEPTH	8
+#define PREFIX_CACHE_NAME_MAX	255
+
+static atomic_t path_prefix_gen = ATOMIC_INIT(0);
+
+struct prefix_step {
+	struct dentry	*dentry;
+	unsigned	seq;
+};
+
+struct prefix_entry {
+	struct rcu_head		rcu;
+	struct vfsmount		*root_mnt;
+	struct dentry		*root;
+	struct vfsmount		*mnt;		/* mount of the last step */
+	unsigned		m_seq;
+	int			gen;
+	unsigned long		used;		/* jiffies of the last insert or hit */
+	unsigned		hash;
+	unsigned		len;
+	unsigned		nr;
+	struct prefix_step	steps[PREFIX_CACHE_DEPTH];
+	char			name[];
+};
+
+struct path_prefix_cache {
+	struct prefix_entry	*slots[1 << PREFIX_CACHE_BITS];
+};
+
+/* A walk from the root, to be remembered once it reaches its last component */
+struct prefix_walk {
+	const char		*name;		/* the dir part */
+	const char		*last;		/* the last component */
+	unsigned		hash;
+	unsigned		len;
+	unsigned		nr;
+	bool			record;
+	struct vfsmount		*mnt;
+	struct prefix_step	steps[PREFIX_CACHE_DEPTH];
+};
+
+void path_prefix_cache_forget(void)
+{
+	/* Pairs with smp_rmb() in prefix_cache_insert() */
+	smp_mb__before_atomic();
+	atomic_inc(&path_prefix_gen);
+}
+
+void path_prefix_cache_free(struct path_prefix_cache *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < ARRAY_SIZE(cache->slots); i++)
+		kfree(cache->slots[i]);
+	kfree(cache);
+}
+
+static bool prefix_walk_init(struct nameidata *nd, const char *name,
+			     struct prefix_walk *pw)
+{
+	const char *end, *p;
+
+	pw->record = false;
+	if (!READ_ONCE(sysctl_path_prefix_cache) ||
+	    (nd->flags & (LOOKUP_RCU | LOOKUP_ROOT)) != LOOKUP_RCU ||
+	    nd->depth || nd->path.dentry != nd->root.dentry ||
+	    nd->path.mnt != nd->root.mnt || !current->nsproxy)
+		return false;
+
+	end = name + strlen(name);
+	while (end > name && end[-1] == '/')
+		end--;
+	for (p = end; p > name && p[-1] != '/'; p--)
+		;
+	if (p == name)
+		return false;
+	pw->last = p;
+	while (p[-1] == '/')
+		p--;
+	if (p - name > PREFIX_CACHE_NAME_MAX)
+		return false;
+
+	pw->name = name;
+	pw->len = p - name;
+	pw->hash = full_name_hash(nd->root.dentry, name, pw->len);
+	pw->nr = 0;
+	pw->mnt = nd->root.mnt;
+	pw->record = true;
+	return true;
+}
+
+/* Jump over the dir part of the walk if it is cached and still valid */
+static bool prefix_cache_jump(struct nameidata *nd, struct prefix_walk *pw)
+{
+	struct mnt_namespace *ns = current->nsproxy->mnt_ns;
+	struct path_prefix_cache *cache = READ_ONCE(ns->prefix_cache);
+	struct inode *inode = nd->inode;
+	struct prefix_entry *e;
+	unsigned i;
+
+	if (!cache)
+		return false;
+	e = READ_ONCE(cache->slots[hash_32(pw->hash, PREFIX_CACHE_BITS)]);
+	if (!e || e->hash != pw->hash || e->len != pw->len ||
+	    e->root != nd->root.dentry || e->root_mnt != nd->root.mnt ||
+	    e->m_seq != nd->m_seq ||
+	    e->gen != atomic_read(&path_prefix_gen) ||
+	    memcmp(e->name, pw->name, pw->len))
+		return false;
+
+	for (i = 0; i < e->nr; i++) {
+		struct dentry *dentry = e->steps[i].dentry;
+
+		if (inode_permission(inode, MAY_EXEC|MAY_NOT_BLOCK))
+			return false;
+		inode = d_backing_inode(dentry);
+		if (read_seqcount_retry(&dentry->d_seq, e->steps[i].seq))
+			return false;
+	}
+
+	if (READ_ONCE(e->used) != jiffies)
+		WRITE_ONCE(e->used, jiffies);
+
+	nd->path.mnt = e->mnt;
+	nd->path.dentry = e->steps[e->nr - 1].dentry;
+	nd->inode = inode;
+	nd->seq = e->steps[e->nr - 1].seq;
+	nd->flags &= ~LOOKUP_JUMPED;
+	return true;
+}
+
+/* Remember the directory that a component of the dir part led to */
+static void prefix_walk_step(struct nameidata *nd, struct prefix_walk *pw,
+			     int err)
+{
+	const unsigned reval = DCACHE_OP_REVALIDATE | DCACHE_OP_WEAK_REVALIDATE;
+	struct dentry *dentry = nd->path.dentry;
+
+	if (err || !(nd->flags & LOOKUP_RCU) || nd->last_type != LAST_NORM ||
+	    pw->nr == PREFIX_CACHE_DEPTH || (dentry->d_flags & reval))
+		goto stop;
+
+	if (nd->path.mnt != pw->mnt) {
+		struct dentry *mp = real_mount(nd->path.mnt)->mnt_mountpoint;
+
+		if (mp->d_flags & (reval | DCACHE_NEED_AUTOMOUNT |
+				   DCACHE_MANAGE_TRANSIT))
+			goto stop;
+		pw->mnt = nd->path.mnt;
+	}
+
+	pw->steps[pw->nr].dentry = dentry;
+	pw->steps[pw->nr].seq = nd->seq;
+	pw->nr++;
+	return;
+stop:
+	pw->record = false;
+}
+
+static bool prefix_cache_mark(struct dentry *dentry, unsigned seq, bool root)
+{
+	bool ok;
+
+	/* Marked by an earlier walk, it only has to be still alive */
+	if (READ_ONCE(dentry->d_flags) & DCACHE_PATH_PREFIX)
+		return !__lockref_is_dead(&dentry->d_lockref) &&
+		       (root || !read_seqcount_retry(&dentry->d_seq, seq));
+
+	spin_lock(&dentry->d_lock);
+	if (root)
+		ok = !__lockref_is_dead(&dentry->d_lockref);
+	else
+		ok = !read_seqcount_retry(&dentry->d_seq, seq);
+	if (ok)
+		dentry->d_flags |= DCACHE_PATH_PREFIX;
+	spin_unlock(&dentry->d_lock);
+	return ok;
+}
+
+/*
+ * Replacing an entry costs an allocation and an RCU free, so a slot changes
+ * at most once a jiffy, and an entry for another path that is still valid
+ * and was hit within the last second is kept.
+ */
+static bool prefix_cache_replace(struct prefix_entry *old,
+				 struct nameidata *nd, struct prefix_walk *pw,
+				 int gen)
+{
+	unsigned long used = READ_ONCE(old->used);
+
+	if (used == jiffies)
+		return false;
+	if (old->gen != gen || old->m_seq != nd->m_seq ||
+	    (old->hash == pw->hash && old->len == pw->len &&
+	     old->root == nd->root.dentry))
+		return true;
+	return time_after(jiffies, used + HZ);
+}
+
+/* The walk reached its last component, remember how it got there */
+static void prefix_cache_insert(struct nameidata *nd, struct prefix_walk *pw)
+{
+	struct mnt_namespace *ns = current->nsproxy->mnt_ns;
+	struct path_prefix_cache *cache, *old_cache;
+	struct prefix_entry *e, *old, **slot;
+	unsigned i;
+	int gen;
+
+	if (!pw->nr || nd->last.name != pw->last || !(nd->flags & LOOKUP_RCU))
+		return;
+
+	/* Dentries killed before this are seen dead by prefix_cache_mark() */
+	gen = atomic_read(&path_prefix_gen);
+	smp_rmb();
+
+	cache = READ_ONCE(ns->prefix_cache);
+	if (!cache) {
+		cache = kzalloc(sizeof(*cache), GFP_NOWAIT | __GFP_NOWARN);
+		if (!cache)
+			return;
+		old_cache = cmpxchg(&ns->prefix_cache, NULL, cache);
+		if (old_cache) {
+			kfree(cache);
+			cache = old_cache;
+		}
+	}
+
+	slot = &cache->slots[hash_32(pw->hash, PREFIX_CACHE_BITS)];
+	old = READ_ONCE(*slot);
+	if (old && !prefix_cache_replace(old, nd, pw, gen))
+		return;
+
+	e = kmalloc(struct_size(e, name, pw->len), GFP_NOWAIT | __GFP_NOWARN);
+	if (!e)
+		return;
+
+	/* Freeing any of these dentries from now on invalidates @gen */
+	if (!prefix_cache_mark(nd->root.dentry, 0, true))
+		goto free;
+	for (i = 0; i < pw->nr; i++) {
+		if (!prefix_cache_mark(pw->steps[i].dentry, pw->steps[i].seq,
+				       false))
+			goto free;
+	}
+
+	e->root_mnt = nd->root.mnt;
+	e->root = nd->root.dentry;
+	e->mnt = nd->path.mnt;
+	e->m_seq = nd->m_seq;
+	e->gen = gen;
+	e->used = jiffies;
+	e->hash = pw->hash;
+	e->len = pw->len;
+	e->nr = pw->nr;
+	memcpy(e->steps, pw->steps, sizeof(e->steps));
+	memcpy(e->name, pw->name, pw->len);
+
+	old = xchg(slot, e);
+	if (old)
+		kfree_rcu(old, rcu);
+	return;
+free:
+	kfree(e);
+}
+
 /*
  * Name resolution.
  * This is the basic name resolution function, turning a pathname into
@@ -2114,6 +2403,7 @@ static inline u64 hash_name(const void *salt, const char *name)
  */
 static int link_path_walk(const char *name, struct nameidata *nd)
 {
+	struct prefix_walk pw;
 	int err;
 
 	if (IS_ERR(name))
@@ -2123,6 +2413,11 @@ static int link_path_walk(const char *name, struct nameidata *nd)
 	if (!*name)
 		return 0;
 
+	if (prefix_walk_init(nd, name, &pw) && prefix_cache_jump(nd, &pw)) {
+		name = pw.last;
+		pw.record = false;
+	}
+
 	/* At this point we know we have a real path component. */
 	for(;;) {
 		u64 hash_len;
@@ -2175,8 +2470,11 @@ static int link_path_walk(const char *name, struct nameidata *nd)
 		if (unlikely(!*name)) {
 OK:
 			/* pathname body, done */
-			if (!nd->depth)
+			if (!nd->depth) {
+				if (unlikely(pw.record))
+					prefix_cache_insert(nd, &pw);
 				return 0;
+			}
 			name = nd->stack[nd->depth - 1].name;
 			/* trailing symlink, done */
 			if (!name)
@@ -2189,6 +2487,8 @@ static int link_path_walk(const char *name, struct nameidata *nd)
 		}
 		if (err < 0)
 			return err;
+		if (unlikely(pw.record))
+			prefix_walk_step(nd, &pw, err);
 
 		if (err) {
 			const char *s = get_link(nd);
@@ -117,12 +117,63 @@ int ovl_copy_xattr(struct dentry *old, struct dentry *new)
 	return error;
 }
 
+/*
+ * Copy @len bytes at @pos of @old_file to the same offset in @new_file.  Use
+ * the copy offload of the filesystem when both files have one, otherwise
+ * splice the data through the page cache.
+ */
+static int ovl_copy_up_file_range(struct file *old_file, struct file *new_file,
+				  loff_t pos, loff_t len)
+{
+	bool can_offload = new_file->f_op->copy_file_range &&
+		new_file->f_op->copy_file_range == old_file->f_op->copy_file_range;
+	loff_t old_pos = pos;
+	loff_t new_pos = pos;
+	int error = 0;
+
+	while (len) {
+		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
+		long bytes = -EOPNOTSUPP;
+
+		if (len < this_len)
+			this_len = len;
+
+		if (signal_pending_state(TASK_KILLABLE, current)) {
+			error = -EINTR;
+			break;
+		}
+
+		if (can_offload) {
+			bytes = new_file->f_op->copy_file_range(old_file, old_pos,
+								 new_file, new_pos,
+								 this_len, 0);
+			if (bytes > 0) {
+				old_pos += bytes;
+				new_pos += bytes;
+			}
+		}
+		if (bytes == -EOPNOTSUPP || bytes == -EXDEV) {
+			can_offload = false;
+			bytes = do_splice_direct(old_file, &old_pos,
+						 new_file, &new_pos,
+						 this_len, SPLICE_F_MOVE);
+		}
+		if (bytes <= 0) {
+			error = bytes;
+			break;
+		}
+		WARN_ON(old_pos != new_pos);
+
+		len -= bytes;
+	}
+
+	return error;
+}
+
 static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 {
 	struct file *old_file;
 	struct file *new_file;
-	loff_t old_pos = 0;
-	loff_t new_pos = 0;
 	loff_t cloned;
 	int error = 0;
 
@@ -146,29 +197,7 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 	/* Couldn't clone, so now we try to copy the data */
 
 	/* FIXME: copy up sparse files efficiently */
-	while (len) {
-		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
-		long bytes;
-
-		if (len < this_len)
-			this_len = len;
-
-		if (signal_pending_state(TASK_KILLABLE, current)) {
-			error = -EINTR;
-			break;
-		}
-
-		bytes = do_splice_direct(old_file, &old_pos,
-					 new_file, &new_pos,
-					 this_len, SPLICE_F_MOVE);
-		if (bytes <= 0) {
-			error = bytes;
-			break;
-		}
-		WARN_ON(old_pos != new_pos);
-
-		len -= bytes;
-	}
+	error = ovl_copy_up_file_range(old_file, new_file, 0, len);
 out:
 	if (!error)
 		error = vfs_fsync(new_file, 0);
@@ -735,10 +764,724 @@ static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
 	return true;
 }
 
+/*
+ * Lazy copy-up of large files
+ *
+ * With "lazy_copy_up=on", opening a large lower file write-only copies up its
+ * metadata only.  The data is copied in chunks: a write first copies the
+ * chunks it touches and a background worker copies the rest, after which the
+ * copy-up is finished like that of any metacopy inode.  Until then reads go
+ * to the upper file for copied chunks and to the lower file for the others.
+ * Opens for read can map the file, so they copy up the rest of the data
+ * before they return.
+ *
+ * Which chunks have been copied is stored in the "copyup" xattr of the upper
+ * file.  It is stored when a file that was open for write is closed or
+ * fsynced, after the copied data has been synced, so it never claims data
+ * that could be lost in a crash.
+ *
+ * Older kernels would take such a file for a plain metacopy file and copy the
+ * lower data over what has been written to the upper file.  Its redirect is
+ * prefixed with OVL_REDIRECT_LAZY for as long as the data is being copied,
+ * which they reject as invalid, so that they fail the lookup instead.
+ */
+#define OVL_LAZY_COPY_UP_MIN	(16 << 20)
+#define OVL_LAZY_CHUNK_SHIFT	20
+#define OVL_LAZY_MAX_CHUNKS	4096
+/* Chunks copied by one run of the background worker */
+#define OVL_LAZY_BATCH		64
+
+#define OVL_COPYUP_MAP_VERSION	1
+
+/* On-disk format of trusted.overlay.copyup */
+struct ovl_copyup_map {
+	u8 version;
+	u8 chunk_shift;
+	u8 pad[6];
+	__le64 size;		/* size of the lower data */
+	u8 map[];		/* bit per chunk, set if copied */
+} __packed;
+
+struct ovl_lazy_copy_up {
+	/* serializes chunk copies and protects the fields below */
+	struct mutex lock;
+	struct file *lower_file;
+	/* NULL if the upper fs was read-only when we got here */
+	struct file *upper_file;
+	loff_t size;
+	unsigned int chunk_shift;
+	unsigned long nr_chunks;
+	unsigned long nr_copied;
+	/* copied[] changed since it was last stored */
+	bool dirty;
+	/* security.capability to restore after writing chunks */
+	char *caps;
+	ssize_t caps_size;
+	struct work_struct work;
+	/* on ofs->lazy_list while the worker holds a ref to @dentry */
+	struct list_head list;
+	struct dentry *dentry;
+	unsigned long copied[];
+};
+
+static struct ovl_lazy_copy_up *ovl_lazy(struct inode *inode)
+{
+	/* Pairs with smp_store_release() in ovl_lazy_get() */
+	return smp_load_acquire(&OVL_I(inode)->lazy);
+}
+
+bool ovl_lazy_copy_up_active(struct inode *inode)
+{
+	return ovl_lazy(inode) && !ovl_has_upperdata(inode);
+}
+
+/*
+ * Return the lower file if data at @pos has not been copied up yet, or NULL
+ * if it is to be read from the upper file.  *@len is trimmed to the length
+ * that is to be read from the same file.
+ */
+struct file *ovl_lazy_copy_up_source(struct inode *inode, loff_t pos,
+				     loff_t *len)
+{
+	struct ovl_lazy_copy_up *lz = ovl_lazy(inode);
+	unsigned long chunk, next;
+	loff_t end;
+
+	if (!lz || pos >= lz->size)
+		return NULL;
+
+	chunk = pos >> lz->chunk_shift;
+	if (test_bit(chunk, lz->copied)) {
+		/* Pairs with smp_wmb() in ovl_lazy_copy_chunks() */
+		smp_rmb();
+		next = find_next_zero_bit(lz->copied, lz->nr_chunks, chunk);
+		if (next < lz->nr_chunks)
+			*len = min(*len, ((loff_t)next << lz->chunk_shift) - pos);
+		return NULL;
+	}
+
+	next = find_next_bit(lz->copied, lz->nr_chunks, chunk);
+	end = min((loff_t)next << lz->chunk_shift, lz->size);
+	*len = min(*len, end - pos);
+	return lz->lower_file;
+}
+
+/* Copy one chunk, leaving holes of the lower file unallocated in upper */
+static int ovl_lazy_copy_chunk(struct ovl_lazy_copy_up *lz,
+			       unsigned long chunk)
+{
+	loff_t pos = (loff_t)chunk << lz->chunk_shift;
+	loff_t end = min(pos + (1LL << lz->chunk_shift), lz->size);
+	loff_t data, hole, cloned;
+	int err;
+
+	cloned = do_clone_file_range(lz->lower_file, pos, lz->upper_file, pos,
+				     end - pos, 0);
+	if (cloned == end - pos)
+		return 0;
+
+	while (pos < end) {
+		data = vfs_llseek(lz->lower_file, pos, SEEK_DATA);
+		if (data == -ENXIO)
+			break;
+		if (data < 0) {
+			data = pos;
+			hole = end;
+		} else {
+			if (data >= end)
+				break;
+			hole = vfs_llseek(lz->lower_file, data, SEEK_HOLE);
+			if (hole < 0 || hole > end)
+				hole = end;
+		}
+
+		err = ovl_copy_up_file_range(lz->lower_file, lz->upper_file,
+					     data, hole - data);
+		if (err)
+			return err;
+		pos = hole;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy chunks [@first, @last] that have not been copied yet.  Called with
+ * lz->lock held, with write access to the upper mount and mounter's creds.
+ */
+static int ovl_lazy_copy_chunks(struct ovl_lazy_copy_up *lz,
+				unsigned long first, unsigned long last)
+{
+	unsigned long chunk;
+	bool copied = false;
+	int err = 0;
+
+	if (!lz->upper_file)
+		return -EROFS;
+
+	for (chunk = find_next_zero_bit(lz->copied, last + 1, first);
+	     chunk <= last;
+	     chunk = find_next_zero_bit(lz->copied, last + 1, chunk + 1)) {
+		err = ovl_lazy_copy_chunk(lz, chunk);
+		if (err)
+			break;
+
+		/* Pairs with smp_rmb() in ovl_lazy_copy_up_source() */
+		smp_wmb();
+		set_bit(chunk, lz->copied);
+		lz->nr_copied++;
+		lz->dirty = copied = true;
+	}
+
+	/* Writing to the upper file cleared security.capability */
+	if (copied && lz->caps) {
+		int err2 = ovl_do_setxattr(lz->upper_file->f_path.dentry,
+					   XATTR_NAME_CAPS, lz->caps,
+					   lz->caps_size, 0);
+		err = err ?: err2;
+	}
+
+	return err;
+}
+
+/* Sync the copied data and record it in the copyup xattr */
+static int ovl_lazy_store_map(struct ovl_lazy_copy_up *lz)
+{
+	struct ovl_copyup_map *map;
+	size_t len = offsetof(struct ovl_copyup_map, map) +
+		     DIV_ROUND_UP(lz->nr_chunks, BITS_PER_BYTE);
+	unsigned long chunk;
+	int err;
+
+	if (!lz->dirty)
+		return 0;
+
+	err = vfs_fsync(lz->upper_file, 1);
+	if (err)
+		return err;
+
+	map = kzalloc(len, GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	map->version = OVL_COPYUP_MAP_VERSION;
+	map->chunk_shift = lz->chunk_shift;
+	map->size = cpu_to_le64(lz->size);
+	for_each_set_bit(chunk, lz->copied, lz->nr_chunks)
+		map->map[chunk / BITS_PER_BYTE] |= 1 << (chunk % BITS_PER_BYTE);
+
+	err = ovl_do_setxattr(lz->upper_file->f_path.dentry, OVL_XATTR_COPYUP,
+			      map, len, 0);
+	if (!err)
+		lz->dirty = false;
+	kfree(map);
+
+	return err;
+}
+
+static int ovl_lazy_load_map(struct ovl_lazy_copy_up *lz,
+			     struct ovl_copyup_map *map, ssize_t len)
+{
+	unsigned long chunk;
+
+	if (len < offsetof(struct ovl_copyup_map, map) ||
+	    map->version != OVL_COPYUP_MAP_VERSION ||
+	    map->chunk_shift != lz->chunk_shift ||
+	    le64_to_cpu(map->size) != lz->size ||
+	    len != offsetof(struct ovl_copyup_map, map) +
+		   DIV_ROUND_UP(lz->nr_chunks, BITS_PER_BYTE))
+		return -EIO;
+
+	for (chunk = 0; chunk < lz->nr_chunks; chunk++) {
+		if (map->map[chunk / BITS_PER_BYTE] &
+		    (1 << (chunk % BITS_PER_BYTE))) {
+			set_bit(chunk, lz->copied);
+			lz->nr_copied++;
+		}
+	}
+
+	return 0;
+}
+
+bool ovl_is_lazy_redirect(struct dentry *upper)
+{
+	const size_t len = sizeof(OVL_REDIRECT_LAZY) - 1;
+	char *buf = NULL;
+	ssize_t res;
+	bool lazy;
+
+	res = ovl_getxattr(upper, OVL_XATTR_REDIRECT, &buf, 0);
+	if (res < 0)
+		return false;
+
+	lazy = res >= len && !strncmp(buf, OVL_REDIRECT_LAZY, len);
+	kfree(buf);
+
+	return lazy;
+}
+
+/* Called with the parent dir of @upper locked */
+int ovl_set_lazy_redirect(struct dentry *upper, const char *redirect)
+{
+	char *buf;
+	int err;
+
+	buf = kasprintf(GFP_KERNEL, OVL_REDIRECT_LAZY "%s", redirect ?: "");
+	if (!buf)
+		return -ENOMEM;
+
+	err = ovl_do_setxattr(upper, OVL_XATTR_REDIRECT, buf, strlen(buf), 0);
+	kfree(buf);
+
+	return err;
+}
+
+static int ovl_mark_lazy_redirect(struct dentry *upper)
+{
+	struct dentry *parent;
+	char *redirect;
+	int err = 0;
+
+	parent = ovl_lock_upper_parent(upper);
+	if (!ovl_is_lazy_redirect(upper)) {
+		redirect = ovl_get_redirect_xattr(upper, 0);
+		if (IS_ERR(redirect)) {
+			err = PTR_ERR(redirect);
+		} else {
+			err = ovl_set_lazy_redirect(upper, redirect);
+			kfree(redirect);
+		}
+	}
+	ovl_unlock_upper_parent(parent);
+
+	return err;
+}
+
+/* Restore the plain redirect once all the data has been copied up */
+static int ovl_clear_lazy_redirect(struct dentry *upper)
+{
+	const size_t len = sizeof(OVL_REDIRECT_LAZY) - 1;
+	struct dentry *parent;
+	char *buf = NULL;
+	ssize_t res;
+	int err = 0;
+
+	parent = ovl_lock_upper_parent(upper);
+	res = ovl_getxattr(upper, OVL_XATTR_REDIRECT, &buf, 0);
+	if (res < 0 && res != -ENODATA) {
+		err = res;
+	} else if (res >= (ssize_t)len && !strncmp(buf, OVL_REDIRECT_LAZY, len)) {
+		if (res == len)
+			err = ovl_do_removexattr(upper, OVL_XATTR_REDIRECT);
+		else
+			err = ovl_do_setxattr(upper, OVL_XATTR_REDIRECT,
+					      buf + len, res - len, 0);
+	}
+	ovl_unlock_upper_parent(parent);
+	kfree(buf);
+
+	return err;
+}
+
+static void ovl_lazy_work(struct work_struct *work);
+
+/*
+ * Get the lazy copy-up state of @dentry, reading it from the copyup xattr if
+ * needed.  Without @create, NULL is returned for a metacopy inode with no
+ * data copied up yet.  Called with ovl_inode_lock held and mounter's creds.
+ */
+static struct ovl_lazy_copy_up *ovl_lazy_get(struct dentry *dentry,
+					     bool create)
+{
+	struct inode *inode = d_inode(dentry);
+	struct ovl_copyup_map *map = NULL;
+	struct ovl_lazy_copy_up *lz;
+	struct path upperpath, datapath;
+	unsigned int chunk_shift;
+	unsigned long nr_chunks;
+	struct file *file;
+	loff_t size;
+	ssize_t res;
+	int err;
+
+	lz = OVL_I(inode)->lazy;
+	if (lz || ovl_has_upperdata(inode) || !ovl_dentry_upper(dentry))
+		return lz;
+
+	ovl_path_upper(dentry, &upperpath);
+	ovl_path_lowerdata(dentry, &datapath);
+	if (WARN_ON(datapath.dentry == NULL))
+		return ERR_PTR(-EIO);
+
+	res = ovl_getxattr(upperpath.dentry, OVL_XATTR_COPYUP, (char **)&map,
+			   0);
+	if (res == -ENODATA && !create)
+		return NULL;
+	if (res < 0 && res != -ENODATA)
+		return ERR_PTR(res);
+
+	size = i_size_read(d_inode(datapath.dentry));
+	chunk_shift = OVL_LAZY_CHUNK_SHIFT;
+	if (map && res > offsetof(struct ovl_copyup_map, chunk_shift))
+		chunk_shift = map->chunk_shift;
+	else
+		while ((size - 1) >> chunk_shift >= OVL_LAZY_MAX_CHUNKS)
+			chunk_shift++;
+	err = -EIO;
+	if (chunk_shift < PAGE_SHIFT || chunk_shift > 40)
+		goto out_free_map;
+	nr_chunks = (size + (1LL << chunk_shift) - 1) >> chunk_shift;
+
+	err = -ENOMEM;
+	lz = kzalloc(struct_size(lz, copied, BITS_TO_LONGS(nr_chunks)),
+		     GFP_KERNEL);
+	if (!lz)
+		goto out_free_map;
+
+	mutex_init(&lz->lock);
+	INIT_WORK(&lz->work, ovl_lazy_work);
+	INIT_LIST_HEAD(&lz->list);
+	lz->size = size;
+	lz->chunk_shift = chunk_shift;
+	lz->nr_chunks = nr_chunks;
+	if (map) {
+		err = ovl_lazy_load_map(lz, map, res);
+		if (err) {
+			pr_warn_ratelimited("overlayfs: invalid copyup xattr (%pd2)\n",
+					    upperpath.dentry);
+			goto out_free;
+		}
+	}
+
+	res = ovl_getxattr(upperpath.dentry, XATTR_NAME_CAPS, &lz->caps, 0);
+	if (res < 0 && res != -ENODATA) {
+		err = res;
+		goto out_free;
+	}
+	lz->caps_size = res;
+
+	file = ovl_path_open(&datapath, O_LARGEFILE | O_RDONLY);
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		goto out_free;
+	}
+	lz->lower_file = file;
+
+	file = ovl_path_open(&upperpath, O_LARGEFILE | O_WRONLY);
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		if (err != -EROFS)
+			goto out_fput;
+		file = NULL;
+	}
+	lz->upper_file = file;
+
+	/* Keep older kernels off the file before we write any data to it */
+	if (!map && lz->upper_file) {
+		err = ovl_mark_lazy_redirect(upperpath.dentry);
+		if (err)
+			goto out_fput_upper;
+	}
+	kfree(map);
+
+	smp_store_release(&OVL_I(inode)->lazy, lz);
+	return lz;
+
+out_fput_upper:
+	fput(lz->upper_file);
+out_fput:
+	fput(lz->lower_file);
+out_free:
+	kfree(lz->caps);
+	kfree(lz);
+out_free_map:
+	kfree(map);
+	return ERR_PTR(err);
+}
+
+void ovl_lazy_copy_up_free(struct inode *inode)
+{
+	struct ovl_lazy_copy_up *lz = OVL_I(inode)->lazy;
+
+	if (!lz)
+		return;
+
+	WARN_ON(!list_empty(&lz->list));
+	fput(lz->lower_file);
+	if (lz->upper_file)
+		fput(lz->upper_file);
+	kfree(lz->caps);
+	mutex_destroy(&lz->lock);
+	kfree(lz);
+}
+
+/* Make sure a read open sees the data that has been copied up so far */
+int ovl_lazy_copy_up_load(struct dentry *dentry)
+{
+	struct inode *inode = d_inode(dentry);
+	const struct cred *old_cred;
+	struct ovl_lazy_copy_up *lz;
+	int err;
+
+	if (!S_ISREG(inode->i_mode) || ovl_lazy(inode) ||
+	    ovl_has_upperdata(inode) || !ovl_inode_upper(inode))
+		return 0;
+
+	err = ovl_inode_lock(inode);
+	if (err)
+		return err;
+
+	old_cred = ovl_override_creds(dentry->d_sb);
+	lz = ovl_lazy_get(dentry, false);
+	ovl_revert_creds(dentry->d_sb, old_cred);
+	ovl_inode_unlock(inode);
+
+	return PTR_ERR_OR_ZERO(lz);
+}
+
+static void ovl_lazy_worker_start(struct ovl_lazy_copy_up *lz,
+				  struct dentry *dentry)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+
+	spin_lock(&ofs->lazy_lock);
+	if (list_empty(&lz->list)) {
+		lz->dentry = dget(dentry);
+		list_add(&lz->list, &ofs->lazy_list);
+		queue_work(system_unbound_wq, &lz->work);
+	}
+	spin_unlock(&ofs->lazy_lock);
+}
+
+static void ovl_lazy_worker_done(struct ovl_lazy_copy_up *lz,
+				 struct dentry *dentry)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+	bool owner;
+
+	spin_lock(&ofs->lazy_lock);
+	owner = !list_empty(&lz->list);
+	list_del_init(&lz->list);
+	spin_unlock(&ofs->lazy_lock);
+
+	/* May free @lz */
+	if (owner)
+		dput(dentry);
+}
+
+static void ovl_lazy_work(struct work_struct *work)
+{
+	struct ovl_lazy_copy_up *lz = container_of(work, struct ovl_lazy_copy_up,
+						   work);
+	struct dentry *dentry = lz->dentry;
+	struct super_block *sb = dentry->d_sb;
+	const struct cred *old_cred;
+	unsigned long first, last;
+	bool done = false;
+	int err;
+
+	if (sb_rdonly(sb) || !ovl_lazy_copy_up_active(d_inode(dentry)))
+		goto out;
+
+	old_cred = ovl_override_creds(sb);
+	err = ovl_want_write(dentry);
+	if (!err) {
+		mutex_lock(&lz->lock);
+		first = find_first_zero_bit(lz->copied, lz->nr_chunks);
+		last = min(first + OVL_LAZY_BATCH, lz->nr_chunks) - 1;
+		if (first < lz->nr_chunks)
+			err = ovl_lazy_copy_chunks(lz, first, last);
+		done = lz->nr_copied == lz->nr_chunks;
+		if (!err && !done)
+			err = ovl_lazy_store_map(lz);
+		mutex_unlock(&lz->lock);
+		ovl_drop_write(dentry);
+	}
+	if (!err && done)
+		err = ovl_lazy_copy_up_finish(dentry);
+	ovl_revert_creds(sb, old_cred);
+
+	if (!err && !done) {
+		queue_work(system_unbound_wq, work);
+		return;
+	}
+	if (err)
+		pr_warn_ratelimited("overlayfs: lazy copy up of %pd2 failed (%i)\n",
+				    dentry, err);
+out:
+	ovl_lazy_worker_done(lz, dentry);
+}
+
+/* Stop background copies before unmount, they hold dentry refs */
+void ovl_lazy_copy_up_stop(struct super_block *sb)
+{
+	struct ovl_fs *ofs = sb->s_fs_info;
+	struct ovl_lazy_copy_up *lz;
+	struct dentry *dentry;
+
+	spin_lock(&ofs->lazy_lock);
+	while ((lz = list_first_entry_or_null(&ofs->lazy_list,
+					      struct ovl_lazy_copy_up,
+					      list))) {
+		list_del_init(&lz->list);
+		dentry = lz->dentry;
+		spin_unlock(&ofs->lazy_lock);
+
+		cancel_work_sync(&lz->work);
+		dput(dentry);
+
+		spin_lock(&ofs->lazy_lock);
+	}
+	spin_unlock(&ofs->lazy_lock);
+}
+
+static bool ovl_lazy_copy_up_wanted(struct dentry *dentry, int flags)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+	struct inode *inode = d_inode(dentry);
+
+	/* A file open for read may get mapped, that needs all of the data */
+	if ((flags & O_TRUNC) || (OPEN_FMODE(flags) & FMODE_READ))
+		return false;
+
+	if (ovl_lazy(inode))
+		return true;
+
+	return ofs->config.lazy_copy_up && S_ISREG(inode->i_mode) &&
+	       i_size_read(inode) >= OVL_LAZY_COPY_UP_MIN;
+}
+
+/* Copy up metadata now and data on demand and in the background */
+static int ovl_lazy_copy_up_start(struct dentry *dentry)
+{
+	struct inode *inode = d_inode(dentry);
+	struct ovl_lazy_copy_up *lz;
+	const struct cred *old_cred;
+	int err;
+
+	err = ovl_copy_up(dentry);
+	if (err)
+		return err;
+
+	err = ovl_inode_lock(inode);
+	if (err)
+		return err;
+
+	old_cred = ovl_override_creds(dentry->d_sb);
+	lz = ovl_lazy_get(dentry, true);
+	ovl_revert_creds(dentry->d_sb, old_cred);
+	ovl_inode_unlock(inode);
+
+	if (IS_ERR(lz))
+		return PTR_ERR(lz);
+
+	if (lz && lz->upper_file)
+		ovl_lazy_worker_start(lz, dentry);
+
+	return 0;
+}
+
+/*
+ * Copy up the data that a write of @len bytes at @pos is going to modify.
+ * Called with mounter's creds.
+ */
+int ovl_lazy_copy_up_range(struct dentry *dentry, loff_t pos, loff_t len)
+{
+	struct ovl_lazy_copy_up *lz = ovl_lazy(d_inode(dentry));
+	loff_t end = pos + len;
+	int err;
+
+	if (!lz)
+		return 0;
+
+	err = ovl_want_write(dentry);
+	if (err)
+		return err;
+
+	mutex_lock(&lz->lock);
+	/* The write removes security.capability, do not put it back */
+	kfree(lz->caps);
+	lz->caps = NULL;
+
+	end = min(end, lz->size);
+	if (len && pos < end)
+		err = ovl_lazy_copy_chunks(lz, pos >> lz->chunk_shift,
+					   (end - 1) >> lz->chunk_shift);
+	mutex_unlock(&lz->lock);
+	ovl_drop_write(dentry);
+
+	return err;
+}
+
+/* Store which chunks have been copied, so writes to them survive a crash */
+int ovl_lazy_copy_up_sync(struct dentry *dentry)
+{
+	struct ovl_lazy_copy_up *lz = ovl_lazy(d_inode(dentry));
+	const struct cred *old_cred;
+	int err;
+
+	if (!lz || !READ_ONCE(lz->dirty))
+		return 0;
+
+	err = ovl_want_write(dentry);
+	if (err)
+		return err;
+
+	old_cred = ovl_override_creds(dentry->d_sb);
+	mutex_lock(&lz->lock);
+	if (lz->dirty) {
+		err = ovl_lazy_store_map(lz);
+		/* fdatasync does not have to write the xattr */
+		if (!err)
+			err = vfs_fsync(lz->upper_file, 0);
+	}
+	mutex_unlock(&lz->lock);
+	ovl_revert_creds(dentry->d_sb, old_cred);
+	ovl_drop_write(dentry);
+
+	return err;
+}
+
+/* Copy up all the data now, for users that need it all in the upper file */
+int ovl_lazy_copy_up_finish(struct dentry *dentry)
+{
+	int err;
+
+	if (!ovl_lazy_copy_up_active(d_inode(dentry)))
+		return 0;
+
+	err = ovl_want_write(dentry);
+	if (!err) {
+		err = ovl_copy_up_with_data(dentry);
+		ovl_drop_write(dentry);
+	}
+
+	return err;
+}
+
+/* Copy the chunks that are left, called with ovl_inode_lock held */
+static int ovl_lazy_copy_up_rest(struct ovl_lazy_copy_up *lz)
+{
+	int err = 0;
+
+	if (!lz->upper_file)
+		return -EROFS;
+
+	mutex_lock(&lz->lock);
+	if (lz->nr_copied < lz->nr_chunks)
+		err = ovl_lazy_copy_chunks(lz, 0, lz->nr_chunks - 1);
+	if (!err)
+		err = vfs_fsync(lz->upper_file, 0);
+	mutex_unlock(&lz->lock);
+
+	return err;
+}
+
 /* Copy up data of an inode which was copied up metadata only in the past. */
 static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
 {
 	struct path upperpath, datapath;
+	struct ovl_lazy_copy_up *lz;
 	int err;
 	char *capability = NULL;
 	ssize_t uninitialized_var(cap_size);
@@ -758,7 +1501,18 @@ static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
 			goto out;
 	}
 
-	err = ovl_copy_up_data(&datapath, &upperpath, c->stat.size);
+	lz = ovl_lazy_get(c->dentry, false);
+	if (IS_ERR(lz)) {
+		err = PTR_ERR(lz);
+		goto out_free;
+	}
+
+	if (!lz)
+		err = ovl_copy_up_data(&datapath, &upperpath, c->stat.size);
+	else if (c->stat.size)
+		err = ovl_lazy_copy_up_rest(lz);
+	else
+		err = 0;
 	if (err)
 		goto out_free;
 
@@ -778,6 +1532,21 @@ static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
 	if (err)
 		goto out_free;
 
+	if (lz) {
+		err = vfs_removexattr(upperpath.dentry, OVL_XATTR_COPYUP);
+		if (err && err != -ENODATA)
+			goto out_free;
+	}
+
+	/*
+	 * Also if no copyup xattr was stored for the chunks copied lazily.
+	 * The metacopy xattr is gone already, so a crash here leaves a file
+	 * that older kernels still refuse, never one they'd copy up again.
+	 */
+	err = ovl_clear_lazy_redirect(upperpath.dentry);
+	if (err)
+		goto out_free;
+
 	ovl_set_upperdata(d_inode(c->dentry));
 out_free:
 	kfree(capability);
@@ -915,7 +1684,10 @@ int ovl_maybe_copy_up(struct dentry *dentry, int flags)
 	if (ovl_open_need_copy_up(dentry, flags)) {
 		err = ovl_want_write(dentry);
 		if (!err) {
-			err = ovl_copy_up_flags(dentry, flags);
+			if (ovl_lazy_copy_up_wanted(dentry, flags))
+				err = ovl_lazy_copy_up_start(dentry);
+			else
+				err = ovl_copy_up_flags(dentry, flags);
 			ovl_drop_write(dentry);
 		}
 	}
@@ -654,11 +654,15 @@ static int ovl_symlink(struct inode *dir, struct dentry *dentry,
 static int ovl_set_link_redirect(struct dentry *dentry)
 {
 	const struct cred *old_cred;
+	struct dentry *parent;
 	int err;
 
+	/* Rename holds the lock too, see ovl_set_redirect() */
+	parent = ovl_lock_upper_parent(ovl_dentry_upper(dentry));
 	old_cred = ovl_override_creds(dentry->d_sb);
 	err = ovl_set_redirect(dentry, false);
 	ovl_revert_creds(dentry->d_sb, old_cred);
+	ovl_unlock_upper_parent(parent);
 
 	return err;
 }
@@ -990,9 +994,14 @@ static bool ovl_need_absolute_redirect(struct dentry *dentry, bool samedir)
 	return (d_inode(lowerdentry)->i_nlink > 1);
 }
 
+/*
+ * Called with the parent dir of the upper dentry locked, which serializes
+ * setting the redirect of a file with lazy copy-up starting and finishing.
+ */
 static int ovl_set_redirect(struct dentry *dentry, bool samedir)
 {
 	int err;
+	struct dentry *upper = ovl_dentry_upper(dentry);
 	const char *redirect = ovl_dentry_get_redirect(dentry);
 	bool absolute_redirect = ovl_need_absolute_redirect(dentry, samedir);
 
@@ -1003,9 +1012,11 @@ static int ovl_set_redirect(struct dentry *dentry, bool samedir)
 	if (IS_ERR(redirect))
 		return PTR_ERR(redirect);
 
-	err = ovl_check_setxattr(dentry, ovl_dentry_upper(dentry),
-				 OVL_XATTR_REDIRECT,
-				 redirect, strlen(redirect), -EXDEV);
+	if (d_is_reg(upper) && ovl_is_lazy_redirect(upper))
+		err = ovl_set_lazy_redirect(upper, redirect);
+	else
+		err = ovl_check_setxattr(dentry, upper, OVL_XATTR_REDIRECT,
+					 redirect, strlen(redirect), -EXDEV);
 	if (!err) {
 		spin_lock(&dentry->d_lock);
 		ovl_dentry_set_redirect(dentry, redirect);
@@ -92,6 +92,18 @@ static int ovl_change_flags(struct file *file, unsigned int flags)
 	return 0;
 }
 
+/*
+ * While data is copied up lazily all I/O goes through the upper file and
+ * ovl_read_iter() reads what has not been copied yet from the lower file.
+ */
+static struct inode *ovl_inode_realfile(struct inode *inode, bool allow_meta)
+{
+	if (allow_meta || ovl_lazy_copy_up_active(inode))
+		return ovl_inode_real(inode);
+
+	return ovl_inode_realdata(inode);
+}
+
 static int ovl_real_fdget_meta(const struct file *file, struct fd *real,
 			       bool allow_meta)
 {
@@ -101,10 +113,7 @@ static int ovl_real_fdget_meta(const struct file *file, struct fd *real,
 	real->flags = 0;
 	real->file = file->private_data;
 
-	if (allow_meta)
-		realinode = ovl_inode_real(inode);
-	else
-		realinode = ovl_inode_realdata(inode);
+	realinode = ovl_inode_realfile(inode, allow_meta);
 
 	/* Has it been copied up since we'd opened it? */
 	if (unlikely(file_inode(real->file) != realinode)) {
@@ -135,10 +144,26 @@ static int ovl_open(struct inode *inode, struct file *file)
 	if (err)
 		return err;
 
+	err = ovl_lazy_copy_up_load(file_dentry(file));
+	if (err)
+		return err;
+
+	/*
+	 * Only write-only opens leave data to copy up lazily.  Files open for
+	 * read can be mapped, and a mapping can't take holes of the upper file
+	 * for data, nor can ovl_mmap() copy it up under mmap_sem.  If the
+	 * upper layer is read-only, keep reading through the lazy copy-up.
+	 */
+	if ((file->f_mode & FMODE_READ) && ovl_lazy_copy_up_active(inode)) {
+		err = ovl_lazy_copy_up_finish(file_dentry(file));
+		if (err && err != -EROFS)
+			return err;
+	}
+
 	/* No longer need these flags, so don't pass them on to underlying fs */
 	file->f_flags &= ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
 
-	realfile = ovl_open_realfile(file, ovl_inode_realdata(inode));
+	realfile = ovl_open_realfile(file, ovl_inode_realfile(inode, false));
 	if (IS_ERR(realfile))
 		return PTR_ERR(realfile);
 
@@ -149,6 +174,15 @@ static int ovl_open(struct inode *inode, struct file *file)
 
 static int ovl_release(struct inode *inode, struct file *file)
 {
+	int err;
+
+	if ((file->f_mode & FMODE_WRITE) && ovl_lazy_copy_up_active(inode)) {
+		err = ovl_lazy_copy_up_sync(file_dentry(file));
+		if (err)
+			pr_warn_ratelimited("overlayfs: failed to store copyup state of %pd2 (%i)\n",
+					    file_dentry(file), err);
+	}
+
 	fput(file->private_data);
 
 	return 0;
@@ -173,6 +207,13 @@ static loff_t ovl_llseek(struct file *file, loff_t offset, int whence)
 			return vfs_setpos(file, 0, 0);
 	}
 
+	/* Holes and data of a lazy copy-up are scattered between layers */
+	if (whence == SEEK_DATA || whence == SEEK_HOLE) {
+		ret = ovl_lazy_copy_up_finish(file_dentry(file));
+		if (ret)
+			return ret;
+	}
+
 	ret = ovl_real_fdget(file, &real);
 	if (ret)
 		return ret;
@@ -238,6 +279,38 @@ static rwf_t ovl_iocb_to_rwf(struct kiocb *iocb)
 	return flags;
 }
 
+/* Read each range from the layer that has its data */
+static ssize_t ovl_lazy_read_iter(struct kiocb *iocb, struct file *upperfile,
+				  struct iov_iter *iter)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	ssize_t ret = 0;
+
+	while (iov_iter_count(iter)) {
+		size_t count = iov_iter_count(iter);
+		loff_t len = count;
+		struct file *realfile;
+		ssize_t bytes;
+
+		realfile = ovl_lazy_copy_up_source(inode, iocb->ki_pos, &len);
+		if (!realfile)
+			realfile = upperfile;
+
+		iov_iter_truncate(iter, len);
+		bytes = vfs_iter_read(realfile, iter, &iocb->ki_pos,
+				      ovl_iocb_to_rwf(iocb));
+		iov_iter_reexpand(iter, count - max_t(ssize_t, bytes, 0));
+		if (bytes <= 0)
+			return ret ?: bytes;
+
+		ret += bytes;
+		if (bytes < len)
+			break;
+	}
+
+	return ret;
+}
+
 static ssize_t ovl_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
 	struct file *file = iocb->ki_filp;
@@ -253,8 +326,11 @@ static ssize_t ovl_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 		return ret;
 
 	old_cred = ovl_override_creds(file_inode(file)->i_sb);
-	ret = vfs_iter_read(real.file, iter, &iocb->ki_pos,
-			    ovl_iocb_to_rwf(iocb));
+	if (ovl_lazy_copy_up_active(file_inode(file)))
+		ret = ovl_lazy_read_iter(iocb, real.file, iter);
+	else
+		ret = vfs_iter_read(real.file, iter, &iocb->ki_pos,
+				    ovl_iocb_to_rwf(iocb));
 	ovl_revert_creds(file_inode(file)->i_sb, old_cred);
 
 	ovl_file_accessed(file);
@@ -287,10 +363,20 @@ static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 		goto out_unlock;
 
 	old_cred = ovl_override_creds(file_inode(file)->i_sb);
-	file_start_write(real.file);
-	ret = vfs_iter_write(real.file, iter, &iocb->ki_pos,
-			     ovl_iocb_to_rwf(iocb));
-	file_end_write(real.file);
+	if (ovl_lazy_copy_up_active(inode)) {
+		loff_t pos = iocb->ki_pos;
+
+		if (iocb->ki_flags & IOCB_APPEND)
+			pos = i_size_read(file_inode(real.file));
+		ret = ovl_lazy_copy_up_range(file_dentry(file), pos,
+					     iov_iter_count(iter));
+	}
+	if (!ret) {
+		file_start_write(real.file);
+		ret = vfs_iter_write(real.file, iter, &iocb->ki_pos,
+				     ovl_iocb_to_rwf(iocb));
+		file_end_write(real.file);
+	}
 	ovl_revert_creds(file_inode(file)->i_sb, old_cred);
 
 	/* Update size */
@@ -310,6 +396,11 @@ static int ovl_fsync(struct file *file, loff_t start, loff_t end, int datasync)
 	const struct cred *old_cred;
 	int ret;
 
+	/* Writes to chunks copied up lazily need the copyup state on disk */
+	ret = ovl_lazy_copy_up_sync(file_dentry(file));
+	if (ret)
+		return ret;
+
 	ret = ovl_real_fdget_meta(file, &real, !datasync);
 	if (ret)
 		return ret;
@@ -332,6 +423,14 @@ static int ovl_mmap(struct file *file, struct vm_area_struct *vma)
 	const struct cred *old_cred;
 	int ret;
 
+	/*
+	 * ovl_open() copied up all the data of a file open for read, unless
+	 * the upper layer was read-only.  Don't map holes for data then.
+	 */
+	if (ovl_lazy_copy_up_active(file_inode(file)) &&
+	    file_inode(realfile) == ovl_inode_upper(file_inode(file)))
+		return -EROFS;
+
 	if (!realfile->f_op->mmap)
 		return -ENODEV;
 
@@ -364,6 +463,10 @@ static long ovl_fallocate(struct file *file, int mode, loff_t offset, loff_t len
 	const struct cred *old_cred;
 	int ret;
 
+	ret = ovl_lazy_copy_up_finish(file_dentry(file));
+	if (ret)
+		return ret;
+
 	ret = ovl_real_fdget(file, &real);
 	if (ret)
 		return ret;
@@ -576,6 +679,12 @@ static loff_t ovl_copyfile(struct file *file_in, loff_t pos_in,
 	const struct cred *old_cred;
 	loff_t ret;
 
+	ret = ovl_lazy_copy_up_finish(file_dentry(file_in));
+	if (!ret)
+		ret = ovl_lazy_copy_up_finish(file_dentry(file_out));
+	if (ret)
+		return ret;
+
 	ret = ovl_real_fdget(file_out, &real_out);
 	if (ret)
 		return ret;
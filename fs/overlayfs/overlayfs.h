@@ -27,6 +27,10 @@ enum ovl_path_type {
 #define OVL_XATTR_NLINK OVL_XATTR_PREFIX "nlink"
 #define OVL_XATTR_UPPER OVL_XATTR_PREFIX "upper"
 #define OVL_XATTR_METACOPY OVL_XATTR_PREFIX "metacopy"
+#define OVL_XATTR_COPYUP OVL_XATTR_PREFIX "copyup"
+
+/* Redirect prefix of a file whose data is being copied up lazily */
+#define OVL_REDIRECT_LAZY "lazy/"
 
 enum ovl_inode_flag {
 	/* Pure upper dir that may contain non pure upper entries */
@@ -281,6 +285,8 @@ bool ovl_need_index(struct dentry *dentry);
 int ovl_nlink_start(struct dentry *dentry);
 void ovl_nlink_end(struct dentry *dentry);
 int ovl_lock_rename_workdir(struct dentry *workdir, struct dentry *upperdir);
+struct dentry *ovl_lock_upper_parent(struct dentry *upper);
+void ovl_unlock_upper_parent(struct dentry *parent);
 int ovl_check_metacopy_xattr(struct dentry *dentry);
 bool ovl_is_metacopy_dentry(struct dentry *dentry);
 char *ovl_get_redirect_xattr(struct dentry *dentry, int padding);
@@ -347,6 +353,8 @@ int ovl_check_empty_dir(struct dentry *dentry, struct list_head *list);
 void ovl_cleanup_whiteouts(struct dentry *upper, struct list_head *list);
 void ovl_cache_free(struct list_head *list);
 void ovl_dir_cache_free(struct inode *inode);
+int ovl_readdir_init(void);
+void ovl_readdir_exit(void);
 int ovl_check_d_type_supported(struct path *realpath);
 void ovl_workdir_cleanup(struct inode *dir, struct vfsmount *mnt,
 			 struct dentry *dentry, int level);
@@ -436,6 +444,17 @@ int ovl_set_attr(struct dentry *upper, struct kstat *stat);
 struct ovl_fh *ovl_encode_real_fh(struct dentry *real, bool is_upper);
 int ovl_set_origin(struct dentry *dentry, struct dentry *lower,
 		   struct dentry *upper);
+bool ovl_lazy_copy_up_active(struct inode *inode);
+struct file *ovl_lazy_copy_up_source(struct inode *inode, loff_t pos,
+				     loff_t *len);
+int ovl_lazy_copy_up_load(struct dentry *dentry);
+int ovl_lazy_copy_up_range(struct dentry *dentry, loff_t pos, loff_t len);
+int ovl_lazy_copy_up_sync(struct dentry *dentry);
+int ovl_lazy_copy_up_finish(struct dentry *dentry);
+void ovl_lazy_copy_up_free(struct inode *inode);
+void ovl_lazy_copy_up_stop(struct super_block *sb);
+bool ovl_is_lazy_redirect(struct dentry *upper);
+int ovl_set_lazy_redirect(struct dentry *upper, const char *redirect);
 
 /* export.c */
 extern const struct export_operations ovl_export_operations;
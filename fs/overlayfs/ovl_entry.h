@@ -18,6 +18,7 @@ struct ovl_config {
 	int xino;
 	bool metacopy;
 	bool override_creds;
+	bool lazy_copy_up;
 };
 
 struct ovl_sb {
@@ -74,6 +75,9 @@ struct ovl_fs {
 	struct inode *indexdir_trap;
 	/* Inode numbers in all layers do not use the high xino_bits */
 	unsigned int xino_bits;
+	/* Lazy copy-ups with a background copy in progress */
+	spinlock_t lazy_lock;
+	struct list_head lazy_list;
 };
 
 /* private information held for every overlayfs dentry */
@@ -106,6 +110,8 @@ struct ovl_inode {
 	struct inode vfs_inode;
 	struct dentry *__upperdentry;
 	struct inode *lower;
+	/* regular file whose data is being copied up lazily */
+	struct ovl_lazy_copy_up *lazy;
 
 	/* synchronize copy up and more */
 	struct mutex lock;
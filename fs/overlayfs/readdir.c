@@ -13,8 +13,26 @@
 #include <linux/security.h>
 #include <linux/cred.h>
 #include <linux/ratelimit.h>
+#include <linux/module.h>
+#include <linux/hash.h>
+#include <linux/iversion.h>
 #include "overlayfs.h"
 
+/*
+ * Merged dir caches are kept around after the last close, so listing a big
+ * merged dir again does not have to merge the layers again.  Idle caches are
+ * on an LRU list that is trimmed to readdir_cache_size and by a shrinker.
+ */
+static unsigned int ovl_dir_cache_max_kb = 16384;
+module_param_named(readdir_cache_size, ovl_dir_cache_max_kb, uint, 0644);
+MODULE_PARM_DESC(readdir_cache_size,
+		 "Maximum KiB of merged dir listings kept while not open (0 = drop on last close)");
+
+static DEFINE_SPINLOCK(ovl_dir_cache_lock);
+static LIST_HEAD(ovl_dir_cache_lru);
+static size_t ovl_dir_cache_idle_size;
+static unsigned long ovl_dir_cache_idle_nr;
+
 struct ovl_cache_entry {
 	unsigned int len;
 	unsigned int type;
@@ -31,6 +49,14 @@ struct ovl_cache_entry {
 struct ovl_dir_cache {
 	long refcount;
 	u64 version;
+	/* ovl_dir_real_version() of a merged dir when the cache was built */
+	u64 real_version;
+	/* bytes used by entries of a merged dir */
+	size_t size;
+	/* entries freed while idle, cache has to be rebuilt */
+	bool evicted;
+	/* on ovl_dir_cache_lru while refcount is zero */
+	struct list_head lru;
 	struct list_head entries;
 	struct rb_root root;
 };
@@ -225,29 +251,149 @@ void ovl_cache_free(struct list_head *list)
 	INIT_LIST_HEAD(list);
 }
 
+/*
+ * Changes to the real dirs that did not go through overlay, e.g. the upper
+ * dir that appears on copy up, don't change the overlay dir version.
+ */
+static u64 ovl_dir_real_version(struct dentry *dentry)
+{
+	struct path realpath;
+	struct inode *inode;
+	u64 version = 0;
+	int idx, next;
+
+	for (idx = 0; idx != -1; idx = next) {
+		next = ovl_path_next(idx, dentry, &realpath);
+		inode = d_inode(realpath.dentry);
+		version ^= inode_peek_iversion_raw(inode) ^
+			   inode->i_ctime.tv_sec ^ inode->i_ctime.tv_nsec;
+		version = hash_64(version + (unsigned long)inode, 64);
+	}
+
+	return version;
+}
+
+static bool ovl_dir_cache_valid(struct dentry *dentry,
+				struct ovl_dir_cache *cache)
+{
+	return ovl_dentry_version_get(dentry) == cache->version &&
+	       ovl_dir_real_version(dentry) == cache->real_version;
+}
+
+/* Called with ovl_dir_cache_lock held */
+static void ovl_dir_cache_lru_del(struct ovl_dir_cache *cache)
+{
+	if (list_empty(&cache->lru))
+		return;
+
+	list_del_init(&cache->lru);
+	ovl_dir_cache_idle_size -= cache->size;
+	ovl_dir_cache_idle_nr--;
+}
+
+static void ovl_dir_cache_destroy(struct ovl_dir_cache *cache)
+{
+	spin_lock(&ovl_dir_cache_lock);
+	ovl_dir_cache_lru_del(cache);
+	spin_unlock(&ovl_dir_cache_lock);
+
+	ovl_cache_free(&cache->entries);
+	kfree(cache);
+}
+
 void ovl_dir_cache_free(struct inode *inode)
 {
 	struct ovl_dir_cache *cache = ovl_dir_cache(inode);
 
-	if (cache) {
-		ovl_cache_free(&cache->entries);
-		kfree(cache);
+	if (cache)
+		ovl_dir_cache_destroy(cache);
+}
+
+/*
+ * Free the entries of up to @nr idle caches, least recently used first, and
+ * of as many as needed to get idle caches down to @max_size bytes.  The
+ * caches themselves stay attached to their inodes until the next
+ * ovl_cache_get().
+ */
+static unsigned long ovl_dir_cache_evict(unsigned long nr, size_t max_size)
+{
+	struct ovl_dir_cache *cache;
+	unsigned long freed = 0;
+	LIST_HEAD(entries);
+
+	spin_lock(&ovl_dir_cache_lock);
+	while (!list_empty(&ovl_dir_cache_lru) &&
+	       (freed < nr || ovl_dir_cache_idle_size > max_size)) {
+		cache = list_first_entry(&ovl_dir_cache_lru,
+					 struct ovl_dir_cache, lru);
+		ovl_dir_cache_lru_del(cache);
+		list_splice_init(&cache->entries, &entries);
+		cache->root = RB_ROOT;
+		cache->evicted = true;
+		freed++;
 	}
+	spin_unlock(&ovl_dir_cache_lock);
+
+	ovl_cache_free(&entries);
+
+	return freed;
 }
 
 static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
 {
 	struct ovl_dir_cache *cache = od->cache;
+	size_t max_size = (size_t)READ_ONCE(ovl_dir_cache_max_kb) << 10;
 
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
-	if (!cache->refcount) {
-		if (ovl_dir_cache(d_inode(dentry)) == cache)
-			ovl_set_dir_cache(d_inode(dentry), NULL);
+	if (cache->refcount)
+		return;
 
-		ovl_cache_free(&cache->entries);
-		kfree(cache);
+	if (ovl_dir_cache(d_inode(dentry)) == cache) {
+		if (max_size && cache->size <= max_size &&
+		    ovl_dir_cache_valid(dentry, cache)) {
+			/* Keep it for the next opener */
+			spin_lock(&ovl_dir_cache_lock);
+			list_add_tail(&cache->lru, &ovl_dir_cache_lru);
+			ovl_dir_cache_idle_size += cache->size;
+			ovl_dir_cache_idle_nr++;
+			spin_unlock(&ovl_dir_cache_lock);
+
+			ovl_dir_cache_evict(0, max_size);
+			return;
+		}
+		ovl_set_dir_cache(d_inode(dentry), NULL);
 	}
+
+	ovl_dir_cache_destroy(cache);
+}
+
+static unsigned long ovl_dir_cache_shrink_count(struct shrinker *shrink,
+						struct shrink_control *sc)
+{
+	return READ_ONCE(ovl_dir_cache_idle_nr);
+}
+
+static unsigned long ovl_dir_cache_shrink_scan(struct shrinker *shrink,
+					       struct shrink_control *sc)
+{
+	return ovl_dir_cache_evict(sc->nr_to_scan, SIZE_MAX);
+}
+
+static struct shrinker ovl_dir_cache_shrinker = {
+	.count_objects	= ovl_dir_cache_shrink_count,
+	.scan_objects	= ovl_dir_cache_shrink_scan,
+	.seeks		= DEFAULT_SEEKS,
+};
+
+int __init ovl_readdir_init(void)
+{
+	return register_shrinker(&ovl_dir_cache_shrinker);
+}
+
+void ovl_readdir_exit(void)
+{
+	unregister_shrinker(&ovl_dir_cache_shrinker);
 }
 
 static int ovl_fill_merge(struct dir_context *ctx, const char *name,
@@ -338,7 +484,7 @@ static void ovl_dir_reset(struct file *file)
 	struct dentry *dentry = file->f_path.dentry;
 	bool is_real;
 
-	if (cache && ovl_dentry_version_get(dentry) != cache->version) {
+	if (cache && !ovl_dir_cache_valid(dentry, cache)) {
 		ovl_cache_put(od, dentry);
 		od->cache = NULL;
 		od->cursor = NULL;
@@ -406,20 +552,33 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 {
 	int res;
 	struct ovl_dir_cache *cache;
+	struct ovl_cache_entry *p;
+	bool hit;
 
 	cache = ovl_dir_cache(d_inode(dentry));
-	if (cache && ovl_dentry_version_get(dentry) == cache->version) {
-		WARN_ON(!cache->refcount);
-		cache->refcount++;
-		return cache;
+	if (cache) {
+		hit = ovl_dir_cache_valid(dentry, cache);
+		spin_lock(&ovl_dir_cache_lock);
+		if (cache->evicted)
+			hit = false;
+		else if (hit && !cache->refcount++)
+			ovl_dir_cache_lru_del(cache);
+		spin_unlock(&ovl_dir_cache_lock);
+		if (hit)
+			return cache;
+
+		/* Stale or evicted; free it unless some opener still uses it */
+		ovl_set_dir_cache(d_inode(dentry), NULL);
+		if (!cache->refcount)
+			ovl_dir_cache_destroy(cache);
 	}
-	ovl_set_dir_cache(d_inode(dentry), NULL);
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
 	if (!cache)
 		return ERR_PTR(-ENOMEM);
 
 	cache->refcount = 1;
+	INIT_LIST_HEAD(&cache->lru);
 	INIT_LIST_HEAD(&cache->entries);
 	cache->root = RB_ROOT;
 
@@ -430,7 +589,10 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 		return ERR_PTR(res);
 	}
 
+	list_for_each_entry(p, &cache->entries, l_node)
+		cache->size += offsetof(struct ovl_cache_entry, name[p->len + 1]);
 	cache->version = ovl_dentry_version_get(dentry);
+	cache->real_version = ovl_dir_real_version(dentry);
 	ovl_set_dir_cache(d_inode(dentry), cache);
 
 	return cache;
@@ -611,6 +773,7 @@ static struct ovl_dir_cache *ovl_cache_get_impure(struct path *path)
 	if (!cache)
 		return ERR_PTR(-ENOMEM);
 
+	INIT_LIST_HEAD(&cache->lru);
 	res = ovl_dir_read_impure(path, &cache->entries, &cache->root);
 	if (res) {
 		ovl_cache_free(&cache->entries);
@@ -58,6 +58,9 @@ module_param_named(override_creds, ovl_override_creds_def, bool, 0644);
 MODULE_PARM_DESC(ovl_override_creds_def,
 		 "Use mounter's credentials for accesses");
 
+static const bool ovl_lazy_copy_up_def =
+	IS_ENABLED(CONFIG_OVERLAY_FS_LAZY_COPY_UP);
+
 static void ovl_entry_stack_free(struct ovl_entry *oe)
 {
 	unsigned int i;
@@ -190,6 +193,7 @@ static struct inode *ovl_alloc_inode(struct super_block *sb)
 	oi->__upperdentry = NULL;
 	oi->lower = NULL;
 	oi->lowerdata = NULL;
+	oi->lazy = NULL;
 	mutex_init(&oi->lock);
 
 	return &oi->vfs_inode;
@@ -210,10 +214,12 @@ static void ovl_destroy_inode(struct inode *inode)
 
 	dput(oi->__upperdentry);
 	iput(oi->lower);
-	if (S_ISDIR(inode->i_mode))
+	if (S_ISDIR(inode->i_mode)) {
 		ovl_dir_cache_free(inode);
-	else
+	} else {
 		iput(oi->lowerdata);
+		ovl_lazy_copy_up_free(inode);
+	}
 }
 
 static void ovl_free_fs(struct ovl_fs *ofs)
@@ -374,6 +380,9 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	if (ofs->config.override_creds != ovl_override_creds_def)
 		seq_show_option(m, "override_creds",
 				ofs->config.override_creds ? "on" : "off");
+	if (ofs->config.lazy_copy_up != ovl_lazy_copy_up_def)
+		seq_printf(m, ",lazy_copy_up=%s",
+			   ofs->config.lazy_copy_up ? "on" : "off");
 	return 0;
 }
 
@@ -416,6 +425,8 @@ enum {
 	OPT_METACOPY_OFF,
 	OPT_OVERRIDE_CREDS_ON,
 	OPT_OVERRIDE_CREDS_OFF,
+	OPT_LAZY_COPY_UP_ON,
+	OPT_LAZY_COPY_UP_OFF,
 	OPT_ERR,
 };
 
@@ -436,6 +447,8 @@ static const match_table_t ovl_tokens = {
 	{OPT_METACOPY_OFF,		"metacopy=off"},
 	{OPT_OVERRIDE_CREDS_ON,		"override_creds=on"},
 	{OPT_OVERRIDE_CREDS_OFF,	"override_creds=off"},
+	{OPT_LAZY_COPY_UP_ON,		"lazy_copy_up=on"},
+	{OPT_LAZY_COPY_UP_OFF,		"lazy_copy_up=off"},
 	{OPT_ERR,			NULL}
 };
 
@@ -583,6 +596,14 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 			config->override_creds = false;
 			break;
 
+		case OPT_LAZY_COPY_UP_ON:
+			config->lazy_copy_up = true;
+			break;
+
+		case OPT_LAZY_COPY_UP_OFF:
+			config->lazy_copy_up = false;
+			break;
+
 		default:
 			pr_err("overlayfs: unrecognized mount option \"%s\" or missing value\n", p);
 			return -EINVAL;
@@ -1629,6 +1650,9 @@ static int ovl_fill_super(struct super_block *sb, void *data, int silent)
 	if (!ofs)
 		goto out;
 
+	spin_lock_init(&ofs->lazy_lock);
+	INIT_LIST_HEAD(&ofs->lazy_list);
+
 	ofs->creator_cred = cred = prepare_creds();
 	if (!cred)
 		goto out_err;
@@ -1637,6 +1661,7 @@ static int ovl_fill_super(struct super_block *sb, void *data, int silent)
 	ofs->config.nfs_export = ovl_nfs_export_def;
 	ofs->config.xino = ovl_xino_def();
 	ofs->config.metacopy = ovl_metacopy_def;
+	ofs->config.lazy_copy_up = ovl_lazy_copy_up_def;
 	err = ovl_parse_opt((char *) data, &ofs->config);
 	if (err)
 		goto out_err;
@@ -1719,6 +1744,11 @@ static int ovl_fill_super(struct super_block *sb, void *data, int silent)
 		ofs->config.nfs_export = false;
 	}
 
+	if (ofs->config.lazy_copy_up && !ofs->config.metacopy) {
+		pr_warn("overlayfs: lazy copy up requires metadata only copy up, falling back to lazy_copy_up=off.\n");
+		ofs->config.lazy_copy_up = false;
+	}
+
 	if (ofs->config.nfs_export)
 		sb->s_export_op = &ovl_export_operations;
 
@@ -1770,11 +1800,19 @@ static struct dentry *ovl_mount(struct file_system_type *fs_type, int flags,
 	return mount_nodev(fs_type, flags, raw_data, ovl_fill_super);
 }
 
+static void ovl_kill_sb(struct super_block *sb)
+{
+	/* s_fs_info is stale if ovl_fill_super() failed */
+	if (sb->s_root)
+		ovl_lazy_copy_up_stop(sb);
+	kill_anon_super(sb);
+}
+
 static struct file_system_type ovl_fs_type = {
 	.owner		= THIS_MODULE,
 	.name		= "overlay",
 	.mount		= ovl_mount,
-	.kill_sb	= kill_anon_super,
+	.kill_sb	= ovl_kill_sb,
 };
 MODULE_ALIAS_FS("overlay");
 
@@ -1797,16 +1835,27 @@ static int __init ovl_init(void)
 	if (ovl_inode_cachep == NULL)
 		return -ENOMEM;
 
+	err = ovl_readdir_init();
+	if (err)
+		goto out_cache;
+
 	err = register_filesystem(&ovl_fs_type);
 	if (err)
-		kmem_cache_destroy(ovl_inode_cachep);
+		goto out_readdir;
+
+	return 0;
 
+out_readdir:
+	ovl_readdir_exit();
+out_cache:
+	kmem_cache_destroy(ovl_inode_cachep);
 	return err;
 }
 
 static void __exit ovl_exit(void)
 {
 	unregister_filesystem(&ovl_fs_type);
+	ovl_readdir_exit();
 
 	/*
 	 * Make sure all delayed rcu free inodes are flushed before we
@@ -867,6 +867,27 @@ int ovl_lock_rename_workdir(struct dentry *workdir, struct dentry *upperdir)
 	return -EIO;
 }
 
+/* Lock the parent dir of @upper, so that it can't be renamed under us */
+struct dentry *ovl_lock_upper_parent(struct dentry *upper)
+{
+	struct dentry *parent;
+
+	for (;;) {
+		parent = dget_parent(upper);
+		inode_lock_nested(d_inode(parent), I_MUTEX_PARENT);
+		if (likely(upper->d_parent == parent))
+			return parent;
+		inode_unlock(d_inode(parent));
+		dput(parent);
+	}
+}
+
+void ovl_unlock_upper_parent(struct dentry *parent)
+{
+	inode_unlock(d_inode(parent));
+	dput(parent);
+}
+
 /* err < 0, 0 if no metacopy xattr, 1 if metacopy xattr found */
 int ovl_check_metacopy_xattr(struct dentry *dentry)
 {
@@ -951,6 +972,17 @@ char *ovl_get_redirect_xattr(struct dentry *dentry, int padding)
 	if (res == 0)
 		goto invalid;
 
+	/* Strip the marker of a lazy copy-up, see ovl_set_lazy_redirect() */
+	if (res >= sizeof(OVL_REDIRECT_LAZY) - 1 &&
+	    !strncmp(buf, OVL_REDIRECT_LAZY, sizeof(OVL_REDIRECT_LAZY) - 1)) {
+		res -= sizeof(OVL_REDIRECT_LAZY) - 1;
+		if (!res) {
+			kfree(buf);
+			return NULL;
+		}
+		memmove(buf, buf + sizeof(OVL_REDIRECT_LAZY) - 1, res + 1);
+	}
+
 	if (buf[0] == '/') {
 		for (s = buf; *s++ == '/'; s = next) {
 			next = strchrnul(s, '/');
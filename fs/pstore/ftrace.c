@@ -16,12 +16,10 @@
 #include <linux/debugfs.h>
 #include <linux/err.h>
 #include <linux/cache.h>
+#include <linux/sched/clock.h>
 #include <asm/barrier.h>
 #include "internal.h"
 
-/* This doesn't need to be atomic: speed is chosen over correctness here. */
-static u64 pstore_ftrace_stamp;
-
 static void notrace pstore_ftrace_call(unsigned long ip,
 				       unsigned long parent_ip,
 				       struct ftrace_ops *op,
@@ -43,7 +41,12 @@ static void notrace pstore_ftrace_call(unsigned long ip,
 
 	rec.ip = ip;
 	rec.parent_ip = parent_ip;
-	pstore_ftrace_write_timestamp(&rec, pstore_ftrace_stamp++);
+	/*
+	 * A clock read rather than a shared counter: it is not written to by
+	 * every CPU, and orders the records of the per-CPU zones when they
+	 * are merged.
+	 */
+	pstore_ftrace_write_timestamp(&rec, local_clock());
 	pstore_ftrace_encode_cpu(&rec, raw_smp_processor_id());
 	psinfo->write(&record);
 
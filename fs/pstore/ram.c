@@ -62,6 +62,13 @@ module_param(dump_oops, int, 0600);
 MODULE_PARM_DESC(dump_oops,
 		"set to 1 to dump oopses, 0 to only dump panics (default 1)");
 
+static bool ramoops_compress_logs;
+module_param_named(compress_logs, ramoops_compress_logs, bool, 0400);
+MODULE_PARM_DESC(compress_logs,
+		"set to 1 to store console and pmsg logs lz4-compressed, "
+		"not used with ecc; same as the \"compress-logs\" DT "
+		"property (default 0)");
+
 static int ramoops_ecc;
 module_param_named(ecc, ramoops_ecc, int, 0600);
 MODULE_PARM_DESC(ramoops_ecc,
@@ -168,56 +175,62 @@ static bool prz_ok(struct persistent_ram_zone *prz)
 			   persistent_ram_ecc_string(prz, NULL, 0));
 }
 
+/*
+ * Merge the records of the per-CPU ftrace zones @srcs into @dest, ordered by
+ * time stamp.  Each zone is already in order, so this is a single pass that
+ * takes the oldest head record among the zones each time.
+ */
 static ssize_t ftrace_log_combine(struct persistent_ram_zone *dest,
-				  struct persistent_ram_zone *src)
+				  struct persistent_ram_zone **srcs,
+				  unsigned int nr_srcs)
 {
-	size_t dest_size, src_size, total, dest_off, src_off;
-	size_t dest_idx = 0, src_idx = 0, merged_idx = 0;
-	void *merged_buf;
-	struct pstore_ftrace_record *drec, *srec, *mrec;
 	size_t record_size = sizeof(struct pstore_ftrace_record);
-
-	dest_off = dest->old_log_size % record_size;
-	dest_size = dest->old_log_size - dest_off;
-
-	src_off = src->old_log_size % record_size;
-	src_size = src->old_log_size - src_off;
-
-	total = dest_size + src_size;
-	merged_buf = kmalloc(total, GFP_KERNEL);
-	if (!merged_buf)
-		return -ENOMEM;
-
-	drec = (struct pstore_ftrace_record *)(dest->old_log + dest_off);
-	srec = (struct pstore_ftrace_record *)(src->old_log + src_off);
-	mrec = (struct pstore_ftrace_record *)(merged_buf);
-
-	while (dest_size > 0 && src_size > 0) {
-		if (pstore_ftrace_read_timestamp(&drec[dest_idx]) <
-		    pstore_ftrace_read_timestamp(&srec[src_idx])) {
-			mrec[merged_idx++] = drec[dest_idx++];
-			dest_size -= record_size;
-		} else {
-			mrec[merged_idx++] = srec[src_idx++];
-			src_size -= record_size;
-		}
-	}
-
-	while (dest_size > 0) {
-		mrec[merged_idx++] = drec[dest_idx++];
-		dest_size -= record_size;
+	struct pstore_ftrace_record **recs, *mrec;
+	size_t *left, total = 0;
+	unsigned int i, min;
+
+	recs = kcalloc(nr_srcs, sizeof(*recs), GFP_KERNEL);
+	left = kcalloc(nr_srcs, sizeof(*left), GFP_KERNEL);
+	if (!recs || !left)
+		goto out_nomem;
+
+	for (i = 0; i < nr_srcs; i++) {
+		size_t off = srcs[i]->old_log_size % record_size;
+
+		recs[i] = (struct pstore_ftrace_record *)
+			  (srcs[i]->old_log + off);
+		left[i] = (srcs[i]->old_log_size - off) / record_size;
+		total += left[i];
 	}
 
-	while (src_size > 0) {
-		mrec[merged_idx++] = srec[src_idx++];
-		src_size -= record_size;
+	dest->old_log = kmalloc(total * record_size, GFP_KERNEL);
+	if (!dest->old_log)
+		goto out_nomem;
+	dest->old_log_size = total * record_size;
+
+	mrec = (struct pstore_ftrace_record *)dest->old_log;
+	while (total--) {
+		min = nr_srcs;
+		for (i = 0; i < nr_srcs; i++) {
+			if (!left[i])
+				continue;
+			if (min == nr_srcs ||
+			    pstore_ftrace_read_timestamp(recs[i]) <
+			    pstore_ftrace_read_timestamp(recs[min]))
+				min = i;
+		}
+		*mrec++ = *recs[min]++;
+		left[min]--;
 	}
 
-	kfree(dest->old_log);
-	dest->old_log = merged_buf;
-	dest->old_log_size = total;
-
+	kfree(left);
+	kfree(recs);
 	return 0;
+
+out_nomem:
+	kfree(left);
+	kfree(recs);
+	return -ENOMEM;
 }
 
 static ssize_t ramoops_pstore_read(struct pstore_record *record)
@@ -272,6 +285,8 @@ static ssize_t ramoops_pstore_read(struct pstore_record *record)
 			 * per-cpu records including metadata and ecc info.
 			 */
 			struct persistent_ram_zone *tmp_prz, *prz_next;
+			struct persistent_ram_zone **srcs;
+			unsigned int nr_srcs = 0;
 
 			tmp_prz = kzalloc(sizeof(struct persistent_ram_zone),
 					  GFP_KERNEL);
@@ -280,6 +295,13 @@ static ssize_t ramoops_pstore_read(struct pstore_record *record)
 			prz = tmp_prz;
 			free_prz = true;
 
+			srcs = kcalloc(cxt->max_ftrace_cnt, sizeof(*srcs),
+				       GFP_KERNEL);
+			if (!srcs) {
+				size = -ENOMEM;
+				goto out;
+			}
+
 			while (cxt->ftrace_read_cnt < cxt->max_ftrace_cnt) {
 				prz_next = ramoops_get_next_prz(cxt->fprzs,
 						cxt->ftrace_read_cnt++, record);
@@ -291,10 +313,14 @@ static ssize_t ramoops_pstore_read(struct pstore_record *record)
 				tmp_prz->corrected_bytes +=
 						prz_next->corrected_bytes;
 				tmp_prz->bad_blocks += prz_next->bad_blocks;
-				size = ftrace_log_combine(tmp_prz, prz_next);
-				if (size)
-					goto out;
+				srcs[nr_srcs++] = prz_next;
 			}
+			if (nr_srcs)
+				size = ftrace_log_combine(tmp_prz, srcs,
+							  nr_srcs);
+			kfree(srcs);
+			if (size)
+				goto out;
 			record->id = 0;
 		}
 	}
@@ -614,11 +640,15 @@ static int ramoops_init_prz(const char *name,
 			    struct persistent_ram_zone **prz,
 			    phys_addr_t *paddr, size_t sz, u32 sig)
 {
+	u32 flags = PRZ_FLAG_ZAP_OLD;
 	char *label;
 
 	if (!sz)
 		return 0;
 
+	if (cxt->flags & RAMOOPS_FLAG_COMPRESS_LOGS)
+		flags |= PRZ_FLAG_COMPRESS;
+
 	if (*paddr + sz - cxt->phys_addr > cxt->size) {
 		dev_err(dev, "no room for %s mem region (0x%zx@0x%llx) in (0x%lx@0x%llx)\n",
 			name, sz, (unsigned long long)*paddr,
@@ -628,7 +658,7 @@ static int ramoops_init_prz(const char *name,
 
 	label = kasprintf(GFP_KERNEL, "ramoops:%s", name);
 	*prz = persistent_ram_new(*paddr, sz, sig, &cxt->ecc_info,
-				  cxt->memtype, PRZ_FLAG_ZAP_OLD, label);
+				  cxt->memtype, flags, label);
 	kfree(label);
 	if (IS_ERR(*prz)) {
 		int err = PTR_ERR(*prz);
@@ -705,6 +735,9 @@ static int ramoops_parse_dt(struct platform_device *pdev,
 
 #undef parse_size
 
+	if (of_property_read_bool(of_node, "compress-logs"))
+		pdata->flags |= RAMOOPS_FLAG_COMPRESS_LOGS;
+
 	/*
 	 * Some old Chromebooks relied on the kernel setting the
 	 * console_size and pmsg_size to the record size since that's
@@ -869,6 +902,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	ramoops_console_size = pdata->console_size;
 	ramoops_pmsg_size = pdata->pmsg_size;
 	ramoops_ftrace_size = pdata->ftrace_size;
+	ramoops_compress_logs = !!(pdata->flags & RAMOOPS_FLAG_COMPRESS_LOGS);
 
 	pr_info("using 0x%lx@0x%llx, ecc: %d\n",
 		cxt->size, (unsigned long long)cxt->phys_addr,
@@ -950,6 +984,8 @@ static void __init ramoops_register_dummy(void)
 	pdata.pmsg_size = ramoops_pmsg_size;
 	pdata.dump_oops = dump_oops;
 	pdata.flags = RAMOOPS_FLAG_FTRACE_PER_CPU;
+	if (ramoops_compress_logs)
+		pdata.flags |= RAMOOPS_FLAG_COMPRESS_LOGS;
 
 	/*
 	 * For backwards compatibility ramoops.ecc=1 means 16 bytes ECC
@@ -12,6 +12,7 @@
 #include <linux/io.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/lz4.h>
 #include <linux/memblock.h>
 #include <linux/pstore_ram.h>
 #include <linux/rslib.h>
@@ -39,6 +40,43 @@ struct persistent_ram_buffer {
 
 #define PERSISTENT_RAM_SIG (0x43474244) /* DBGC */
 
+/*
+ * A compressed zone (PRZ_FLAG_COMPRESS) ends in a stage that collects text
+ * until it is full.  The stage is then compressed into a frame that is
+ * written to the circular buffer in front of it.  Frames are compressed
+ * independently of each other, so the ones left after the buffer wrapped
+ * can still be read, and the text in the stage survives a crash like the
+ * frames do.
+ *
+ * @len:
+ *	number of bytes of text in @data
+ * @seq:
+ *	sequence number of the frame @data will go to
+ */
+struct persistent_ram_stage {
+	uint32_t    len;
+	uint32_t    seq;
+	uint8_t     data[0];
+};
+
+/*
+ * @zlen:
+ *	number of bytes in @data, which holds the text uncompressed if it
+ *	equals @len
+ * @len:
+ *	number of bytes of text
+ */
+struct persistent_ram_frame {
+	uint32_t    magic;
+	uint32_t    seq;
+	uint16_t    zlen;
+	uint16_t    len;
+	uint8_t     data[0];
+};
+
+#define PERSISTENT_RAM_FRAME_MAGIC (0x5a4c5a46) /* FZLZ */
+#define PERSISTENT_RAM_STAGE_SIZE 4096
+
 static inline size_t buffer_size(struct persistent_ram_zone *prz)
 {
 	return atomic_read(&prz->buffer->size);
@@ -49,50 +87,88 @@ static inline size_t buffer_start(struct persistent_ram_zone *prz)
 	return atomic_read(&prz->buffer->start);
 }
 
+/*
+ * Writers reserve their range of the buffer with cmpxchg on copies of the
+ * start and size kept in the zone, and then publish the new values to the
+ * buffer header.  Read-modify-write atomics cannot be used on the header
+ * itself, as the buffer may be mapped uncached or write-combined.  Writers
+ * on different CPUs thus never serialize on a lock, but the header may lag
+ * behind a racing writer for a moment, which at worst garbles the oldest
+ * record of a log that is recovered after a crash.  Zones with a single
+ * writer (PRZ_FLAG_NO_LOCK), such as per-CPU ftrace zones, need no cmpxchg
+ * and update the copies with plain stores.
+ */
+
 /* increase and wrap the start pointer, returning the old value */
 static size_t buffer_start_add(struct persistent_ram_zone *prz, size_t a)
 {
 	int old;
 	int new;
-	unsigned long flags = 0;
 
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_lock_irqsave(&prz->buffer_lock, flags);
-
-	old = atomic_read(&prz->buffer->start);
-	new = old + a;
-	while (unlikely(new >= prz->buffer_size))
-		new -= prz->buffer_size;
+	do {
+		old = atomic_read(&prz->cur_start);
+		new = old + a;
+		while (unlikely(new >= prz->buffer_size))
+			new -= prz->buffer_size;
+		if (prz->flags & PRZ_FLAG_NO_LOCK) {
+			atomic_set(&prz->cur_start, new);
+			break;
+		}
+	} while (unlikely(atomic_cmpxchg(&prz->cur_start, old, new) != old));
 	atomic_set(&prz->buffer->start, new);
 
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
-
 	return old;
 }
 
 /* increase the size counter until it hits the max size */
 static void buffer_size_add(struct persistent_ram_zone *prz, size_t a)
 {
-	size_t old;
-	size_t new;
-	unsigned long flags = 0;
+	int old;
+	int new;
 
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_lock_irqsave(&prz->buffer_lock, flags);
+	do {
+		old = atomic_read(&prz->cur_size);
+		if (old == prz->buffer_size)
+			return;
+		new = min_t(size_t, old + a, prz->buffer_size);
+		if (prz->flags & PRZ_FLAG_NO_LOCK) {
+			atomic_set(&prz->cur_size, new);
+			break;
+		}
+	} while (unlikely(atomic_cmpxchg(&prz->cur_size, old, new) != old));
+	atomic_set(&prz->buffer->size, new);
+}
 
-	old = atomic_read(&prz->buffer->size);
-	if (old == prz->buffer_size)
-		goto exit;
+static inline struct persistent_ram_stage *
+prz_stage(struct persistent_ram_zone *prz)
+{
+	return (struct persistent_ram_stage *)(prz->buffer->data +
+					       prz->buffer_size);
+}
 
-	new = old + a;
-	if (new > prz->buffer_size)
-		new = prz->buffer_size;
-	atomic_set(&prz->buffer->size, new);
+static inline size_t prz_stage_len(struct persistent_ram_zone *prz)
+{
+	if (!(prz->flags & PRZ_FLAG_COMPRESS))
+		return 0;
+	return prz_stage(prz)->len;
+}
 
-exit:
-	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
-		raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
+static void buffer_reset(struct persistent_ram_zone *prz)
+{
+	atomic_set(&prz->cur_start, buffer_start(prz));
+	atomic_set(&prz->cur_size, buffer_size(prz));
+}
+
+/*
+ * Writes to the same ECC block and the ECC workspace have to be serialized,
+ * unless the zone has only one writer.
+ */
+static bool prz_ecc_lock(struct persistent_ram_zone *prz, unsigned long *flags)
+{
+	if (!prz->ecc_info.ecc_size || (prz->flags & PRZ_FLAG_NO_LOCK))
+		return false;
+	raw_spin_lock_irqsave(&prz->buffer_lock, *flags);
+	return true;
 }
 
 static void notrace persistent_ram_encode_rs8(struct persistent_ram_zone *prz,
@@ -289,12 +365,108 @@ static int notrace persistent_ram_update_user(struct persistent_ram_zone *prz,
 	return ret;
 }
 
+/*
+ * Find the next intact frame at or after @off in @ring, the frames of a
+ * compressed zone in order.  The oldest frame may have been overwritten in
+ * part, so we resynchronize on the magic.
+ */
+static void *persistent_ram_next_frame(struct persistent_ram_zone *prz,
+	char *ring, size_t size, size_t *off,
+	struct persistent_ram_frame *frame)
+{
+	void *data;
+
+	for (; *off + sizeof(*frame) <= size; (*off)++) {
+		memcpy(frame, ring + *off, sizeof(*frame));
+		if (frame->magic != PERSISTENT_RAM_FRAME_MAGIC ||
+		    !frame->len || frame->len > prz->stage_size ||
+		    frame->zlen > frame->len ||
+		    *off + sizeof(*frame) + frame->zlen > size)
+			continue;
+
+		data = ring + *off + sizeof(*frame);
+		*off += sizeof(*frame) + frame->zlen;
+		return data;
+	}
+	return NULL;
+}
+
+/* Decompress the frames and the stage of a compressed zone into @old_log */
+static void persistent_ram_save_old_compressed(struct persistent_ram_zone *prz)
+{
+	struct persistent_ram_buffer *buffer = prz->buffer;
+	struct persistent_ram_stage *stage = prz_stage(prz);
+	struct persistent_ram_frame frame;
+	size_t size = buffer_size(prz);
+	size_t start = buffer_start(prz);
+	size_t stage_len = stage->len;
+	size_t off, total = 0, len = 0;
+	bool last_seq_valid = false;
+	uint32_t last_seq = 0;
+	char *ring, *log;
+	void *data;
+	int ret;
+
+	persistent_ram_free_old(prz);
+
+	ring = kvmalloc(size ?: 1, GFP_KERNEL);
+	if (!ring) {
+		pr_err("failed to allocate buffer\n");
+		return;
+	}
+	memcpy_fromio(ring, &buffer->data[start], size - start);
+	memcpy_fromio(ring + size - start, &buffer->data[0], start);
+
+	off = 0;
+	while (persistent_ram_next_frame(prz, ring, size, &off, &frame)) {
+		total += frame.len;
+		last_seq = frame.seq;
+		last_seq_valid = true;
+	}
+	/* The text in the stage already went to the last frame */
+	if (last_seq_valid && last_seq == stage->seq)
+		stage_len = 0;
+	total += stage_len;
+
+	log = total ? kvmalloc(total, GFP_KERNEL) : NULL;
+	if (!log) {
+		if (total)
+			pr_err("failed to allocate buffer\n");
+		kvfree(ring);
+		return;
+	}
+
+	off = 0;
+	while ((data = persistent_ram_next_frame(prz, ring, size, &off,
+						 &frame))) {
+		if (frame.zlen == frame.len) {
+			memcpy(log + len, data, frame.len);
+			ret = frame.len;
+		} else {
+			ret = LZ4_decompress_safe(data, log + len, frame.zlen,
+						  frame.len);
+		}
+		if (ret == frame.len)
+			len += ret;
+	}
+	memcpy_fromio(log + len, stage->data, stage_len);
+	kvfree(ring);
+
+	prz->old_log = log;
+	prz->old_log_size = len + stage_len;
+}
+
 void persistent_ram_save_old(struct persistent_ram_zone *prz)
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
 	size_t size = buffer_size(prz);
 	size_t start = buffer_start(prz);
 
+	if (prz->flags & PRZ_FLAG_COMPRESS) {
+		persistent_ram_save_old_compressed(prz);
+		return;
+	}
+
 	if (!size)
 		return;
 
@@ -312,12 +484,16 @@ void persistent_ram_save_old(struct persistent_ram_zone *prz)
 	memcpy_fromio(prz->old_log + size - start, &buffer->data[0], start);
 }
 
-int notrace persistent_ram_write(struct persistent_ram_zone *prz,
+static int notrace __persistent_ram_write(struct persistent_ram_zone *prz,
 	const void *s, unsigned int count)
 {
 	int rem;
 	int c = count;
 	size_t start;
+	unsigned long flags = 0;
+	bool locked;
+
+	locked = prz_ecc_lock(prz, &flags);
 
 	if (unlikely(c > prz->buffer_size)) {
 		s += c - prz->buffer_size;
@@ -339,9 +515,81 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 
 	persistent_ram_update_header_ecc(prz);
 
+	if (locked)
+		raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
+
 	return count;
 }
 
+/* Compress the full stage of a compressed zone into a new frame */
+static void notrace persistent_ram_flush_stage(struct persistent_ram_zone *prz)
+{
+	struct persistent_ram_stage *stage = prz_stage(prz);
+	struct persistent_ram_frame *frame = prz->zframe;
+	unsigned int len = stage->len;
+	int zlen;
+
+	/* Compress a copy, as the stage may be mapped uncached */
+	memcpy_fromio(prz->ztext, stage->data, len);
+	zlen = LZ4_compress_default(prz->ztext, (char *)frame->data, len,
+				    len - 1, prz->zwrkmem);
+	if (zlen <= 0) {
+		memcpy(frame->data, prz->ztext, len);
+		zlen = len;
+	}
+	frame->magic = PERSISTENT_RAM_FRAME_MAGIC;
+	frame->seq = stage->seq;
+	frame->zlen = zlen;
+	frame->len = len;
+	__persistent_ram_write(prz, frame, sizeof(*frame) + zlen);
+
+	/*
+	 * Until the stage is emptied, its sequence number tells that its text
+	 * is in the last frame already, so a crash in between duplicates none.
+	 */
+	wmb();
+	stage->len = 0;
+	wmb();
+	stage->seq++;
+}
+
+static int notrace persistent_ram_write_stage(struct persistent_ram_zone *prz,
+	const void *s, unsigned int count)
+{
+	struct persistent_ram_stage *stage = prz_stage(prz);
+	unsigned long flags;
+	unsigned int c, len;
+	int ret = count;
+
+	raw_spin_lock_irqsave(&prz->buffer_lock, flags);
+	while (count) {
+		len = stage->len;
+		c = min_t(unsigned int, count, prz->stage_size - len);
+		memcpy_toio(stage->data + len, s, c);
+		wmb();
+		stage->len = len + c;
+		if (len + c == prz->stage_size)
+			persistent_ram_flush_stage(prz);
+		s += c;
+		count -= c;
+	}
+	raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
+
+	return ret;
+}
+
+int notrace persistent_ram_write(struct persistent_ram_zone *prz,
+	const void *s, unsigned int count)
+{
+	if (prz->flags & PRZ_FLAG_COMPRESS)
+		return persistent_ram_write_stage(prz, s, count);
+	return __persistent_ram_write(prz, s, count);
+}
+
+/*
+ * Copying from user space may fault, so the ECC lock cannot be held here;
+ * the only user, pmsg, serializes its writers itself.
+ */
 int notrace persistent_ram_write_user(struct persistent_ram_zone *prz,
 	const void __user *s, unsigned int count)
 {
@@ -350,6 +598,22 @@ int notrace persistent_ram_write_user(struct persistent_ram_zone *prz,
 
 	if (unlikely(!access_ok(s, count)))
 		return -EFAULT;
+
+	if (prz->flags & PRZ_FLAG_COMPRESS) {
+		char buf[256];
+
+		/* The stage is written under a spinlock, so bounce the data */
+		while (c) {
+			rem = min_t(int, c, sizeof(buf));
+			if (unlikely(__copy_from_user(buf, s, rem)))
+				return -EFAULT;
+			persistent_ram_write_stage(prz, buf, rem);
+			s += rem;
+			c -= rem;
+		}
+		return count;
+	}
+
 	if (unlikely(c > prz->buffer_size)) {
 		s += c - prz->buffer_size;
 		c = prz->buffer_size;
@@ -386,7 +650,7 @@ void *persistent_ram_old(struct persistent_ram_zone *prz)
 
 void persistent_ram_free_old(struct persistent_ram_zone *prz)
 {
-	kfree(prz->old_log);
+	kvfree(prz->old_log);
 	prz->old_log = NULL;
 	prz->old_log_size = 0;
 }
@@ -395,6 +659,11 @@ void persistent_ram_zap(struct persistent_ram_zone *prz)
 {
 	atomic_set(&prz->buffer->start, 0);
 	atomic_set(&prz->buffer->size, 0);
+	if (prz->flags & PRZ_FLAG_COMPRESS) {
+		prz_stage(prz)->len = 0;
+		prz_stage(prz)->seq = 0;
+	}
+	buffer_reset(prz);
 	persistent_ram_update_header_ecc(prz);
 }
 
@@ -487,6 +756,43 @@ static int persistent_ram_buffer_map(phys_addr_t start, phys_addr_t size,
 	return 0;
 }
 
+/*
+ * Set aside the stage of a compressed zone.  ECC is not supported for
+ * compressed zones.
+ */
+static int persistent_ram_init_compress(struct persistent_ram_zone *prz,
+					struct persistent_ram_ecc_info *ecc_info)
+{
+	size_t stage_size;
+
+	if (!(prz->flags & PRZ_FLAG_COMPRESS))
+		return 0;
+
+	stage_size = min_t(size_t, PERSISTENT_RAM_STAGE_SIZE,
+			   prz->buffer_size / 4);
+	if ((ecc_info && ecc_info->ecc_size) ||
+	    stage_size <= sizeof(struct persistent_ram_stage)) {
+		pr_info("%s: not compressing, %s\n", prz->label,
+			stage_size > sizeof(struct persistent_ram_stage) ?
+			"ECC in use" : "zone too small");
+		prz->flags &= ~PRZ_FLAG_COMPRESS;
+		return 0;
+	}
+
+	prz->stage_size = stage_size - sizeof(struct persistent_ram_stage);
+	prz->zwrkmem = kmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+	prz->ztext = kmalloc(prz->stage_size, GFP_KERNEL);
+	prz->zframe = kmalloc(sizeof(struct persistent_ram_frame) +
+			      prz->stage_size, GFP_KERNEL);
+	if (!prz->zwrkmem || !prz->ztext || !prz->zframe) {
+		pr_err("cannot allocate compression buffers\n");
+		return -ENOMEM;
+	}
+
+	prz->buffer_size -= stage_size;
+	return 0;
+}
+
 static int persistent_ram_post_init(struct persistent_ram_zone *prz, u32 sig,
 				    struct persistent_ram_ecc_info *ecc_info)
 {
@@ -500,15 +806,19 @@ static int persistent_ram_post_init(struct persistent_ram_zone *prz, u32 sig,
 	}
 
 	sig ^= PERSISTENT_RAM_SIG;
+	if (prz->flags & PRZ_FLAG_COMPRESS)
+		sig ^= PERSISTENT_RAM_FRAME_MAGIC;
 
 	if (prz->buffer->sig == sig) {
-		if (buffer_size(prz) == 0) {
+		if (buffer_size(prz) == 0 && prz_stage_len(prz) == 0) {
 			pr_debug("found existing empty buffer\n");
+			buffer_reset(prz);
 			return 0;
 		}
 
 		if (buffer_size(prz) > prz->buffer_size ||
-		    buffer_start(prz) > buffer_size(prz)) {
+		    buffer_start(prz) > buffer_size(prz) ||
+		    prz_stage_len(prz) > prz->stage_size) {
 			pr_info("found existing invalid buffer, size %zu, start %zu\n",
 				buffer_size(prz), buffer_start(prz));
 			zap = true;
@@ -527,6 +837,8 @@ static int persistent_ram_post_init(struct persistent_ram_zone *prz, u32 sig,
 	/* Reset missing, invalid, or single-use memory area. */
 	if (zap)
 		persistent_ram_zap(prz);
+	else
+		buffer_reset(prz);
 
 	return 0;
 }
@@ -552,6 +864,9 @@ void persistent_ram_free(struct persistent_ram_zone *prz)
 	}
 	kfree(prz->ecc_info.par);
 	prz->ecc_info.par = NULL;
+	kfree(prz->zwrkmem);
+	kfree(prz->ztext);
+	kfree(prz->zframe);
 
 	persistent_ram_free_old(prz);
 	kfree(prz->label);
@@ -580,6 +895,10 @@ struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
 	if (ret)
 		goto err;
 
+	ret = persistent_ram_init_compress(prz, ecc_info);
+	if (ret)
+		goto err;
+
 	ret = persistent_ram_post_init(prz, sig, ecc_info);
 	if (ret)
 		goto err;
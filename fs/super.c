@@ -162,6 +162,7 @@ static void destroy_super_work(struct work_struct *work)
 
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_free_rwsem(&s->s_writers.rw_sem[i]);
+	percpu_counter_destroy(&s->s_nr_dentry_negative);
 	kfree(s);
 }
 
@@ -238,6 +239,9 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags,
 			goto fail;
 	}
 	init_waitqueue_head(&s->s_writers.wait_unfrozen);
+	if (percpu_counter_init(&s->s_nr_dentry_negative, 0, GFP_KERNEL))
+		goto fail;
+	INIT_WORK(&s->s_dentry_trim_work, prune_dcache_negative);
 	s->s_bdi = &noop_backing_dev_info;
 	s->s_flags = flags;
 	if (s->s_user_ns != &init_user_ns)
@@ -333,6 +337,7 @@ void deactivate_locked_super(struct super_block *s)
 		cleancache_invalidate_fs(s);
 		unregister_shrinker(&s->s_shrink);
 		fs->kill_sb(s);
+		cancel_work_sync(&s->s_dentry_trim_work);
 
 		/*
 		 * Since list_lru_destroy() may sleep, we cannot call it from
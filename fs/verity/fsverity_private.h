@@ -68,13 +68,26 @@ struct merkle_tree_params {
  * and stored in ->i_verity_info; it remains until the inode is evicted.  It
  * caches information about the Merkle tree that's needed to efficiently verify
  * data read from the file.  It also caches the file measurement.  The Merkle
- * tree pages themselves are not cached here, but the filesystem may cache them.
+ * tree pages themselves are cached by the filesystem, except that copies of
+ * the blocks of the top few levels may be pinned here once they're verified.
  */
 struct fsverity_info {
 	struct merkle_tree_params tree_params;
 	u8 root_hash[FS_VERITY_MAX_DIGEST_SIZE];
 	u8 measurement[FS_VERITY_MAX_DIGEST_SIZE];
 	const struct inode *inode;
+
+	/*
+	 * One bit per Merkle tree block, set once the block is verified.  For
+	 * a pinned block the bit means its copy in ->pinned_blocks is valid;
+	 * otherwise it is only valid while the block's page stays cached.
+	 */
+	unsigned long *hash_block_verified;
+	spinlock_t hash_page_init_lock;
+
+	/* Copies of tree blocks [0, num_pinned_blocks), i.e. the top levels */
+	u8 *pinned_blocks;
+	unsigned long num_pinned_blocks;
 };
 
 /*
@@ -7,10 +7,20 @@
 
 #include "fsverity_private.h"
 
+#include <linux/moduleparam.h>
 #include <linux/slab.h>
 
 static struct kmem_cache *fsverity_info_cachep;
 
+static unsigned int pinned_tree_blocks;
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "fsverity."
+
+module_param(pinned_tree_blocks, uint, 0644);
+MODULE_PARM_DESC(pinned_tree_blocks,
+		 "Max number of top Merkle tree blocks to keep in memory per file");
+
 /**
  * fsverity_init_merkle_tree_params() - initialize Merkle tree parameters
  * @params: the parameters struct to initialize
@@ -141,6 +151,45 @@ static int compute_file_measurement(struct fsverity_hash_alg *hash_alg,
 	return err;
 }
 
+/*
+ * Allocate the bitmap of verified Merkle tree blocks, and room for the pinned
+ * copies of as many whole levels from the root down as pinned_tree_blocks
+ * allows.  The top levels are stored first, so they are blocks [0, n).
+ */
+static int alloc_verified_state(struct fsverity_info *vi)
+{
+	const struct merkle_tree_params *params = &vi->tree_params;
+	unsigned long num_blocks = params->tree_size >> params->log_blocksize;
+	unsigned int limit = READ_ONCE(pinned_tree_blocks);
+	int level;
+
+	spin_lock_init(&vi->hash_page_init_lock);
+	if (!num_blocks)
+		return 0;
+
+	vi->hash_block_verified = kvcalloc(BITS_TO_LONGS(num_blocks),
+					   sizeof(unsigned long), GFP_KERNEL);
+	if (!vi->hash_block_verified)
+		return -ENOMEM;
+
+	for (level = params->num_levels - 1; level >= 0; level--) {
+		u64 end = level ? params->level_start[level - 1] : num_blocks;
+
+		if (end > limit)
+			break;
+		vi->num_pinned_blocks = end;
+	}
+	if (vi->num_pinned_blocks) {
+		vi->pinned_blocks = kvmalloc(vi->num_pinned_blocks <<
+					     params->log_blocksize, GFP_KERNEL);
+		if (!vi->pinned_blocks)
+			return -ENOMEM;
+	}
+	pr_debug("Pinning %lu of %lu Merkle tree blocks\n",
+		 vi->num_pinned_blocks, num_blocks);
+	return 0;
+}
+
 /*
  * Validate the given fsverity_descriptor and create a new fsverity_info from
  * it.  The signature (if present) is also checked.
@@ -199,6 +248,10 @@ struct fsverity_info *fsverity_create_info(const struct inode *inode,
 
 	memcpy(vi->root_hash, desc->root_hash, vi->tree_params.digest_size);
 
+	err = alloc_verified_state(vi);
+	if (err)
+		goto out;
+
 	err = compute_file_measurement(vi->tree_params.hash_alg, desc,
 				       vi->measurement);
 	if (err) {
@@ -233,6 +286,8 @@ void fsverity_free_info(struct fsverity_info *vi)
 	if (!vi)
 		return;
 	kfree(vi->tree_params.hashstate);
+	kvfree(vi->hash_block_verified);
+	kvfree(vi->pinned_blocks);
 	kmem_cache_free(fsverity_info_cachep, vi);
 }
 
@@ -9,10 +9,29 @@
 
 #include <crypto/hash.h>
 #include <linux/bio.h>
+#include <linux/moduleparam.h>
 #include <linux/ratelimit.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 
 static struct workqueue_struct *fsverity_read_workqueue;
 
+/* Runs the parts of big bios split off by fsverity_verify_bio() */
+static struct workqueue_struct *fsverity_verify_workqueue;
+static unsigned int fsverity_verify_max_active;
+
+static unsigned int verify_workers;
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "fsverity."
+
+module_param(verify_workers, uint, 0444);
+MODULE_PARM_DESC(verify_workers,
+		 "Max number of parts of bios verified at once (default: number of CPUs)");
+
+/* Bios are not split into parts smaller than this */
+#define FS_VERITY_MIN_PAGES_PER_PART	16
+
 /**
  * hash_at_level() - compute the location of the block's hash at the given level
  *
@@ -66,26 +85,101 @@ static inline int cmp_hashes(const struct fsverity_info *vi,
 	return -EBADMSG;
 }
 
+/* Counts of one verification call, added to the sb's totals at the end */
+struct verify_stats {
+	unsigned long verified_blocks;
+	unsigned long hash_reads;
+	unsigned long hash_reads_saved;
+	unsigned long hash_ops;
+	unsigned long hash_ops_saved;
+};
+
+static void add_verify_stats(struct super_block *sb,
+			     const struct verify_stats *vs)
+{
+	struct fsverity_stats *stats = &sb->s_verity_stats;
+
+	atomic64_add(vs->verified_blocks, &stats->verified_blocks);
+	atomic64_add(vs->hash_reads, &stats->hash_reads);
+	atomic64_add(vs->hash_reads_saved, &stats->hash_reads_saved);
+	atomic64_add(vs->hash_ops, &stats->hash_ops);
+	atomic64_add(vs->hash_ops_saved, &stats->hash_ops_saved);
+}
+
+/*
+ * Is the hash block @hindex, which is in @hpage, already verified?
+ *
+ * A block's bit in ->hash_block_verified is only meaningful while the page it
+ * was verified in stays cached: a page read back in after eviction may not
+ * hold what was verified before.  So the first time a page is seen since it
+ * was read, its block's bit is cleared, and PageChecked is set to note that
+ * this has been done.  The spinlock keeps a bit set by a racing verifier from
+ * being cleared after the fact.
+ */
+static bool is_hash_block_verified(struct fsverity_info *vi,
+				   struct page *hpage, pgoff_t hindex)
+{
+	bool verified;
+
+	if (PageChecked(hpage)) {
+		/* pairs with the smp_wmb() below */
+		smp_rmb();
+		return test_bit(hindex, vi->hash_block_verified);
+	}
+
+	spin_lock(&vi->hash_page_init_lock);
+	if (PageChecked(hpage)) {
+		verified = test_bit(hindex, vi->hash_block_verified);
+	} else {
+		clear_bit(hindex, vi->hash_block_verified);
+		smp_wmb();
+		SetPageChecked(hpage);
+		verified = false;
+	}
+	spin_unlock(&vi->hash_page_init_lock);
+	return verified;
+}
+
+/* Record that the hash block @hindex, which is in @hpage, has been verified */
+static void set_hash_block_verified(struct fsverity_info *vi,
+				    struct page *hpage, pgoff_t hindex)
+{
+	const unsigned int log_blocksize = vi->tree_params.log_blocksize;
+
+	if (hindex < vi->num_pinned_blocks) {
+		void *virt = kmap_atomic(hpage);
+
+		memcpy(vi->pinned_blocks + (hindex << log_blocksize), virt,
+		       1 << log_blocksize);
+		kunmap_atomic(virt);
+		/* pairs with the smp_rmb() in verify_page() */
+		smp_wmb();
+	}
+	set_bit(hindex, vi->hash_block_verified);
+}
+
 /*
  * Verify a single data page against the file's Merkle tree.
  *
  * In principle, we need to verify the entire path to the root node.  However,
  * for efficiency the filesystem may cache the hash pages.  Therefore we need
- * only ascend the tree until an already-verified page is seen, as indicated by
- * the PageChecked bit being set; then verify the path to that page.
+ * only ascend the tree until an already-verified hash block is seen, as
+ * indicated by its bit in ->hash_block_verified; then verify the path to that
+ * block.  Blocks of the pinned top levels are taken from their in-memory copy
+ * once verified, so they are neither read nor hashed again even if the
+ * filesystem evicts their pages.
  *
  * This code currently only supports the case where the verity block size is
- * equal to PAGE_SIZE.  Doing otherwise would be possible but tricky, since we
- * wouldn't be able to use the PageChecked bit.
+ * equal to PAGE_SIZE.
  *
- * Note that multiple processes may race to verify a hash page and mark it
- * Checked, but it doesn't matter; the result will be the same either way.
+ * Note that multiple processes may race to verify a hash block and mark it
+ * verified, but it doesn't matter; the result will be the same either way.
  *
  * Return: true if the page is valid, else false.
  */
-static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
+static bool verify_page(struct inode *inode, struct fsverity_info *vi,
 			struct ahash_request *req, struct page *data_page,
-			unsigned long level0_ra_pages)
+			unsigned long level0_ra_pages, struct verify_stats *vs)
 {
 	const struct merkle_tree_params *params = &vi->tree_params;
 	const unsigned int hsize = params->digest_size;
@@ -95,6 +189,7 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 	const u8 *want_hash;
 	u8 real_hash[FS_VERITY_MAX_DIGEST_SIZE];
 	struct page *hpages[FS_VERITY_MAX_LEVELS];
+	pgoff_t hindexes[FS_VERITY_MAX_LEVELS];
 	unsigned int hoffsets[FS_VERITY_MAX_LEVELS];
 	int err;
 
@@ -105,8 +200,8 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 
 	/*
 	 * Starting at the leaf level, ascend the tree saving hash pages along
-	 * the way until we find a verified hash page, indicated by PageChecked;
-	 * or until we reach the root.
+	 * the way until we find a verified hash block; or until we reach the
+	 * root.
 	 */
 	for (level = 0; level < params->num_levels; level++) {
 		pgoff_t hindex;
@@ -118,6 +213,21 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 		pr_debug_ratelimited("Level %d: hindex=%lu, hoffset=%u\n",
 				     level, hindex, hoffset);
 
+		if (hindex < vi->num_pinned_blocks &&
+		    test_bit(hindex, vi->hash_block_verified)) {
+			/* pairs with the smp_wmb() in set_hash_block_verified() */
+			smp_rmb();
+			memcpy(_want_hash, vi->pinned_blocks +
+			       (hindex << params->log_blocksize) + hoffset,
+			       hsize);
+			want_hash = _want_hash;
+			vs->hash_reads_saved++;
+			pr_debug_ratelimited("Hash block pinned, want %s:%*phN\n",
+					     params->hash_alg->name,
+					     hsize, want_hash);
+			goto descend;
+		}
+
 		hpage = inode->i_sb->s_vop->read_merkle_tree_page(inode, hindex,
 				level == 0 ? level0_ra_pages : 0);
 		if (IS_ERR(hpage)) {
@@ -127,18 +237,20 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 				     err, hindex);
 			goto out;
 		}
+		vs->hash_reads++;
 
-		if (PageChecked(hpage)) {
+		if (is_hash_block_verified(vi, hpage, hindex)) {
 			extract_hash(hpage, hoffset, hsize, _want_hash);
 			want_hash = _want_hash;
 			put_page(hpage);
-			pr_debug_ratelimited("Hash page already checked, want %s:%*phN\n",
+			pr_debug_ratelimited("Hash block already verified, want %s:%*phN\n",
 					     params->hash_alg->name,
 					     hsize, want_hash);
 			goto descend;
 		}
-		pr_debug_ratelimited("Hash page not yet checked\n");
+		pr_debug_ratelimited("Hash block not yet verified\n");
 		hpages[level] = hpage;
+		hindexes[level] = hindex;
 		hoffsets[level] = hoffset;
 	}
 
@@ -146,6 +258,9 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 	pr_debug("Want root hash: %s:%*phN\n",
 		 params->hash_alg->name, hsize, want_hash);
 descend:
+	/* The levels from here up to the root need no hashing this time */
+	vs->hash_ops_saved += params->num_levels - level;
+
 	/* Descend the tree verifying hash pages */
 	for (; level > 0; level--) {
 		struct page *hpage = hpages[level - 1];
@@ -154,10 +269,11 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 		err = fsverity_hash_page(params, inode, req, hpage, real_hash);
 		if (err)
 			goto out;
+		vs->hash_ops++;
 		err = cmp_hashes(vi, want_hash, real_hash, index, level - 1);
 		if (err)
 			goto out;
-		SetPageChecked(hpage);
+		set_hash_block_verified(vi, hpage, hindexes[level - 1]);
 		extract_hash(hpage, hoffset, hsize, _want_hash);
 		want_hash = _want_hash;
 		put_page(hpage);
@@ -169,7 +285,10 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 	err = fsverity_hash_page(params, inode, req, data_page, real_hash);
 	if (err)
 		goto out;
+	vs->hash_ops++;
 	err = cmp_hashes(vi, want_hash, real_hash, index, -1);
+	if (!err)
+		vs->verified_blocks++;
 out:
 	for (; level > 0; level--)
 		put_page(hpages[level - 1]);
@@ -189,22 +308,99 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 bool fsverity_verify_page(struct page *page)
 {
 	struct inode *inode = page->mapping->host;
-	const struct fsverity_info *vi = inode->i_verity_info;
+	struct fsverity_info *vi = inode->i_verity_info;
+	struct verify_stats vs = {};
 	struct ahash_request *req;
 	bool valid;
 
 	/* This allocation never fails, since it's mempool-backed. */
 	req = fsverity_alloc_hash_request(vi->tree_params.hash_alg, GFP_NOFS);
 
-	valid = verify_page(inode, vi, req, page, 0);
+	valid = verify_page(inode, vi, req, page, 0, &vs);
 
 	fsverity_free_hash_request(vi->tree_params.hash_alg, req);
+	add_verify_stats(inode->i_sb, &vs);
 
 	return valid;
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_page);
 
 #ifdef CONFIG_BLOCK
+/*
+ * Start reading all the Merkle tree pages that data pages @first..@last will
+ * need, one range per level, so that the hash pages of a big bio are read with
+ * a few large I/Os up front rather than one at a time as verification gets to
+ * them.  Level 0 additionally reads ahead @max_ra_pages pages.  Pinned levels
+ * are skipped, as they are normally found in memory.
+ */
+static void prefetch_hash_pages(struct inode *inode,
+				const struct fsverity_info *vi,
+				pgoff_t first, pgoff_t last,
+				unsigned long max_ra_pages)
+{
+	const struct merkle_tree_params *params = &vi->tree_params;
+	int level;
+
+	for (level = 0; level < params->num_levels; level++) {
+		pgoff_t hfirst, hlast;
+		unsigned int hoffset;
+		unsigned long nr;
+		struct page *hpage;
+
+		hash_at_level(params, first, level, &hfirst, &hoffset);
+		hash_at_level(params, last, level, &hlast, &hoffset);
+		if (hlast < vi->num_pinned_blocks)
+			break;
+
+		nr = hlast - hfirst + 1;
+		if (level == 0)
+			nr = max(nr, min(max_ra_pages, params->level0_blocks -
+					 (first >> params->log_arity)));
+
+		hpage = inode->i_sb->s_vop->read_merkle_tree_page(inode, hfirst,
+								  nr);
+		if (!IS_ERR(hpage))
+			put_page(hpage);
+	}
+}
+
+/* A run of pages of a bio being verified, possibly by another CPU */
+struct verify_bio_part {
+	struct work_struct work;
+	struct bio *bio;
+	struct inode *inode;
+	struct fsverity_info *vi;
+	struct ahash_request *req;
+	unsigned int first;		/* index of the first page in the bio */
+	unsigned int nr_pages;
+	struct verify_stats vs;
+};
+
+static void verify_bio_part(struct verify_bio_part *part)
+{
+	struct bio_vec *bv;
+	struct bvec_iter_all iter_all;
+	unsigned int i = 0;
+
+	bio_for_each_segment_all(bv, part->bio, iter_all) {
+		struct page *page = bv->bv_page;
+
+		if (i++ < part->first)
+			continue;
+		if (i > part->first + part->nr_pages)
+			break;
+		if (!PageError(page) &&
+		    !verify_page(part->inode, part->vi, part->req, page, 0,
+				 &part->vs))
+			SetPageError(page);
+	}
+}
+
+static void verify_bio_part_work(struct work_struct *work)
+{
+	verify_bio_part(container_of(work, struct verify_bio_part, work));
+}
+
 /**
  * fsverity_verify_bio() - verify a 'read' bio that has just completed
  * @bio: the bio to verify
@@ -219,19 +415,31 @@ EXPORT_SYMBOL_GPL(fsverity_verify_page);
  * populate the page cache without issuing bios (e.g. non block-based
  * filesystems) must instead call fsverity_verify_page() directly on each page.
  * All filesystems must also call fsverity_verify_page() on holes.
+ *
+ * Big bios are split into parts that are verified in parallel on the
+ * fsverity_verify_queue workqueue, whose concurrency is set by the
+ * verify_workers parameter.  This must be called from process context.
  */
 void fsverity_verify_bio(struct bio *bio)
 {
 	struct inode *inode = bio_first_page_all(bio)->mapping->host;
-	const struct fsverity_info *vi = inode->i_verity_info;
+	struct fsverity_info *vi = inode->i_verity_info;
 	const struct merkle_tree_params *params = &vi->tree_params;
-	struct ahash_request *req;
+	struct verify_bio_part part0 = { .bio = bio, .inode = inode, .vi = vi };
+	struct verify_bio_part *parts = NULL;
 	struct bio_vec *bv;
 	struct bvec_iter_all iter_all;
+	unsigned int nr_pages = 0, nr_parts, per_part, i;
+	pgoff_t last_index = 0;
 	unsigned long max_ra_pages = 0;
 
 	/* This allocation never fails, since it's mempool-backed. */
-	req = fsverity_alloc_hash_request(params->hash_alg, GFP_NOFS);
+	part0.req = fsverity_alloc_hash_request(params->hash_alg, GFP_NOFS);
+
+	bio_for_each_segment_all(bv, bio, iter_all) {
+		last_index = bv->bv_page->index;
+		nr_pages++;
+	}
 
 	if (bio->bi_opf & REQ_RAHEAD) {
 		/*
@@ -243,27 +451,97 @@ void fsverity_verify_bio(struct bio *bio)
 		 * This improves sequential read performance, as it greatly
 		 * reduces the number of I/O requests made to the Merkle tree.
 		 */
-		bio_for_each_segment_all(bv, bio, iter_all)
-			max_ra_pages++;
-		max_ra_pages /= 4;
+		max_ra_pages = nr_pages / 4;
 	}
+	prefetch_hash_pages(inode, vi, bio_first_page_all(bio)->index,
+			    last_index, max_ra_pages);
 
-	bio_for_each_segment_all(bv, bio, iter_all) {
-		struct page *page = bv->bv_page;
-		unsigned long level0_index = page->index >> params->log_arity;
-		unsigned long level0_ra_pages =
-			min(max_ra_pages, params->level0_blocks - level0_index);
-
-		if (!PageError(page) &&
-		    !verify_page(inode, vi, req, page, level0_ra_pages))
-			SetPageError(page);
+	/*
+	 * Split big bios into parts verified on other CPUs, each part needing
+	 * a hash request of its own.  Only the first request is guaranteed, so
+	 * the others are allocated without waiting; if one can't be had, the
+	 * bio just gets split into fewer parts.
+	 */
+	nr_parts = min(nr_pages / FS_VERITY_MIN_PAGES_PER_PART,
+		       fsverity_verify_max_active + 1);
+	if (nr_parts > 1)
+		parts = kcalloc(nr_parts - 1, sizeof(*parts),
+				GFP_NOWAIT | __GFP_NOWARN);
+	if (!parts)
+		nr_parts = 1;
+	for (i = 1; i < nr_parts; i++) {
+		parts[i - 1].req = fsverity_alloc_hash_request(params->hash_alg,
+						GFP_NOWAIT | __GFP_NOWARN);
+		if (!parts[i - 1].req) {
+			nr_parts = i;
+			break;
+		}
 	}
 
-	fsverity_free_hash_request(params->hash_alg, req);
+	per_part = DIV_ROUND_UP(nr_pages, nr_parts);
+	for (i = 1; i < nr_parts; i++) {
+		struct verify_bio_part *part = &parts[i - 1];
+
+		if (i * per_part >= nr_pages) {
+			/* Rounding left nothing for this part */
+			fsverity_free_hash_request(params->hash_alg, part->req);
+			part->req = NULL;
+			continue;
+		}
+		part->bio = bio;
+		part->inode = inode;
+		part->vi = vi;
+		part->first = i * per_part;
+		part->nr_pages = min(per_part, nr_pages - part->first);
+		INIT_WORK(&part->work, verify_bio_part_work);
+		queue_work(fsverity_verify_workqueue, &part->work);
+	}
+	part0.nr_pages = min(per_part, nr_pages);
+	verify_bio_part(&part0);
+
+	fsverity_free_hash_request(params->hash_alg, part0.req);
+	for (i = 1; i < nr_parts; i++) {
+		struct verify_bio_part *part = &parts[i - 1];
+
+		if (!part->req)
+			continue;
+		flush_work(&part->work);
+		fsverity_free_hash_request(params->hash_alg, part->req);
+		add_verify_stats(inode->i_sb, &part->vs);
+	}
+	add_verify_stats(inode->i_sb, &part0.vs);
+	kfree(parts);
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_bio);
 #endif /* CONFIG_BLOCK */
 
+/**
+ * fsverity_seq_stats_show() - show a filesystem's fs-verity statistics
+ * @seq: the seq_file, whose ->private is the super_block
+ * @offset: unused
+ *
+ * For use with proc_create_single_data() by filesystems that support verity.
+ *
+ * Return: 0
+ */
+int fsverity_seq_stats_show(struct seq_file *seq, void *offset)
+{
+	struct super_block *sb = seq->private;
+	struct fsverity_stats *stats = &sb->s_verity_stats;
+
+	seq_printf(seq, "verified_blocks: %lld\n",
+		   atomic64_read(&stats->verified_blocks));
+	seq_printf(seq, "hash_block_reads: %lld\n",
+		   atomic64_read(&stats->hash_reads));
+	seq_printf(seq, "hash_block_reads_saved: %lld\n",
+		   atomic64_read(&stats->hash_reads_saved));
+	seq_printf(seq, "hash_ops: %lld\n", atomic64_read(&stats->hash_ops));
+	seq_printf(seq, "hash_ops_saved: %lld\n",
+		   atomic64_read(&stats->hash_ops_saved));
+	return 0;
+}
+EXPORT_SYMBOL_GPL(fsverity_seq_stats_show);
+
 /**
  * fsverity_enqueue_verify_work() - enqueue work on the fs-verity workqueue
  * @work: the work to enqueue
@@ -291,11 +569,30 @@ int __init fsverity_init_workqueue(void)
 						  num_online_cpus());
 	if (!fsverity_read_workqueue)
 		return -ENOMEM;
+
+	/*
+	 * The parts of a bio are queued from fsverity_read_workqueue work and
+	 * waited for there, so they need a workqueue of their own.
+	 */
+	fsverity_verify_max_active = verify_workers ?: num_online_cpus();
+	fsverity_verify_max_active = min_t(unsigned int,
+					   fsverity_verify_max_active,
+					   WQ_UNBOUND_MAX_ACTIVE);
+	fsverity_verify_workqueue = alloc_workqueue("fsverity_verify_queue",
+						    WQ_UNBOUND | WQ_HIGHPRI,
+						    fsverity_verify_max_active);
+	if (!fsverity_verify_workqueue) {
+		destroy_workqueue(fsverity_read_workqueue);
+		fsverity_read_workqueue = NULL;
+		return -ENOMEM;
+	}
 	return 0;
 }
 
 void __init fsverity_exit_workqueue(void)
 {
+	destroy_workqueue(fsverity_verify_workqueue);
+	fsverity_verify_workqueue = NULL;
 	destroy_workqueue(fsverity_read_workqueue);
 	fsverity_read_workqueue = NULL;
 }
@@ -304,10 +304,33 @@ static inline u16 blk_mq_unique_tag_to_tag(u32 unique_tag)
 
 int blk_mq_request_started(struct request *rq);
 int blk_mq_request_completed(struct request *rq);
+
+static inline void blk_mq_set_request_complete(struct request *rq)
+{
+	WRITE_ONCE(rq->state, MQ_RQ_COMPLETE);
+}
+
 void blk_mq_start_request(struct request *rq);
 void blk_mq_end_request(struct request *rq, blk_status_t error);
 void __blk_mq_end_request(struct request *rq, blk_status_t error);
 
+/**
+ * struct blk_mq_comp_batch - requests completed together by a driver
+ * @list:	completed requests, linked through their queuelist
+ * @need_ts:	at least one request on @list needs a completion time stamp
+ */
+struct blk_mq_comp_batch {
+	struct list_head	list;
+	bool			need_ts;
+};
+
+#define DEFINE_BLK_MQ_COMP_BATCH(name) \
+	struct blk_mq_comp_batch name = { .list = LIST_HEAD_INIT(name.list) }
+
+bool blk_mq_add_to_batch(struct request *rq, struct blk_mq_comp_batch *batch,
+			 blk_status_t error);
+void blk_mq_end_request_batch(struct blk_mq_comp_batch *batch);
+
 void blk_mq_requeue_request(struct request *rq, bool kick_requeue_list);
 void blk_mq_kick_requeue_list(struct request_queue *q);
 void blk_mq_delay_kick_requeue_list(struct request_queue *q, unsigned long msecs);
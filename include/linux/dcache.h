@@ -214,6 +214,7 @@ struct dentry_operations {
 #define DCACHE_FALLTHRU			0x01000000 /* Fall through to lower layer */
 #define DCACHE_ENCRYPTED_NAME		0x02000000 /* Encrypted name (dir key was unavailable) */
 #define DCACHE_OP_REAL			0x04000000
+#define DCACHE_PATH_PREFIX		0x08000000 /* In a path prefix cache */
 
 #define DCACHE_PAR_LOOKUP		0x10000000 /* being looked up (with parent locked shared) */
 #define DCACHE_DENTRY_CURSOR		0x20000000
@@ -498,6 +499,7 @@ static inline bool d_is_fallthru(const struct dentry *dentry)
 
 
 extern int sysctl_vfs_cache_pressure;
+extern unsigned long sysctl_negative_dentry_limit;
 
 static inline unsigned long vfs_pressure_ratio(unsigned long val)
 {
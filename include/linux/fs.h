@@ -32,6 +32,7 @@
 #include <linux/uidgid.h>
 #include <linux/lockdep.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/percpu_counter.h>
 #include <linux/workqueue.h>
 #include <linux/delayed_call.h>
 #include <linux/uuid.h>
@@ -83,6 +84,7 @@ extern int sysctl_protected_symlinks;
 extern int sysctl_protected_hardlinks;
 extern int sysctl_protected_fifos;
 extern int sysctl_protected_regular;
+extern int sysctl_path_prefix_cache;
 
 typedef __kernel_rwf_t rwf_t;
 
@@ -922,6 +924,10 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	pgoff_t stride_prev;		/* where the last strided read started */
+	int stride;			/* pages between strided reads */
+	unsigned int stride_hits;	/* times in a row @stride was seen */
 };
 
 /*
@@ -1422,6 +1428,15 @@ enum {
 
 #define SB_FREEZE_LEVELS (SB_FREEZE_COMPLETE - 1)
 
+/* fs-verity statistics of a filesystem, see fsverity_seq_stats_show() */
+struct fsverity_stats {
+	atomic64_t	verified_blocks;	/* data blocks verified */
+	atomic64_t	hash_reads;		/* Merkle tree blocks read */
+	atomic64_t	hash_reads_saved;	/* ... or found pinned instead */
+	atomic64_t	hash_ops;		/* data and tree blocks hashed */
+	atomic64_t	hash_ops_saved;		/* tree blocks already verified */
+};
+
 struct sb_writers {
 	int				frozen;		/* Is sb frozen? */
 	wait_queue_head_t		wait_unfrozen;	/* for get_super_thawed() */
@@ -1456,6 +1471,7 @@ struct super_block {
 #endif
 #ifdef CONFIG_FS_VERITY
 	const struct fsverity_operations *s_vop;
+	struct fsverity_stats	s_verity_stats;
 #endif
 #ifdef CONFIG_UNICODE
 	struct unicode_map *s_encoding;
@@ -1543,6 +1559,9 @@ struct super_block {
 	 */
 	struct list_lru		s_dentry_lru;
 	struct list_lru		s_inode_lru;
+	/* Unused negative dentries on s_dentry_lru, and their trimming */
+	struct percpu_counter	s_nr_dentry_negative;
+	struct work_struct	s_dentry_trim_work;
 	struct rcu_head		rcu;
 	struct work_struct	destroy_work;
 
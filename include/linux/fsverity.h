@@ -137,6 +137,7 @@ void fsverity_cleanup_inode(struct inode *inode);
 
 bool fsverity_verify_page(struct page *page);
 void fsverity_verify_bio(struct bio *bio);
+int fsverity_seq_stats_show(struct seq_file *seq, void *offset);
 void fsverity_enqueue_verify_work(struct work_struct *work);
 
 #else /* !CONFIG_FS_VERITY */
@@ -191,6 +192,11 @@ static inline void fsverity_verify_bio(struct bio *bio)
 	WARN_ON(1);
 }
 
+static inline int fsverity_seq_stats_show(struct seq_file *seq, void *offset)
+{
+	return 0;
+}
+
 static inline void fsverity_enqueue_verify_work(struct work_struct *work)
 {
 	WARN_ON(1);
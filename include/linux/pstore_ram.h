@@ -17,9 +17,10 @@
 #include <linux/types.h>
 
 /*
- * Choose whether access to the RAM zone requires locking or not.  If a zone
- * can be written to from different CPUs like with ftrace for example, then
- * PRZ_FLAG_NO_LOCK is used. For all other cases, locking is required.
+ * Choose whether ECC updates of the RAM zone require locking or not.  If a
+ * zone is only ever written to from one CPU at a time, like the per-CPU
+ * ftrace zones, then PRZ_FLAG_NO_LOCK is used.  Space in a zone is reserved
+ * without locking either way.
  */
 #define PRZ_FLAG_NO_LOCK	BIT(0)
 /*
@@ -27,6 +28,11 @@
  * getting wiped after its contents get copied out after boot.
  */
 #define PRZ_FLAG_ZAP_OLD	BIT(1)
+/*
+ * Text written to the PRZ is stored compressed with lz4, and decompressed
+ * again when the old contents are saved.
+ */
+#define PRZ_FLAG_COMPRESS	BIT(2)
 
 struct persistent_ram_buffer;
 struct rs_control;
@@ -50,7 +56,11 @@ struct persistent_ram_ecc_info {
  * @flags:	holds PRZ_FLAGS_* bits
  *
  * @buffer_lock:
- *	locks access to @buffer "size" bytes and "start" offset
+ *	serializes writers to a zone with ECC, see PRZ_FLAG_NO_LOCK
+ * @cur_start:
+ *	next write offset, published to @buffer "start" offset
+ * @cur_size:
+ *	bytes written, published to @buffer "size" bytes
  * @buffer:
  *	pointer to actual RAM area managed by this PRZ
  * @buffer_size:
@@ -70,6 +80,15 @@ struct persistent_ram_ecc_info {
  * @ecc_info:
  *	ECC configuration details
  *
+ * @stage_size:
+ *	bytes of text the stage of a compressed PRZ holds
+ * @zwrkmem:
+ *	lz4 workspace of a compressed PRZ
+ * @ztext:
+ *	copy of the stage that gets compressed
+ * @zframe:
+ *	frame the stage is compressed into
+ *
  * @old_log:
  *	saved copy of @buffer->data prior to most recent wipe
  * @old_log_size:
@@ -85,6 +104,8 @@ struct persistent_ram_zone {
 	u32 flags;
 
 	raw_spinlock_t buffer_lock;
+	atomic_t cur_start;
+	atomic_t cur_size;
 	struct persistent_ram_buffer *buffer;
 	size_t buffer_size;
 
@@ -95,6 +116,11 @@ struct persistent_ram_zone {
 	int bad_blocks;
 	struct persistent_ram_ecc_info ecc_info;
 
+	size_t stage_size;
+	void *zwrkmem;
+	char *ztext;
+	void *zframe;
+
 	char *old_log;
 	size_t old_log_size;
 };
@@ -124,6 +150,7 @@ ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
  */
 
 #define RAMOOPS_FLAG_FTRACE_PER_CPU	BIT(0)
+#define RAMOOPS_FLAG_COMPRESS_LOGS	BIT(1)
 
 struct ramoops_platform_data {
 	unsigned long	mem_size;
@@ -496,6 +496,20 @@ void sbitmap_queue_min_shallow_depth(struct sbitmap_queue *sbq,
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu);
 
+/**
+ * sbitmap_queue_clear_batch() - Free several allocated bits and wake up
+ * waiters on a &struct sbitmap_queue.
+ * @sbq: Bitmap to free from.
+ * @offset: Value subtracted from each entry of @tags to get its bit number.
+ * @tags: Bits to free, offset by @offset.
+ * @nr_tags: Number of entries in @tags, must be at least one.
+ *
+ * Equivalent to calling sbitmap_queue_clear() on each bit, but bits that
+ * share a word are released with a single atomic operation.
+ */
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       int *tags, int nr_tags);
+
 static inline int sbq_index_inc(int index)
 {
 	return (index + 1) & (SBQ_WAIT_QUEUES - 1);
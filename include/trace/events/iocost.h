@@ -172,6 +172,73 @@ TRACE_EVENT(iocost_ioc_vrate_adj,
 	)
 );
 
+TRACE_EVENT(iocost_iocg_period,
+
+	TP_PROTO(struct ioc_gq *iocg, const char *path, struct ioc_now *now,
+		u64 vtime, u64 vdone, u32 usage, u32 hw_active, u32 hw_inuse),
+
+	TP_ARGS(iocg, path, now, vtime, vdone, usage, hw_active, hw_inuse),
+
+	TP_STRUCT__entry (
+		__string(devname, ioc_name(iocg->ioc))
+		__string(cgroup, path)
+		__field(u64, now)
+		__field(u64, vnow)
+		__field(u64, vtime)
+		__field(u64, vdone)
+		__field(u64, vdebt)
+		__field(u32, usage)
+		__field(u32, hw_active)
+		__field(u32, hw_inuse)
+	),
+
+	TP_fast_assign(
+		__assign_str(devname, ioc_name(iocg->ioc));
+		__assign_str(cgroup, path);
+		__entry->now = now->now;
+		__entry->vnow = now->vnow;
+		__entry->vtime = vtime;
+		__entry->vdone = vdone;
+		__entry->vdebt = iocg->abs_vdebt;
+		__entry->usage = usage;
+		__entry->hw_active = hw_active;
+		__entry->hw_inuse = hw_inuse;
+	),
+
+	TP_printk("[%s:%s] now=%llu:%llu vtime=%llu vdone=%llu vdebt=%llu "
+		  "usage=%u hweight=%u/%u",
+		__get_str(devname), __get_str(cgroup),
+		__entry->now, __entry->vnow,
+		__entry->vtime, __entry->vdone, __entry->vdebt,
+		__entry->usage, __entry->hw_inuse, __entry->hw_active
+	)
+);
+
+TRACE_EVENT(iocost_ioc_calib,
+
+	TP_PROTO(struct ioc *ioc, u64 *i_lcoefs),
+
+	TP_ARGS(ioc, i_lcoefs),
+
+	TP_STRUCT__entry (
+		__string(devname, ioc_name(ioc))
+		__array(u64, i_lcoefs, 6)
+	),
+
+	TP_fast_assign(
+		__assign_str(devname, ioc_name(ioc));
+		memcpy(__entry->i_lcoefs, i_lcoefs, sizeof(__entry->i_lcoefs));
+	),
+
+	TP_printk("[%s] rbps=%llu rseqiops=%llu rrandiops=%llu "
+		  "wbps=%llu wseqiops=%llu wrandiops=%llu",
+		__get_str(devname),
+		__entry->i_lcoefs[0], __entry->i_lcoefs[1],
+		__entry->i_lcoefs[2], __entry->i_lcoefs[3],
+		__entry->i_lcoefs[4], __entry->i_lcoefs[5]
+	)
+);
+
 #endif /* _TRACE_BLK_IOCOST_H */
 
 /* This part must be outside protection */
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+
+/*
+ * Access patterns recognized by ondemand_readahead()
+ */
+#define ra_patterns						\
+	EM(RA_PATTERN_INITIAL,		"initial")		\
+	EM(RA_PATTERN_SEQUENTIAL,	"sequential")		\
+	EM(RA_PATTERN_INTERLEAVED,	"interleaved")		\
+	EM(RA_PATTERN_CONTEXT,		"context")		\
+	EM(RA_PATTERN_RANDOM,		"random")		\
+	EM(RA_PATTERN_STRIDE,		"stride")		\
+	E_(RA_PATTERN_BACKWARD,		"backward")
+
+#ifndef __RA_DECLARE_TRACE_ENUMS_ONCE_ONLY
+#define __RA_DECLARE_TRACE_ENUMS_ONCE_ONLY
+
+#undef EM
+#undef E_
+#define EM(a, b) a,
+#define E_(a, b) a
+
+enum ra_pattern { ra_patterns };
+
+#endif /* __RA_DECLARE_TRACE_ENUMS_ONCE_ONLY */
+
+#undef EM
+#undef E_
+#define EM(a, b) TRACE_DEFINE_ENUM(a);
+#define E_(a, b) TRACE_DEFINE_ENUM(a);
+
+ra_patterns;
+
+#undef EM
+#undef E_
+#define EM(a, b)	{ a, b },
+#define E_(a, b)	{ a, b }
+
+TRACE_EVENT(mm_readahead,
+
+	TP_PROTO(struct address_space *mapping, struct file_ra_state *ra,
+		 pgoff_t offset, unsigned long req_size, bool async,
+		 enum ra_pattern pattern),
+
+	TP_ARGS(mapping, ra, offset, req_size, async, pattern),
+
+	TP_STRUCT__entry(
+		__field(dev_t, s_dev)
+		__field(unsigned long, i_ino)
+		__field(pgoff_t, offset)
+		__field(unsigned long, req_size)
+		__field(pgoff_t, start)
+		__field(unsigned int, size)
+		__field(unsigned int, async_size)
+		__field(int, stride)
+		__field(bool, async)
+		__field(enum ra_pattern, pattern)
+	),
+
+	TP_fast_assign(
+		__entry->s_dev = mapping->host->i_sb->s_dev;
+		__entry->i_ino = mapping->host->i_ino;
+		__entry->offset = offset;
+		__entry->req_size = req_size;
+		__entry->start = ra->start;
+		__entry->size = ra->size;
+		__entry->async_size = ra->async_size;
+		__entry->stride = ra->stride;
+		__entry->async = async;
+		__entry->pattern = pattern;
+	),
+
+	TP_printk("dev %d:%d ino %lx %s ofs=%lu req=%lu %s start=%lu size=%u async_size=%u stride=%d",
+		  MAJOR(__entry->s_dev), MINOR(__entry->s_dev),
+		  __entry->i_ino, __entry->async ? "async" : "sync",
+		  __entry->offset, __entry->req_size,
+		  __print_symbolic(__entry->pattern, ra_patterns),
+		  __entry->start, __entry->size, __entry->async_size,
+		  __entry->stride)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
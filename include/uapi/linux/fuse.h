@@ -176,6 +176,13 @@
  *  7.32
  *  - add FUSE_SECURITY_CTX flag for fuse_init_out
  *  - add security context to create, mkdir, symlink, and mknod requests
+ *
+ *  Not part of the upstream protocol, so they don't bump the minor version:
+ *  - add FUSE_PASSTHROUGH and FOPEN_PASSTHROUGH, only in effect once
+ *    FUSE_PASSTHROUGH was negotiated in INIT
+ *  - add passthrough_fh to fuse_open_out
+ *  - add FUSE_DEV_IOC_PASSTHROUGH_OPEN
+ *  - add FUSE_DEV_IOC_BIND_QUEUE
  */
 
 #ifndef _LINUX_FUSE_H
@@ -281,12 +288,15 @@ struct fuse_file_lock {
  * FOPEN_NONSEEKABLE: the file is not seekable
  * FOPEN_CACHE_DIR: allow caching this directory
  * FOPEN_STREAM: the file is stream-like (no file position at all)
+ * FOPEN_PASSTHROUGH: read, write and mmap go to the backing file registered
+ *		      with FUSE_DEV_IOC_PASSTHROUGH_OPEN, see passthrough_fh
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
 #define FOPEN_CACHE_DIR		(1 << 3)
 #define FOPEN_STREAM		(1 << 4)
+#define FOPEN_PASSTHROUGH	(1 << 31)
 
 /**
  * INIT request/reply flags
@@ -321,6 +331,7 @@ struct fuse_file_lock {
  *		       foffset and moffset fields in struct
  *		       fuse_setupmapping_out and fuse_removemapping_one.
  * FUSE_SECURITY_CTX: add security context to create, mkdir, symlink, and mknod
+ * FUSE_PASSTHROUGH: kernel supports passing file I/O through to backing files
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -350,6 +361,7 @@ struct fuse_file_lock {
 #define FUSE_EXPLICIT_INVAL_DATA (1 << 25)
 #define FUSE_MAP_ALIGNMENT	(1 << 26)
 #define FUSE_SECURITY_CTX	(1 << 27)
+#define FUSE_PASSTHROUGH	(1 << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -607,7 +619,7 @@ struct fuse_chromeos_tmpfile_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	uint32_t	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -884,8 +896,16 @@ struct fuse_notify_retrieve_in {
 	uint64_t	dummy4;
 };
 
+struct fuse_passthrough_out {
+	uint32_t	fd;
+	uint32_t	flags;
+};
+
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	\
+	_IOW(229, 1, struct fuse_passthrough_out)
+#define FUSE_DEV_IOC_BIND_QUEUE	_IOW(229, 2, uint32_t)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -1881,6 +1881,13 @@ static struct ctl_table fs_table[] = {
 		.mode		= 0444,
 		.proc_handler	= proc_nr_dentry,
 	},
+	{
+		.procname	= "negative-dentry-limit",
+		.data		= &sysctl_negative_dentry_limit,
+		.maxlen		= sizeof(sysctl_negative_dentry_limit),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
 	{
 		.procname	= "overflowuid",
 		.data		= &fs_overflowuid,
@@ -1994,6 +2001,15 @@ static struct ctl_table fs_table[] = {
 		.extra1		= SYSCTL_ZERO,
 		.extra2		= &two,
 	},
+	{
+		.procname	= "path_prefix_cache",
+		.data		= &sysctl_path_prefix_cache,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
 	{
 		.procname	= "suid_dumpable",
 		.data		= &suid_dumpable,
@@ -603,6 +603,45 @@ void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_clear);
 
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       int *tags, int nr_tags)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned long *addr = NULL;
+	unsigned long mask = 0;
+	int i;
+
+	/* See sbitmap_queue_clear() for the ordering requirements. */
+	smp_mb__before_atomic();
+	for (i = 0; i < nr_tags; i++) {
+		const int nr = tags[i] - offset;
+		unsigned long *this_addr;
+
+		this_addr = &sb->map[SB_NR_TO_INDEX(sb, nr)].cleared;
+		if (addr != this_addr) {
+			if (mask)
+				atomic_long_or(mask, (atomic_long_t *)addr);
+			mask = 0;
+			addr = this_addr;
+		}
+		mask |= 1UL << SB_NR_TO_BIT(sb, nr);
+	}
+	if (mask)
+		atomic_long_or(mask, (atomic_long_t *)addr);
+
+	smp_mb__after_atomic();
+	for (i = 0; i < nr_tags; i++)
+		sbitmap_queue_wake_up(sbq);
+
+	if (likely(!sbq->round_robin)) {
+		const unsigned int nr = tags[nr_tags - 1] - offset;
+
+		if (nr < sbq->sb.depth)
+			this_cpu_write(*sbq->alloc_hint, nr);
+	}
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_clear_batch);
+
 void sbitmap_queue_wake_all(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
@@ -2009,6 +2009,70 @@ static void shrink_readahead_size_eio(struct file *filp,
 	ra->ra_pages /= 4;
 }
 
+/*
+ * Contiguous pages that generic_file_buffered_read() looked up in one go, so
+ * that a large read walks the page cache once per batch rather than once per
+ * page.  pages[cur] is the page at @index, and the batch holds a reference
+ * on each page it has not handed out yet.
+ */
+struct read_batch {
+	pgoff_t index;
+	unsigned int cur;
+	unsigned int nr;
+	struct page *pages[PAGEVEC_SIZE];
+};
+
+static void read_batch_release(struct read_batch *batch)
+{
+	while (batch->cur < batch->nr)
+		put_page(batch->pages[batch->cur++]);
+}
+
+/*
+ * Return the page at @index with a reference held, or NULL if it is not
+ * cached.  Unless @batch already has it, @batch is refilled with up to
+ * @nr_pages pages from @index on.
+ */
+static struct page *read_batch_get_page(struct address_space *mapping,
+					struct read_batch *batch,
+					pgoff_t index, unsigned long nr_pages)
+{
+	if (batch->cur < batch->nr && batch->index != index)
+		read_batch_release(batch);
+
+	if (batch->cur == batch->nr) {
+		batch->index = index;
+		batch->cur = 0;
+		batch->nr = find_get_pages_contig(mapping, index,
+				min_t(unsigned long, nr_pages, PAGEVEC_SIZE),
+				batch->pages);
+		if (!batch->nr)
+			return NULL;
+	}
+
+	batch->index++;
+	return batch->pages[batch->cur++];
+}
+
+/*
+ * Hand out the next page of @batch if it is the page at @index and can just
+ * be copied: it is uptodate and does not trigger readahead.
+ */
+static struct page *read_batch_next_uptodate(struct read_batch *batch,
+					     pgoff_t index)
+{
+	struct page *page;
+
+	if (batch->cur == batch->nr || batch->index != index)
+		return NULL;
+	page = batch->pages[batch->cur];
+	if (!PageUptodate(page) || PageReadahead(page))
+		return NULL;
+	batch->cur++;
+	batch->index++;
+	return page;
+}
+
 /**
  * generic_file_buffered_read - generic file read routine
  * @iocb:	the iocb to read
@@ -2038,6 +2102,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
 	unsigned int prev_offset;
+	struct read_batch batch = { .cur = 0, .nr = 0 };
 	int error = 0;
 
 	if (unlikely(*ppos >= inode->i_sb->s_maxbytes))
@@ -2063,14 +2128,16 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			goto out;
 		}
 
-		page = find_get_page(mapping, index);
+		page = read_batch_get_page(mapping, &batch, index,
+					   last_index - index);
 		if (!page) {
 			if (iocb->ki_flags & IOCB_NOWAIT)
 				goto would_block;
 			page_cache_sync_readahead(mapping,
 					ra, filp,
 					index, last_index - index);
-			page = find_get_page(mapping, index);
+			page = read_batch_get_page(mapping, &batch, index,
+						   last_index - index);
 			if (unlikely(page == NULL))
 				goto no_cached_page;
 		}
@@ -2174,6 +2241,33 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			error = -EFAULT;
 			goto out;
 		}
+
+		/*
+		 * Copy the rest of the batch in the same pass, for as long as
+		 * its pages are uptodate and wholly below the i_size read
+		 * above.  Anything else goes back through the loop.
+		 */
+		while (!offset && index < end_index &&
+		       (page = read_batch_next_uptodate(&batch, index))) {
+			if (mapping_writably_mapped(mapping))
+				flush_dcache_page(page);
+			mark_page_accessed(page);
+			prev_index = index;
+
+			ret = copy_page_to_iter(page, 0, PAGE_SIZE, iter);
+			index += ret >> PAGE_SHIFT;
+			offset = ret & ~PAGE_MASK;
+			prev_offset = offset;
+
+			put_page(page);
+			written += ret;
+			if (!iov_iter_count(iter))
+				goto out;
+			if (ret < PAGE_SIZE) {
+				error = -EFAULT;
+				goto out;
+			}
+		}
 		continue;
 
 page_not_up_to_date:
@@ -2269,6 +2363,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 would_block:
 	error = -EAGAIN;
 out:
+	read_batch_release(&batch);
 	ra->prev_pos = prev_index;
 	ra->prev_pos <<= PAGE_SHIFT;
 	ra->prev_pos |= prev_offset;
@@ -25,6 +25,9 @@
 
 #include "internal.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -34,6 +37,9 @@ file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 {
 	ra->ra_pages = inode_to_bdi(mapping->host)->ra_pages;
 	ra->prev_pos = -1;
+	ra->stride_prev = 0;
+	ra->stride = 0;
+	ra->stride_hits = 0;
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
 
@@ -375,6 +381,154 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Strided readahead.
+ *
+ * Reads that miss the page cache outside of a readahead window are
+ * remembered in ->stride_prev, and the distance between the last two of them
+ * in ->stride.  Once the same distance was seen RA_STRIDE_HITS times in a
+ * row, reads are assumed to go on with that stride:
+ *
+ * - a forward stride, or a backward stride with gaps between the reads, gets
+ *   up to RA_STRIDE_DEPTH chunks of the request size read ahead, one stride
+ *   apart.  The first page of each chunk is marked PG_readahead, and hitting
+ *   it reads one more chunk at the far end.
+ *
+ * - a backward stride without gaps, such as a reverse read of a log file, gets
+ *   a window below the read, marked halfway down.  Hitting the mark reads the
+ *   next, larger, window below.  ->start, ->size and ->async_size describe
+ *   the window as usual.
+ */
+#define RA_STRIDE_HITS	2
+#define RA_STRIDE_DEPTH	8
+
+static bool ra_stride_backward(struct file_ra_state *ra,
+			       unsigned long req_size)
+{
+	return ra->stride < 0 && -ra->stride <= req_size;
+}
+
+/*
+ * Learn from a read that missed the page cache, return true if it follows a
+ * known stride.
+ */
+static bool ra_stride_learn(struct file_ra_state *ra, pgoff_t offset,
+			    unsigned long req_size)
+{
+	long stride = (long)(offset - ra->stride_prev);
+	pgoff_t prev_offset = (unsigned long long)ra->prev_pos >> PAGE_SHIFT;
+
+	ra->stride_prev = offset;
+	if (ra->stride && stride == ra->stride) {
+		if (ra->stride_hits < RA_STRIDE_HITS)
+			ra->stride_hits++;
+		return ra->stride_hits >= RA_STRIDE_HITS;
+	}
+
+	/*
+	 * Reads that continue the previous one, or that are no further apart
+	 * than their size, are sequential.
+	 */
+	if (stride == 0 || (stride > 0 && stride <= req_size) ||
+	    offset - prev_offset <= 1UL || stride != (int)stride) {
+		ra->stride = 0;
+		ra->stride_hits = 0;
+	} else {
+		ra->stride = stride;
+		ra->stride_hits = 1;
+	}
+	return false;
+}
+
+/* Read the chunk @nr strides from @offset, if it is inside the file */
+static unsigned long ra_stride_chunk(struct address_space *mapping,
+				     struct file_ra_state *ra,
+				     struct file *filp, pgoff_t offset,
+				     unsigned int nr, unsigned long req_size)
+{
+	long delta = (long)ra->stride * nr;
+
+	if (delta < 0 && -delta > offset)
+		return 0;
+	return __do_page_cache_readahead(mapping, filp, offset + delta,
+					 req_size, req_size);
+}
+
+/*
+ * Returns true if @offset is read ahead as part of a stride, with the number
+ * of pages submitted in @nr_pages.
+ */
+static bool try_stride_readahead(struct address_space *mapping,
+				 struct file_ra_state *ra, struct file *filp,
+				 bool hit_readahead_marker, pgoff_t offset,
+				 unsigned long req_size,
+				 unsigned long max_pages,
+				 unsigned long *nr_pages)
+{
+	unsigned int depth, i;
+	pgoff_t end;
+
+	*nr_pages = 0;
+	if (req_size > max_pages)
+		return false;
+
+	if (hit_readahead_marker) {
+		/* Only marks that we left behind */
+		if (ra->stride_hits < RA_STRIDE_HITS)
+			return false;
+		if (ra_stride_backward(ra, req_size)) {
+			if (offset != ra->start + ra->size - ra->async_size)
+				return false;
+			/* Nothing left below */
+			if (!ra->start)
+				return true;
+			end = ra->start;
+			ra->size = get_next_ra_size(ra, max_pages);
+			goto backward;
+		}
+		if ((long)(offset - ra->stride_prev) != ra->stride)
+			return false;
+		ra->stride_prev = offset;
+		depth = clamp_t(unsigned long, max_pages / req_size, 1,
+				RA_STRIDE_DEPTH);
+		*nr_pages = ra_stride_chunk(mapping, ra, filp, offset, depth,
+					    req_size);
+		goto out;
+	}
+
+	if (!ra_stride_learn(ra, offset, req_size))
+		return false;
+
+	if (ra_stride_backward(ra, req_size)) {
+		end = offset + req_size;
+		ra->size = get_init_ra_size(req_size, max_pages);
+		goto backward;
+	}
+
+	/* The read itself, and the chunks ahead of it */
+	*nr_pages = __do_page_cache_readahead(mapping, filp, offset,
+					      req_size, 0);
+	depth = clamp_t(unsigned long, max_pages / req_size, 1,
+			RA_STRIDE_DEPTH);
+	for (i = 1; i <= depth; i++)
+		*nr_pages += ra_stride_chunk(mapping, ra, filp, offset, i,
+					     req_size);
+	goto out;
+
+backward:
+	ra->start = end > ra->size ? end - ra->size : 0;
+	ra->size = end - ra->start;
+	ra->async_size = ra->size - ra->size / 2;
+	*nr_pages = __do_page_cache_readahead(mapping, filp, ra->start,
+					      ra->size, ra->async_size);
+out:
+	trace_mm_readahead(mapping, ra, offset, req_size,
+			   hit_readahead_marker,
+			   ra_stride_backward(ra, req_size) ?
+			   RA_PATTERN_BACKWARD : RA_PATTERN_STRIDE);
+	return true;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -386,7 +540,8 @@ ondemand_readahead(struct address_space *mapping,
 {
 	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
 	unsigned long max_pages = ra->ra_pages;
-	unsigned long add_pages;
+	unsigned long add_pages, nr_pages;
+	enum ra_pattern pattern;
 	pgoff_t prev_offset;
 
 	/*
@@ -399,8 +554,18 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * start of file
 	 */
-	if (!offset)
+	if (!offset) {
+		pattern = RA_PATTERN_INITIAL;
 		goto initial_readahead;
+	}
+
+	/*
+	 * Fixed strides, forwards or backwards.  This comes first as a
+	 * backward stride keeps its window in ->start and ->size too.
+	 */
+	if (try_stride_readahead(mapping, ra, filp, hit_readahead_marker,
+				 offset, req_size, max_pages, &nr_pages))
+		return nr_pages;
 
 	/*
 	 * It's the expected callback offset, assume sequential access.
@@ -411,6 +576,7 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max_pages);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_SEQUENTIAL;
 		goto readit;
 	}
 
@@ -435,12 +601,14 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max_pages);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_INTERLEAVED;
 		goto readit;
 	}
 
 	/*
 	 * oversize read
 	 */
+	pattern = RA_PATTERN_INITIAL;
 	if (req_size > max_pages)
 		goto initial_readahead;
 
@@ -457,13 +625,17 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max_pages))
+	if (try_context_readahead(mapping, ra, offset, req_size, max_pages)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
+	trace_mm_readahead(mapping, ra, offset, req_size, hit_readahead_marker,
+			   RA_PATTERN_RANDOM);
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
@@ -489,6 +661,8 @@ ondemand_readahead(struct address_space *mapping,
 		}
 	}
 
+	trace_mm_readahead(mapping, ra, offset, req_size, hit_readahead_marker,
+			   pattern);
 	return ra_submit(ra, mapping, filp);
 }
 
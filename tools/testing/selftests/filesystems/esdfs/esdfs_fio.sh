@@ -0,0 +1,84 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare data path throughput of the lower file system, esdfs and esdfs
+# mounted with the passthrough option.
+#
+# usage: esdfs_fio.sh <lower dir> [file size]
+
+TCID="esdfs_fio.sh"
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+lower=$1
+size=${2:-1g}
+mnt=$(mktemp -d)
+
+cleanup()
+{
+	umount "$mnt" 2>/dev/null
+	rmdir "$mnt"
+	rm -f "$lower/esdfs_fio.dat"
+}
+
+if [ $(id -u) -ne 0 ]; then
+	echo "$TCID: must be run as root" >&2
+	exit $ksft_skip
+fi
+
+if [ -z "$lower" ] || [ ! -d "$lower" ]; then
+	echo "usage: $0 <lower dir> [file size]" >&2
+	exit 1
+fi
+
+if ! which fio > /dev/null 2>&1; then
+	echo "$TCID: could not find fio" >&2
+	exit $ksft_skip
+fi
+
+if ! grep -qw esdfs /proc/filesystems; then
+	echo "$TCID: esdfs is not supported" >&2
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+# run_fio <dir> <name> <rw> <bs> <ioengine>
+# Prints the read or write bandwidth in KiB/s from fio's terse output.
+run_fio()
+{
+	local out
+
+	echo 3 > /proc/sys/vm/drop_caches
+	out=$(fio --minimal --name="$2" --directory="$1" \
+		--filename=esdfs_fio.dat --size="$size" --rw="$3" \
+		--bs="$4" --ioengine="$5" --runtime=30 \
+		--end_fsync=1)
+	case $3 in
+	*write) echo "$out" | cut -d';' -f48 ;;
+	*) echo "$out" | cut -d';' -f7 ;;
+	esac
+}
+
+run_suite()
+{
+	printf "%-14s" "$2"
+	printf "%12s" $(run_fio "$1" seqwrite write 1m psync)
+	printf "%12s" $(run_fio "$1" seqread read 1m psync)
+	printf "%12s" $(run_fio "$1" randread randread 4k psync)
+	printf "%12s" $(run_fio "$1" mmapread read 1m mmap)
+	echo
+}
+
+printf "%-14s%12s%12s%12s%12s  (KiB/s)\n" "" seqwrite seqread \
+	randread mmapread
+
+run_suite "$lower" lower
+
+mount -t esdfs "$lower" "$mnt" || exit 1
+run_suite "$mnt" esdfs
+umount "$mnt"
+
+mount -t esdfs -o passthrough "$lower" "$mnt" || exit 1
+run_suite "$mnt" passthrough
@@ -0,0 +1,88 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Measure writeback throughput of a compressed f2fs file on a loop device
+# image, with 1 to N clusters compressed in parallel.
+#
+# usage: f2fs_compress_wb.sh [file size in MiB] [algorithm]
+
+TCID="f2fs_compress_wb.sh"
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+size=${1:-512}
+algo=${2:-lz4}
+work=$(mktemp -d)
+img=$work/f2fs.img
+src=$work/src.dat
+mnt=$work/mnt
+
+cleanup()
+{
+	umount "$mnt" 2>/dev/null
+	[ -n "$loop" ] && losetup -d "$loop"
+	rm -rf "$work"
+}
+
+if [ $(id -u) -ne 0 ]; then
+	echo "$TCID: must be run as root" >&2
+	exit $ksft_skip
+fi
+
+if ! which mkfs.f2fs > /dev/null 2>&1; then
+	echo "$TCID: could not find mkfs.f2fs" >&2
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+# Roughly 4:3 compressible data
+base64 /dev/urandom | head -c $((size * 1024 * 1024)) > "$src"
+
+truncate -s $((size * 4))M "$img"
+loop=$(losetup -f --show "$img") || exit 1
+mkfs.f2fs -q -f -O extra_attr,compression "$loop" || exit 1
+mkdir "$mnt"
+if ! mount -t f2fs -o compress_algorithm="$algo" "$loop" "$mnt"; then
+	echo "$TCID: compression is not supported" >&2
+	exit $ksft_skip
+fi
+
+knob=/sys/fs/f2fs/$(basename "$loop")/compress_batch_clusters
+if [ ! -w "$knob" ]; then
+	echo "$TCID: no parallel compression support" >&2
+	exit $ksft_skip
+fi
+mkdir "$mnt/c"
+chattr +c "$mnt/c" || exit 1
+
+# run <clusters>
+# Prints the MiB/s of writing back a freshly dirtied compressed file.
+run()
+{
+	local start end
+
+	echo "$1" > "$knob" || return 1
+	rm -f "$mnt/c/file"
+	sync
+	cat "$src" > "$mnt/c/file"
+	start=$(date +%s%N)
+	sync "$mnt/c/file"
+	end=$(date +%s%N)
+	echo $((size * 1000000000 / (end - start)))
+}
+
+cpus=$(nproc)
+max=$(cat "$knob")
+[ "$max" -lt "$cpus" ] && cpus=$max
+[ "$cpus" -lt 1 ] && cpus=1
+
+printf "%10s%12s  (%s, %d MiB)\n" clusters MiB/s "$algo" "$size"
+n=1
+while :; do
+	printf "%10d%12s\n" "$n" "$(run $n)"
+	[ "$n" -ge "$cpus" ] && break
+	n=$((n * 2))
+	[ "$n" -gt "$cpus" ] && n=$cpus
+done
@@ -0,0 +1,379 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Scaling test for FUSE per-CPU request queues.
+ *
+ * A minimal passthrough daemon serves a single file, "file", backed by a
+ * temporary file.  Each daemon thread clones the /dev/fuse channel and binds
+ * it to one CPU's queue with FUSE_DEV_IOC_BIND_QUEUE.  The same number of
+ * client threads, pinned to those CPUs, then issue GETATTR and READ requests
+ * and the throughput is reported for 1 to N threads.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <linux/fuse.h>
+
+#include "../../kselftest.h"
+
+#define ROOT_NODEID	FUSE_ROOT_ID
+#define FILE_NODEID	2
+#define FILE_NAME	"file"
+#define FILE_SIZE	4096
+#define MAX_WRITE	(128 * 1024)
+#define BUF_SIZE	(MAX_WRITE + 8192)
+#define MAX_THREADS	64
+#define RUN_SECONDS	2
+
+struct daemon_thread {
+	pthread_t thread;
+	int fd;
+	int cpu;
+};
+
+struct client_thread {
+	pthread_t thread;
+	int cpu;
+	unsigned long getattrs;
+	unsigned long reads;
+	int err;
+};
+
+static char mnt_dir[] = "/tmp/fuse_mq_mnt.XXXXXX";
+static char backing_path[] = "/tmp/fuse_mq_backing.XXXXXX";
+static int backing_fd = -1;
+static volatile bool stop;
+
+static int reply(int fd, uint64_t unique, int error, const void *arg,
+		 size_t len)
+{
+	struct fuse_out_header out = {
+		.len = sizeof(out) + (error ? 0 : len),
+		.error = error,
+		.unique = unique,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &out, .iov_len = sizeof(out) },
+		{ .iov_base = (void *)arg, .iov_len = len },
+	};
+	ssize_t ret;
+
+	ret = writev(fd, iov, error ? 1 : 2);
+	return ret == out.len ? 0 : -errno;
+}
+
+static void fill_attr(uint64_t nodeid, struct fuse_attr *attr)
+{
+	struct stat st;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	if (nodeid == ROOT_NODEID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+		return;
+	}
+
+	/* Passthrough: report the backing file's attributes */
+	fstat(backing_fd, &st);
+	attr->mode = S_IFREG | (st.st_mode & 07777);
+	attr->nlink = 1;
+	attr->size = st.st_size;
+	attr->blocks = st.st_blocks;
+	attr->atime = st.st_atime;
+	attr->mtime = st.st_mtime;
+	attr->ctime = st.st_ctime;
+	attr->blksize = st.st_blksize;
+}
+
+static int handle_request(int fd, struct fuse_in_header *in, void *arg)
+{
+	switch (in->opcode) {
+	case FUSE_INIT: {
+		struct fuse_init_out out = {
+			.major = FUSE_KERNEL_VERSION,
+			.minor = FUSE_KERNEL_MINOR_VERSION,
+			.max_readahead = MAX_WRITE,
+			.max_background = 64,
+			.congestion_threshold = 48,
+			.max_write = MAX_WRITE,
+		};
+
+		return reply(fd, in->unique, 0, &out, sizeof(out));
+	}
+	case FUSE_LOOKUP: {
+		struct fuse_entry_out out = { 0 };
+
+		if (in->nodeid != ROOT_NODEID || strcmp(arg, FILE_NAME))
+			return reply(fd, in->unique, -ENOENT, NULL, 0);
+		out.nodeid = FILE_NODEID;
+		fill_attr(FILE_NODEID, &out.attr);
+		return reply(fd, in->unique, 0, &out, sizeof(out));
+	}
+	case FUSE_GETATTR: {
+		/* Zero attr_valid, so that every fstat() comes here */
+		struct fuse_attr_out out = { 0 };
+
+		fill_attr(in->nodeid, &out.attr);
+		return reply(fd, in->unique, 0, &out, sizeof(out));
+	}
+	case FUSE_OPEN: {
+		struct fuse_open_out out = { .open_flags = FOPEN_DIRECT_IO };
+
+		return reply(fd, in->unique, 0, &out, sizeof(out));
+	}
+	case FUSE_READ: {
+		struct fuse_read_in *read_in = arg;
+		char buf[FILE_SIZE];
+		ssize_t ret;
+
+		ret = pread(backing_fd, buf,
+			    read_in->size < sizeof(buf) ? read_in->size :
+							  sizeof(buf),
+			    read_in->offset);
+		if (ret < 0)
+			return reply(fd, in->unique, -errno, NULL, 0);
+		return reply(fd, in->unique, 0, buf, ret);
+	}
+	case FUSE_FLUSH:
+	case FUSE_RELEASE:
+		return reply(fd, in->unique, 0, NULL, 0);
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+		return 0;
+	default:
+		return reply(fd, in->unique, -ENOSYS, NULL, 0);
+	}
+}
+
+static void *daemon_main(void *data)
+{
+	struct daemon_thread *dt = data;
+	char *buf = malloc(BUF_SIZE);
+	ssize_t len;
+
+	if (!buf)
+		return NULL;
+
+	for (;;) {
+		len = read(dt->fd, buf, BUF_SIZE);
+		if (len < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			/* ENODEV once the connection is gone */
+			break;
+		}
+		if (len < sizeof(struct fuse_in_header))
+			break;
+		handle_request(dt->fd, (struct fuse_in_header *)buf,
+			       buf + sizeof(struct fuse_in_header));
+	}
+	free(buf);
+	return NULL;
+}
+
+static int pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *client_main(void *data)
+{
+	struct client_thread *ct = data;
+	char path[64], buf[FILE_SIZE];
+	struct stat st;
+	int fd;
+
+	pin_to_cpu(ct->cpu);
+	snprintf(path, sizeof(path), "%s/%s", mnt_dir, FILE_NAME);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		ct->err = errno;
+		return NULL;
+	}
+
+	while (!stop) {
+		if (fstat(fd, &st)) {
+			ct->err = errno;
+			break;
+		}
+		ct->getattrs++;
+		if (pread(fd, buf, sizeof(buf), 0) != sizeof(buf)) {
+			ct->err = errno ?: EIO;
+			break;
+		}
+		ct->reads++;
+	}
+	close(fd);
+	return NULL;
+}
+
+/* Clone the session channel and bind the clone to @cpu's queue */
+static int clone_channel(int session_fd, int cpu)
+{
+	uint32_t arg = session_fd;
+	int fd;
+
+	fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (ioctl(fd, FUSE_DEV_IOC_CLONE, &arg))
+		goto err;
+
+	arg = cpu;
+	if (ioctl(fd, FUSE_DEV_IOC_BIND_QUEUE, &arg))
+		goto err;
+
+	return fd;
+err:
+	arg = -errno;
+	close(fd);
+	return (int)arg;
+}
+
+static int run(int nr_threads, int *cpus)
+{
+	struct daemon_thread daemons[MAX_THREADS];
+	struct client_thread clients[MAX_THREADS];
+	unsigned long getattrs = 0, reads = 0;
+	char opts[128];
+	int session_fd;
+	int i, err = 0;
+
+	session_fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (session_fd < 0) {
+		ksft_print_msg("open /dev/fuse: %s\n", strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other",
+		 session_fd);
+	if (mount("fuse_mq", mnt_dir, "fuse", MS_NOSUID | MS_NODEV, opts)) {
+		ksft_print_msg("mount: %s\n", strerror(errno));
+		close(session_fd);
+		return KSFT_SKIP;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		daemons[i].cpu = cpus[i];
+		daemons[i].fd = clone_channel(session_fd, cpus[i]);
+		if (daemons[i].fd < 0) {
+			err = daemons[i].fd == -ENOTTY ? KSFT_SKIP : KSFT_FAIL;
+			ksft_print_msg("bind queue %d: %s\n", cpus[i],
+				       strerror(-daemons[i].fd));
+			break;
+		}
+		pthread_create(&daemons[i].thread, NULL, daemon_main,
+			       &daemons[i]);
+	}
+	if (err) {
+		umount2(mnt_dir, MNT_DETACH);
+		close(session_fd);
+		while (i--) {
+			pthread_join(daemons[i].thread, NULL);
+			close(daemons[i].fd);
+		}
+		return err;
+	}
+
+	stop = false;
+	for (i = 0; i < nr_threads; i++) {
+		memset(&clients[i], 0, sizeof(clients[i]));
+		clients[i].cpu = cpus[i];
+		pthread_create(&clients[i].thread, NULL, client_main,
+			       &clients[i]);
+	}
+	sleep(RUN_SECONDS);
+	stop = true;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(clients[i].thread, NULL);
+		if (clients[i].err) {
+			ksft_print_msg("client on cpu %d: %s\n",
+				       clients[i].cpu,
+				       strerror(clients[i].err));
+			err = KSFT_FAIL;
+		}
+		getattrs += clients[i].getattrs;
+		reads += clients[i].reads;
+	}
+
+	umount2(mnt_dir, MNT_DETACH);
+	close(session_fd);
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(daemons[i].thread, NULL);
+		close(daemons[i].fd);
+	}
+
+	ksft_print_msg("%2d threads: %8lu getattr/s %8lu read/s\n",
+		       nr_threads, getattrs / RUN_SECONDS,
+		       reads / RUN_SECONDS);
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	char buf[FILE_SIZE];
+	int cpus[MAX_THREADS];
+	int nr_cpus = 0;
+	int cpu, ret = KSFT_PASS;
+	int nr_threads;
+	cpu_set_t set;
+
+	if (geteuid()) {
+		ksft_print_msg("skip: must be run as root\n");
+		return KSFT_SKIP;
+	}
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return KSFT_FAIL;
+	for (cpu = 0; cpu < CPU_SETSIZE && nr_cpus < MAX_THREADS; cpu++)
+		if (CPU_ISSET(cpu, &set))
+			cpus[nr_cpus++] = cpu;
+
+	if (!mkdtemp(mnt_dir))
+		return KSFT_FAIL;
+	backing_fd = mkstemp(backing_path);
+	if (backing_fd < 0) {
+		rmdir(mnt_dir);
+		return KSFT_FAIL;
+	}
+	unlink(backing_path);
+	memset(buf, 0x5a, sizeof(buf));
+	if (pwrite(backing_fd, buf, sizeof(buf), 0) != sizeof(buf)) {
+		ret = KSFT_FAIL;
+		goto out;
+	}
+
+	/* 1, 2, 4, ... threads, finishing with one per CPU */
+	for (nr_threads = 1; ; nr_threads *= 2) {
+		if (nr_threads > nr_cpus)
+			nr_threads = nr_cpus;
+		ret = run(nr_threads, cpus);
+		if (ret != KSFT_PASS || nr_threads == nr_cpus)
+			break;
+	}
+out:
+	close(backing_fd);
+	rmdir(mnt_dir);
+	return ret;
+}
@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Check that fs.negative-dentry-limit keeps a superblock's unused negative
+ * dentries in bounds.
+ *
+ * The limit is lowered to <limit>, <count> names that do not exist are
+ * stat()ed in a fresh directory under <dir>, and /proc/fs/negative-dentries
+ * is polled until the line for <dir>'s superblock is back under the limit.
+ * <dir> must be on a filesystem that keeps negative dentries, so not tmpfs.
+ *
+ * usage: negative_dentry_limit [-l limit] [-n count] [dir]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "../kselftest.h"
+
+#define LIMIT_SYSCTL	"/proc/sys/fs/negative-dentry-limit"
+#define NEGATIVE_PROC	"/proc/fs/negative-dentries"
+
+/* Per-cpu counter error the kernel tolerates before it notices */
+#define SLACK_PER_CPU	64
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_limit(const char *val)
+{
+	int fd, ret = 0;
+
+	fd = open(LIMIT_SYSCTL, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+/* Unused negative dentries of the superblock of @dev, or -1 */
+static long long nr_negative(dev_t dev)
+{
+	unsigned int maj, min;
+	long long negative, ret = -1;
+	unsigned long unused;
+	char type[64];
+	FILE *f;
+
+	f = fopen(NEGATIVE_PROC, "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%u:%u %63s %lld %lu", &maj, &min, type, &negative,
+		      &unused) == 5) {
+		if (maj == major(dev) && min == minor(dev)) {
+			ret = negative;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-l limit] [-n count] [dir]\n", prog);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	char base[PATH_MAX], path[PATH_MAX + 32], cmd[PATH_MAX + 16];
+	char old[32] = "", val[32];
+	long long limit = 10000, slack, nr = -1, peak = 0;
+	unsigned long long start;
+	int count = 100000;
+	int ret = KSFT_PASS;
+	int i, fd, len, opt;
+	struct stat st;
+
+	while ((opt = getopt(argc, argv, "l:n:")) != -1) {
+		switch (opt) {
+		case 'l':
+			limit = atoll(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc - 1 || limit <= 0 || count <= 0)
+		usage(argv[0]);
+
+	if (geteuid()) {
+		ksft_print_msg("skip: must be run as root\n");
+		return KSFT_SKIP;
+	}
+	fd = open(LIMIT_SYSCTL, O_RDONLY);
+	if (fd < 0 || access(NEGATIVE_PROC, R_OK)) {
+		ksft_print_msg("skip: no negative dentry limit\n");
+		return KSFT_SKIP;
+	}
+	len = read(fd, old, sizeof(old) - 1);
+	old[len > 0 ? len : 0] = '\0';
+	close(fd);
+
+	snprintf(base, sizeof(base), "%s/negative_dentry.XXXXXX",
+		 optind < argc ? argv[optind] : "/var/tmp");
+	if (!mkdtemp(base) || stat(base, &st)) {
+		ksft_print_msg("mkdtemp: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	snprintf(val, sizeof(val), "%lld", limit);
+	len = write_limit(val);
+	if (len) {
+		ksft_print_msg("set limit: %s\n", strerror(-len));
+		ret = KSFT_FAIL;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "%s/missing%d", base, i);
+		if (!stat(path, &st) || errno != ENOENT) {
+			ksft_print_msg("stat %s: %s\n", path, strerror(errno));
+			ret = KSFT_FAIL;
+			goto restore;
+		}
+	}
+
+	slack = SLACK_PER_CPU * sysconf(_SC_NPROCESSORS_CONF);
+	start = now_ns();
+	do {
+		nr = nr_negative(st.st_dev);
+		if (nr > peak)
+			peak = nr;
+		if (nr >= 0 && nr <= limit + slack)
+			break;
+		usleep(10000);
+	} while (now_ns() - start < 5000000000ULL);
+
+	if (nr < 0) {
+		ksft_print_msg("no %s line for %u:%u\n", NEGATIVE_PROC,
+			       major(st.st_dev), minor(st.st_dev));
+		ret = KSFT_FAIL;
+	} else if (nr > limit + slack) {
+		ksft_print_msg("%lld negative dentries, limit %lld\n", nr,
+			       limit);
+		ret = KSFT_FAIL;
+	} else {
+		ksft_print_msg("%lld negative dentries (peak %lld) after %llu msec, limit %lld\n",
+			       nr, peak, (now_ns() - start) / 1000000, limit);
+	}
+
+restore:
+	if (old[0])
+		write_limit(old);
+out:
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", base);
+	if (system(cmd))
+		ksft_print_msg("failed to remove %s\n", base);
+	return ret;
+}
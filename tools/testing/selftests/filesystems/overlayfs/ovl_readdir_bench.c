@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * getdents64() throughput on a large merged overlayfs directory.
+ *
+ * A lower dir with <entries> files is merged with an upper dir that adds a
+ * tenth as many files and whites out one lower file in a hundred.  The merged
+ * dir is then opened, read to the end with getdents64() and closed, again
+ * and again, once with the readdir cache of the overlay module kept across
+ * opens and once with it dropped on every close.
+ *
+ * usage: ovl_readdir_bench [-n entries] [-i iterations]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+
+#include "../../kselftest.h"
+
+#define CACHE_PARAM	"/sys/module/overlay/parameters/readdir_cache_size"
+#define BUF_SIZE	(64 * 1024)
+
+struct linux_dirent64 {
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static char work_dir[] = "/tmp/ovl_readdir.XXXXXX";
+static char merged[PATH_MAX];
+static char mount_opts[PATH_MAX * 3 + 64];
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int make_files(const char *dir, int first, int nr)
+{
+	char path[PATH_MAX];
+	int i, fd;
+
+	for (i = first; i < first + nr; i++) {
+		snprintf(path, sizeof(path), "%s/file-%08d", dir, i);
+		fd = open(path, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0)
+			return -errno;
+		close(fd);
+	}
+	return 0;
+}
+
+static int make_whiteouts(const char *dir, int nr, int step)
+{
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 0; i < nr; i += step) {
+		snprintf(path, sizeof(path), "%s/file-%08d", dir, i);
+		if (mknod(path, S_IFCHR | 0000, makedev(0, 0)))
+			return -errno;
+	}
+	return 0;
+}
+
+/* Read the whole dir, return the number of entries */
+static long read_dir(char *buf)
+{
+	long entries = 0;
+	int fd, len, off;
+
+	fd = open(merged, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -errno;
+
+	while ((len = syscall(SYS_getdents64, fd, buf, BUF_SIZE)) > 0) {
+		for (off = 0; off < len; entries++)
+			off += ((struct linux_dirent64 *)(buf + off))->d_reclen;
+	}
+	close(fd);
+
+	return len < 0 ? -errno : entries;
+}
+
+static int set_cache_param(const char *val)
+{
+	int fd, ret = 0;
+
+	fd = open(CACHE_PARAM, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+static int run(const char *name, int iterations, char *buf)
+{
+	unsigned long long start, first_ns, rest_ns;
+	long entries = 0;
+	int i;
+
+	/* A fresh mount, so that the first listing starts cold */
+	if (mount("overlay", merged, "overlay", 0, mount_opts)) {
+		ksft_print_msg("mount: %s\n", strerror(errno));
+		return KSFT_SKIP;
+	}
+
+	start = now_ns();
+	entries = read_dir(buf);
+	first_ns = now_ns() - start;
+	if (entries < 0) {
+		ksft_print_msg("getdents64: %s\n", strerror(-entries));
+		umount2(merged, 0);
+		return KSFT_FAIL;
+	}
+
+	start = now_ns();
+	for (i = 1; i < iterations; i++) {
+		if (read_dir(buf) != entries) {
+			ksft_print_msg("listing changed between opens\n");
+			umount2(merged, 0);
+			return KSFT_FAIL;
+		}
+	}
+	rest_ns = now_ns() - start;
+	umount2(merged, 0);
+
+	ksft_print_msg("%s: %ld entries, first listing %llu usec, then %llu entries/sec\n",
+		       name, entries, first_ns / 1000,
+		       iterations > 1 ?
+		       entries * (iterations - 1) * 1000000000ULL / rest_ns :
+		       0ULL);
+	return KSFT_PASS;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n entries] [-i iterations]\n", prog);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	char lower[PATH_MAX], upper[PATH_MAX], work[PATH_MAX];
+	char cmd[PATH_MAX + 16], old_param[32] = "";
+	int nr = 50000, iterations = 100;
+	int ret = KSFT_PASS;
+	char *buf;
+	int opt, fd, len;
+
+	while ((opt = getopt(argc, argv, "n:i:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || nr <= 0 || iterations <= 0)
+		usage(argv[0]);
+
+	if (geteuid()) {
+		ksft_print_msg("skip: must be run as root\n");
+		return KSFT_SKIP;
+	}
+
+	buf = malloc(BUF_SIZE);
+	if (!buf || !mkdtemp(work_dir))
+		return KSFT_FAIL;
+
+	snprintf(lower, sizeof(lower), "%s/lower", work_dir);
+	snprintf(upper, sizeof(upper), "%s/upper", work_dir);
+	snprintf(work, sizeof(work), "%s/work", work_dir);
+	snprintf(merged, sizeof(merged), "%s/merged", work_dir);
+	if (mkdir(lower, 0755) || mkdir(upper, 0755) || mkdir(work, 0755) ||
+	    mkdir(merged, 0755)) {
+		ret = KSFT_FAIL;
+		goto out;
+	}
+
+	if (make_files(lower, 0, nr) || make_files(upper, nr, nr / 10) ||
+	    make_whiteouts(upper, nr, 100)) {
+		ksft_print_msg("populate: %s\n", strerror(errno));
+		ret = KSFT_FAIL;
+		goto out;
+	}
+
+	snprintf(mount_opts, sizeof(mount_opts),
+		 "lowerdir=%s,upperdir=%s,workdir=%s", lower, upper, work);
+
+	fd = open(CACHE_PARAM, O_RDONLY);
+	if (fd >= 0) {
+		len = read(fd, old_param, sizeof(old_param) - 1);
+		old_param[len > 0 ? len : 0] = '\0';
+		close(fd);
+	}
+
+	ret = run("cache kept across opens", iterations, buf);
+	if (ret == KSFT_PASS && old_param[0]) {
+		if (set_cache_param("0")) {
+			ksft_print_msg("set %s: %s\n", CACHE_PARAM,
+				       strerror(errno));
+			ret = KSFT_FAIL;
+		} else {
+			ret = run("cache dropped on close", iterations, buf);
+			set_cache_param(old_param);
+		}
+	}
+out:
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", work_dir);
+	if (system(cmd))
+		ksft_print_msg("failed to remove %s\n", work_dir);
+	free(buf);
+	return ret;
+}
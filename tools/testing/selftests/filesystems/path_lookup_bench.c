@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * stat() and open() latency on a deep absolute path.
+ *
+ * A chain of <depth> directories is made under <dir>, with a file at the
+ * bottom, and the absolute path of that file is stat()ed and open()ed+closed,
+ * again and again.  If fs.path_prefix_cache is there and we may write it,
+ * each test runs once with the cache off and once with it on.
+ *
+ * usage: path_lookup_bench [-d depth] [-n count] [dir]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "../kselftest.h"
+
+#define CACHE_SYSCTL	"/proc/sys/fs/path_prefix_cache"
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int set_cache(const char *val)
+{
+	int fd, ret = 0;
+
+	fd = open(CACHE_SYSCTL, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+static int run(const char *name, const char *path, int count)
+{
+	unsigned long long start, stat_ns, open_ns;
+	struct stat st;
+	int i, fd;
+
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		if (stat(path, &st)) {
+			ksft_print_msg("stat: %s\n", strerror(errno));
+			return KSFT_FAIL;
+		}
+	}
+	stat_ns = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			ksft_print_msg("open: %s\n", strerror(errno));
+			return KSFT_FAIL;
+		}
+		close(fd);
+	}
+	open_ns = now_ns() - start;
+
+	ksft_print_msg("%s: stat %llu ns, open+close %llu ns\n", name,
+		       stat_ns / count, open_ns / count);
+	return KSFT_PASS;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-d depth] [-n count] [dir]\n", prog);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	char base[PATH_MAX], path[PATH_MAX], cmd[PATH_MAX + 16], old[8] = "";
+	int depth = 8, count = 1000000;
+	int ret = KSFT_PASS;
+	int i, fd, len, opt;
+	size_t off;
+
+	while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc - 1 || depth <= 0 || count <= 0)
+		usage(argv[0]);
+
+	snprintf(base, sizeof(base), "%s/path_lookup.XXXXXX",
+		 optind < argc ? argv[optind] : "/tmp");
+	if (!mkdtemp(base) || !realpath(base, path)) {
+		ksft_print_msg("mkdtemp: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	off = strlen(path);
+	for (i = 0; i < depth; i++) {
+		off += snprintf(path + off, sizeof(path) - off, "/dir%d", i);
+		if (off >= sizeof(path) - 16 || mkdir(path, 0755)) {
+			ksft_print_msg("mkdir: %s\n", strerror(errno));
+			ret = KSFT_FAIL;
+			goto out;
+		}
+	}
+	snprintf(path + off, sizeof(path) - off, "/file");
+	fd = open(path, O_CREAT | O_WRONLY, 0644);
+	if (fd < 0) {
+		ksft_print_msg("create: %s\n", strerror(errno));
+		ret = KSFT_FAIL;
+		goto out;
+	}
+	close(fd);
+
+	fd = open(CACHE_SYSCTL, O_RDONLY);
+	if (fd >= 0) {
+		len = read(fd, old, sizeof(old) - 1);
+		old[len > 0 ? len : 0] = '\0';
+		close(fd);
+	}
+
+	if (!old[0] || set_cache("0")) {
+		ret = run("default", path, count);
+	} else {
+		ret = run("path_prefix_cache=0", path, count);
+		if (ret == KSFT_PASS && !set_cache("1"))
+			ret = run("path_prefix_cache=1", path, count);
+		set_cache(old);
+	}
+out:
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", base);
+	if (system(cmd))
+		ksft_print_msg("failed to remove %s\n", base);
+	return ret;
+}
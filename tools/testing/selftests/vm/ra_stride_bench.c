@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Buffered read throughput of a file under different access patterns.
+ *
+ * The file is dropped from the page cache before each pass, and then read in
+ * <record size> requests: front to back, back to front, and front to back
+ * every <stride>th record.  The strided and backward passes show whether
+ * readahead picked up the pattern; compare against the same run with the
+ * file opened POSIX_FADV_RANDOM (-r), which turns readahead off.
+ *
+ * With -c the file is read into the page cache once up front and kept there,
+ * which times the page cache lookup and copy paths instead of readahead.
+ *
+ * usage: ra_stride_bench [-c] [-r] [-b record size] [-s stride] <file>
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "../kselftest.h"
+
+enum pattern { SEQUENTIAL, BACKWARD, STRIDE };
+
+static const char * const pattern_names[] = {
+	[SEQUENTIAL]	= "sequential",
+	[BACKWARD]	= "backward",
+	[STRIDE]	= "stride",
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int drop_cache(int fd)
+{
+	if (fsync(fd))
+		return -errno;
+	return -posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static int run(int fd, enum pattern pattern, int cached, int random_advice,
+	       off_t size, size_t bs, int stride, char *buf)
+{
+	unsigned long long start, ns, bytes = 0;
+	off_t nr = size / bs, i, rec;
+	int ret = 0;
+
+	if (!cached)
+		ret = drop_cache(fd);
+	if (!ret && random_advice)
+		ret = -posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+	if (ret) {
+		ksft_print_msg("fadvise: %s\n", strerror(-ret));
+		return KSFT_FAIL;
+	}
+
+	start = now_ns();
+	for (i = 0; i < nr; i++) {
+		switch (pattern) {
+		case SEQUENTIAL:
+			rec = i;
+			break;
+		case BACKWARD:
+			rec = nr - 1 - i;
+			break;
+		case STRIDE:
+			rec = i * stride;
+			if (rec >= nr)
+				goto done;
+			break;
+		}
+		if (pread(fd, buf, bs, rec * bs) != bs) {
+			ksft_print_msg("read: %s\n", strerror(errno));
+			return KSFT_FAIL;
+		}
+		bytes += bs;
+	}
+done:
+	ns = now_ns() - start;
+
+	ksft_print_msg("%s%s%s: %llu MB in %llu msec, %llu MB/s\n",
+		       pattern_names[pattern], cached ? " (cached)" : "",
+		       random_advice ? " (random)" : "",
+		       bytes >> 20, ns / 1000000,
+		       ns ? (bytes * 1000000000ULL / ns) >> 20 : 0ULL);
+	return KSFT_PASS;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c] [-r] [-b record size] [-s stride] <file>\n",
+		prog);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	int cached = 0, random_advice = 0, stride = 8;
+	size_t bs = 16 * 1024;
+	int ret = KSFT_PASS;
+	struct stat st;
+	int fd, opt;
+	char *buf;
+
+	while ((opt = getopt(argc, argv, "crb:s:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cached = 1;
+			break;
+		case 'r':
+			random_advice = 1;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			stride = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !bs || stride <= 1)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		ksft_print_msg("open %s: %s\n", argv[optind], strerror(errno));
+		return KSFT_FAIL;
+	}
+	if (st.st_size < (off_t)bs * stride * 2) {
+		ksft_print_msg("skip: %s is too small\n", argv[optind]);
+		return KSFT_SKIP;
+	}
+
+	buf = malloc(bs);
+	if (!buf)
+		return KSFT_FAIL;
+
+	/* The first pass warms the page cache for the ones that follow */
+	if (cached && run(fd, SEQUENTIAL, 0, 0, st.st_size, bs, stride, buf))
+		ret = KSFT_FAIL;
+	else if (run(fd, SEQUENTIAL, cached, random_advice, st.st_size, bs,
+		     stride, buf) ||
+		 run(fd, BACKWARD, cached, random_advice, st.st_size, bs,
+		     stride, buf) ||
+		 run(fd, STRIDE, cached, random_advice, st.st_size, bs,
+		     stride, buf))
+		ret = KSFT_FAIL;
+
+	free(buf);
+	close(fd);
+	return ret;
+}